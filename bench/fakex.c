@@ -0,0 +1,72 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+#include <stdint.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+#include <xcb/shm.h>
+
+/* the X calls the canvas makes on the paths the benchmarks time, */
+/* which reach no server: the chunks and the overview are built on */
+/* a connection that is not one */
+
+#define FAKE(name, ...) \
+	xcb_void_cookie_t name(__VA_ARGS__) { xcb_void_cookie_t k = { 0 }; return k; }
+
+static xcb_screen_t screen = { .root_depth = 24 };
+
+const struct xcb_setup_t *
+xcb_get_setup(xcb_connection_t *c)
+{
+	(void)(c);
+	return NULL;
+}
+
+xcb_screen_iterator_t
+xcb_setup_roots_iterator(const xcb_setup_t *s)
+{
+	xcb_screen_iterator_t it = { &screen, 1, 0 };
+
+	(void)(s);
+	return it;
+}
+
+uint32_t
+xcb_generate_id(xcb_connection_t *c)
+{
+	static uint32_t id;
+
+	(void)(c);
+	return ++id;
+}
+
+FAKE(xcb_create_gc, xcb_connection_t *c, xcb_gcontext_t g, xcb_drawable_t d,
+		uint32_t mask, const void *values)
+FAKE(xcb_free_gc, xcb_connection_t *c, xcb_gcontext_t g)
+FAKE(xcb_create_pixmap, xcb_connection_t *c, uint8_t depth, xcb_pixmap_t p,
+		xcb_drawable_t d, uint16_t w, uint16_t h)
+FAKE(xcb_free_pixmap, xcb_connection_t *c, xcb_pixmap_t p)
+FAKE(xcb_poly_fill_rectangle, xcb_connection_t *c, xcb_drawable_t d,
+		xcb_gcontext_t g, uint32_t n, const xcb_rectangle_t *r)
+FAKE(xcb_copy_area, xcb_connection_t *c, xcb_drawable_t src, xcb_drawable_t dst,
+		xcb_gcontext_t g, int16_t sx, int16_t sy, int16_t dx, int16_t dy,
+		uint16_t w, uint16_t h)
+FAKE(xcb_put_image, xcb_connection_t *c, uint8_t format, xcb_drawable_t d,
+		xcb_gcontext_t g, uint16_t w, uint16_t h, int16_t x, int16_t y,
+		uint8_t pad, uint8_t depth, uint32_t len, const uint8_t *data)
+FAKE(xcb_shm_detach, xcb_connection_t *c, xcb_shm_seg_t s)
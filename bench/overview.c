@@ -0,0 +1,129 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+/* times the zoomed out view of canvases of growing height, on the */
+/* internals of the canvas and no server, so it is built with them */
+#include "../src/pizarra.c"
+
+#include <stdio.h>
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_FRAMES 50
+
+/* a canvas of n chunks the size of the window, noise all over, as */
+/* the chunks away from the camera are kept when nothing evicts them */
+static Pizarra *
+canvas(int n)
+{
+	int i;
+	size_t k;
+	Chunk *c, *prev;
+	Pizarra *piz;
+
+	piz = xcalloc(1, sizeof(Pizarra));
+	piz->conn = (void *)(1);
+	piz->max_request = 4 << 20;
+	piz->depth = 24;
+	piz->view.width = BENCH_WIDTH;
+	piz->view.height = BENCH_HEIGHT;
+
+	for (prev = NULL, i = 0; i < n; ++i, prev = c) {
+		c = __chunk_new(piz->conn, 0, BENCH_WIDTH, BENCH_HEIGHT, false, NULL);
+		for (k = 0; k < (size_t)(BENCH_WIDTH) * BENCH_HEIGHT; ++k)
+			c->px[k] = k * 2654435761u;
+		c->index = i;
+		c->previous = prev;
+		if (NULL == prev)
+			piz->root = c;
+		else
+			prev->next = c;
+	}
+
+	return piz;
+}
+
+static void
+destroy(Pizarra *piz)
+{
+	Chunk *c, *next;
+
+	for (c = piz->root; c; c = next) {
+		next = c->next;
+		__chunk_destroy(piz->conn, c);
+	}
+
+	__overview_free(piz);
+	free(piz);
+}
+
+/* the first frame, which builds the pyramids of what it shows, then */
+/* frames scrolled back and forth and frames after a dab of damage */
+static void
+run(int n, int zoom)
+{
+	int f;
+	uint64_t first, steady, damaged;
+	Pizarra *piz;
+
+	piz = canvas(n);
+	piz->view.zoom = zoom;
+
+	first = now_us();
+	__overview_compose(piz, 0, 0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+	first = now_us() - first;
+
+	steady = now_us();
+	for (f = 0; f < BENCH_FRAMES; ++f) {
+		piz->view.pos.y = (f % 2) * 64;
+		__overview_compose(piz, 0, 0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+	}
+	steady = (now_us() - steady) / BENCH_FRAMES;
+
+	damaged = now_us();
+	for (f = 0; f < BENCH_FRAMES; ++f) {
+		__chunk_mark_stale(piz->root, &(Box) { 500 + f, 500, 564 + f, 564 });
+		__overview_compose(piz, 0, 0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+	}
+	damaged = (now_us() - damaged) / BENCH_FRAMES;
+
+	printf("%4d chunks (%6d rows), zoom 1/%-2d: first frame %7.2f ms, "
+			"steady %5.2f ms, after a 64x64 dab %5.2f ms\n", n,
+			n * BENCH_HEIGHT, 1 << zoom, first / 1000.0, steady / 1000.0,
+			damaged / 1000.0);
+
+	destroy(piz);
+}
+
+/* usage: overview [chunks...], 8 32 96 by default */
+int
+main(int argc, char **argv)
+{
+	int i, n, zoom;
+	static const int sizes[] = { 8, 32, 96 };
+
+	for (i = 0; i < (argc > 1 ? argc - 1 : 3); ++i) {
+		n = argc > 1 ? atoi(argv[i+1]) : sizes[i];
+		if (n <= 0)
+			die("invalid number of chunks: %s", argv[i+1]);
+		for (zoom = 3; zoom <= 6; zoom += 3)
+			run(n, zoom);
+	}
+
+	return 0;
+}
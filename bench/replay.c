@@ -0,0 +1,184 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+/* times the replay engine against drawing the same dabs a pixel */
+/* at a time, and checks that the threads it draws on change none */
+/* of the pixels the serial replay draws; the number of threads */
+/* is a variable here, to be given on the command line */
+#include <stdio.h>
+
+static long replay_threads;
+
+#undef ZINC_REPLAY_THREADS
+#define ZINC_REPLAY_THREADS replay_threads
+
+#include "../src/pizarra.c"
+
+#define BENCH_WIDTH 1000
+#define BENCH_HEIGHT 700
+#define BENCH_CHUNKS 8
+#define BENCH_PIXELS ((size_t)(BENCH_WIDTH) * BENCH_HEIGHT * BENCH_CHUNKS)
+
+static unsigned long long seed = 4242;
+
+static unsigned long
+rnd(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed;
+}
+
+/* a blank canvas, drawn on with the given number of replay threads */
+static Pizarra *
+canvas(long nthreads)
+{
+	int i;
+	Chunk *c, *prev;
+	Pizarra *piz;
+
+	piz = xcalloc(1, sizeof(Pizarra));
+	piz->conn = (void *)(1);
+	piz->viewport_width = BENCH_WIDTH;
+	piz->viewport_height = BENCH_HEIGHT / 2;
+	piz->zoom_steps = 1;
+
+#ifdef ZINC_USE_LAYERS
+	for (i = 0; i < ZINC_LAYERS; ++i)
+		piz->layer_visible[i] = true;
+#endif
+
+	for (prev = NULL, i = 0; i < BENCH_CHUNKS; ++i, prev = c) {
+		c = __chunk_new(piz->conn, 0, BENCH_WIDTH, BENCH_HEIGHT, false, NULL);
+		c->index = i;
+		c->previous = prev;
+		if (NULL == prev)
+			piz->root = c;
+		else
+			prev->next = c;
+	}
+
+	// read when the workers are started, on the first replay
+	replay_threads = nthreads;
+
+	return piz;
+}
+
+/* the dabs as drawn before there was a replay engine */
+static void
+draw(Pizarra *piz, const PizarraOp *ops, size_t n)
+{
+	int x, y;
+	size_t k;
+	const uint8_t *s;
+
+	for (k = 0; k < n; ++k) {
+		s = brush_stamp(ops[k].size);
+		for (y = -ops[k].size; y < ops[k].size; ++y)
+			for (x = -ops[k].size; x < ops[k].size; ++x, ++s)
+				if (0 != *s)
+					pizarra_blend_pixel(piz, ops[k].x + x - piz->pos.x,
+							ops[k].y + y - piz->pos.y, ops[k].color, *s);
+	}
+}
+
+static uint32_t *
+pixels(Pizarra *piz)
+{
+	int y;
+	uint32_t *px;
+
+	px = xmalloc(BENCH_PIXELS * sizeof(uint32_t));
+
+	for (y = 0; y < BENCH_HEIGHT * BENCH_CHUNKS; ++y)
+		pizarra_read_row(piz, 0, y, &px[(size_t)(y)*BENCH_WIDTH], BENCH_WIDTH);
+
+	return px;
+}
+
+/* usage: replay [dabs [threads]], 100000 dabs and a thread per */
+/* processor by default; exits with 1 when the pixels differ */
+int
+main(int argc, char **argv)
+{
+	long nthreads;
+	size_t k, n;
+	uint64_t tdraw, tserial, tthreads;
+	uint32_t *pdraw, *pserial, *pthreads;
+	PizarraOp *ops;
+	Pizarra *a, *b, *c;
+
+	n = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+	nthreads = argc > 2 ? strtol(argv[2], NULL, 10) : 0;
+
+	if (0 == n || nthreads < 0)
+		die("usage: replay [dabs [threads]]");
+
+	if (0 == nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	ops = xmalloc(n * sizeof(PizarraOp));
+
+	for (k = 0; k < n; ++k) {
+		ops[k] = (PizarraOp) { .type = PIZARRA_OP_DAB, .engine = BRUSH_SOFT };
+		ops[k].size = 1 + rnd() % 24;
+		ops[k].x = rnd() % BENCH_WIDTH;
+		ops[k].y = rnd() % (BENCH_HEIGHT * BENCH_CHUNKS);
+		ops[k].color = rnd() & 0xffffff;
+	}
+
+	a = canvas(1);
+	tdraw = now_us();
+	draw(a, ops, n);
+	tdraw = now_us() - tdraw;
+
+	b = canvas(1);
+	tserial = now_us();
+	pizarra_replay(b, ops, n);
+	tserial = now_us() - tserial;
+
+	c = canvas(nthreads);
+	tthreads = now_us();
+	pizarra_replay(c, ops, n);
+	tthreads = now_us() - tthreads;
+
+	pdraw = pixels(a);
+	pserial = pixels(b);
+	pthreads = pixels(c);
+
+	printf("%zu soft dabs, radius 1-24, %dx%d canvas: a pixel at a time "
+			"%.0f ms, replay on 1 thread %.0f ms (%.1fx), on %ld threads "
+			"%.0f ms (%.1fx)\n", n, BENCH_WIDTH, BENCH_HEIGHT * BENCH_CHUNKS,
+			tdraw / 1000.0, tserial / 1000.0, (double)(tdraw) / tserial,
+			nthreads, tthreads / 1000.0, (double)(tdraw) / tthreads);
+
+	if (0 != memcmp(pdraw, pserial, BENCH_PIXELS * sizeof(uint32_t))) {
+		fprintf(stderr, "replay: the serial replay differs from the dabs "
+				"drawn a pixel at a time\n");
+		return 1;
+	}
+
+	if (0 != memcmp(pserial, pthreads, BENCH_PIXELS * sizeof(uint32_t))) {
+		fprintf(stderr, "replay: the replay on %ld threads differs from "
+				"the serial one\n", nthreads);
+		return 1;
+	}
+
+	return 0;
+}
@@ -8,12 +8,59 @@ MANPREFIX = $(PREFIX)/share/man
 
 PKG_CONFIG = pkg-config
 
-DEPENDENCIES = xcb xcb-shm xcb-image xcb-keysyms xcb-cursor
+# Present extension output (double buffered, with latency statistics),
+# falls back to drawing straight into the window when the server lacks it
+#PRESENTDEPS = xcb-present
+#PRESENTFLAGS = -DZINC_USE_PRESENT
+
+# zoomed out views scaled by the server through the Render extension,
+# in finer steps, falls back to the client side mipmaps when it lacks it
+#XRENDERDEPS = xcb-render
+#XRENDERFLAGS = -DZINC_USE_XRENDER
+
+# render and upload on a thread of its own, fed with damage by the
+# input thread
+#THREADFLAGS = -DZINC_USE_RENDER_THREAD
+
+# strokes kept as vectors in a spatial index, the chunks away from the
+# camera give their memory back and are drawn again from it when needed
+#VECTORFLAGS = -DZINC_USE_VECTOR
+
+# layers drawn on separately and shown or hidden at will, composed
+# into the canvas tile by tile where they change
+#LAYERSFLAGS = -DZINC_USE_LAYERS
+
+# pointer motion through XInput 2, to a fraction of a pixel, falls back
+# to core events when the server lacks it
+#XINPUTDEPS = xcb-xinput
+#XINPUTFLAGS = -DZINC_USE_XINPUT
+
+# the brush stroke drawn a few milliseconds ahead of the pointer, where
+# its speed and acceleration take it, taken back as the pointer gets there
+#PREDICTFLAGS = -DZINC_USE_PREDICTION
+
+# memory counted by owner (history, chunks, shared memory...), live,
+# at its peak and left behind, printed with -s
+#ALLOCFLAGS = -DZINC_USE_ALLOC_STATS
+
+# PNG import through zlib, PPM, PGM and PAM files are always read
+#PNGDEPS = zlib
+#PNGFLAGS = -DZINC_USE_PNG
+
+DEPENDENCIES = xcb xcb-shm xcb-image xcb-keysyms xcb-cursor $(PRESENTDEPS) $(XRENDERDEPS) \
+	$(XINPUTDEPS) $(PNGDEPS)
 
 INCS = $(shell $(PKG_CONFIG) --cflags $(DEPENDENCIES)) -Iinclude
-LIBS = $(shell $(PKG_CONFIG) --libs $(DEPENDENCIES)) -lm
+LIBS = $(shell $(PKG_CONFIG) --libs $(DEPENDENCIES)) -lm -lpthread
 
-CFLAGS = -std=c99 -pedantic -Wall -Wextra -Os $(INCS) -DVERSION=\"$(VERSION)\"
+CFLAGS = -std=c11 -pedantic -Wall -Wextra -Os $(INCS) -D_XOPEN_SOURCE=700 \
+	-DVERSION=\"$(VERSION)\" $(PRESENTFLAGS) $(XRENDERFLAGS) \
+	$(THREADFLAGS) $(VECTORFLAGS) $(LAYERSFLAGS) $(XINPUTFLAGS) $(PNGFLAGS) \
+	$(PREDICTFLAGS) $(ALLOCFLAGS)
 LDFLAGS = -s $(LIBS)
 
 CC = cc
+
+# compiler for the tools run while building (genmasks), the host's
+# when cross compiling
+HOSTCC ?= $(CC)
@@ -0,0 +1,69 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+
+/* largest radius a dab can have */
+#define BRUSH_MAX_SIZE 128
+
+/* how the dabs of a stroke look: fading out towards the edge, or */
+/* opaque all the way to it */
+typedef enum {
+	BRUSH_SOFT,
+	BRUSH_HARD,
+	BRUSH_ENGINES
+} BrushEngine;
+
+/* fills dst with the premultiplied ARGB pixels a dab of the given */
+/* radius puts down over row dy of it (from -size to size - 1) in */
+/* the color: the 2w + 1 of the span brush_spans has for the row */
+typedef void (*BrushKernel)(uint32_t *dst, int size, int dy, uint32_t color);
+
+extern const char *
+brush_engine_name(BrushEngine engine);
+
+/* the kernel dabs of the engine and size are drawn with, the small */
+/* ones spelled out pixel by pixel, the rest a span at a time; meant */
+/* to be looked up once a stroke, not once a dab */
+extern BrushKernel
+brush_kernel(BrushEngine engine, int size);
+
+/* makes what the kernel of the engine and size looks up, which is */
+/* not safe to do from more than one thread at once, done before */
+/* dabs are handed to other threads */
+extern void
+brush_prepare(BrushEngine engine, int size);
+
+/* half widths w of the rows of a dab of the given radius, from the */
+/* top one: a row covers -w to w from the center, nothing when w is */
+/* negative; made the first time a size is asked for, as stamps are */
+extern const int *
+brush_spans(int size);
+
+/* opacity of every pixel of a dab of the given radius: a square */
+/* 2 * size pixels a side around its center, row by row, 0 outside */
+/* the circle; made the first time a size is asked for, which is */
+/* not safe to do from more than one thread at once */
+extern const uint8_t *
+brush_stamp(int size);
+
+extern void
+brush_free(void);
@@ -0,0 +1,71 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <xcb/xcb.h>
+
+typedef struct Clipboard Clipboard;
+
+/* pixels of the largest rectangle that can be offered, 8192 by */
+/* 8192; it is read whole into memory before it is encoded */
+#define CLIPBOARD_MAX_PIXELS ((size_t)(1) << 26)
+
+/* fills px with the w by h XRGB pixels of the canvas rectangle at */
+/* x, y, as they are to be copied */
+typedef void (*ClipboardReader)(int x, int y, int w, int h, uint32_t *px, void *data);
+
+/* offers a rectangle of the canvas on the CLIPBOARD selection of */
+/* the X server as image/png and image/x-portable-pixmap, read with */
+/* reader and encoded on a thread of its own only once asked for */
+extern Clipboard *
+clipboard_new(xcb_connection_t *conn, xcb_window_t win,
+		ClipboardReader reader, void *data);
+
+/* takes the CLIPBOARD over with the canvas rectangle, false when */
+/* it is empty or larger than CLIPBOARD_MAX_PIXELS */
+extern bool
+clipboard_set(Clipboard *cb, int x, int y, int w, int h, xcb_timestamp_t time);
+
+/* the canvas changed within [x0, x1) by [y0, y1), what was encoded */
+/* of the rectangle, if it reaches into it, is encoded again */
+extern void
+clipboard_damage(Clipboard *cb, int x0, int y0, int x1, int y1);
+
+/* selection requests, and the property deletions INCR transfers */
+/* go on with, anything else is left alone */
+extern bool
+clipboard_try_process_event(Clipboard *cb, const xcb_generic_event_t *ev);
+
+/* readable once an encoding is done, which clipboard_process then */
+/* hands to the requests waiting for it */
+extern int
+clipboard_get_pollfd(const Clipboard *cb);
+
+extern void
+clipboard_process(Clipboard *cb);
+
+extern void
+clipboard_print_stats(const Clipboard *cb, FILE *fp);
+
+extern void
+clipboard_destroy(Clipboard *cb);
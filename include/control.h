@@ -0,0 +1,99 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <poll.h>
+
+#include "brush.h"
+
+/* what zinc is sent through its control socket: commands one after */
+/* the other, each a ControlHeader, followed by a.size ControlPoint */
+/* for CONTROL_STROKE, all in the byte order of the machine */
+typedef enum {
+	/* a: 0xRRGGBB the strokes after it are drawn with */
+	CONTROL_COLOR,
+
+	/* a: brush size the strokes after it are drawn with */
+	CONTROL_SIZE,
+
+	/* a: number of points of the polyline, in canvas coordinates */
+	CONTROL_STROKE,
+
+	/* a, b: how far to move the camera */
+	CONTROL_CAMERA,
+
+	CONTROL_UNDO,
+	CONTROL_REDO,
+
+	/* a: brush engine the strokes after it are drawn with */
+	CONTROL_BRUSH
+} ControlOp;
+
+typedef struct {
+	uint8_t op;
+	uint8_t pad[3];
+	int32_t a, b;
+} ControlHeader;
+
+typedef struct {
+	int32_t x, y;
+} ControlPoint;
+
+/* clients connected at once at most, the next ones are turned */
+/* away, points a stroke can have at most, and how far from the */
+/* origin they can be, the canvas growing to take them in, as far */
+/* as the camera moves at once */
+#define CONTROL_MAX_CLIENTS 8
+#define CONTROL_MAX_POINTS (1 << 20)
+#define CONTROL_MAX_COORD (1 << 16)
+
+/* a command as it is handed over: strokes arrive whole, with the */
+/* color, size and brush engine their client asked for last */
+typedef struct {
+	ControlOp op;
+	int a, b;
+	uint32_t color;
+	int size;
+	BrushEngine engine;
+	const ControlPoint *points;
+	int npoints;
+} ControlCommand;
+
+typedef struct ControlServer ControlServer;
+
+typedef void (*ControlCommandHandler)(const ControlCommand *cmd, void *data);
+
+extern ControlServer *
+control_new(const char *path);
+
+extern int
+control_get_pollfds(const ControlServer *server, struct pollfd *pfds, int max);
+
+extern int
+control_process(ControlServer *server, ControlCommandHandler handler, void *data);
+
+extern void
+control_print_stats(const ControlServer *server, FILE *fp);
+
+extern void
+control_destroy(ControlServer *server);
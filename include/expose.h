@@ -0,0 +1,39 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <xcb/xcb.h>
+
+/* rectangles kept apart at most, the next ones are merged into the */
+/* last */
+#define EXPOSE_MAX_RECTS 16
+
+/* the rectangles of a series of Expose events, as they come */
+typedef struct {
+	xcb_rectangle_t rects[EXPOSE_MAX_RECTS];
+	int nrects;
+	bool done;
+} Expose;
+
+/* adds what the event exposed, true once the server says no more */
+/* of the series are coming, rects being then what to repaint, until */
+/* the next series starts */
+extern bool
+expose_add(Expose *ex, const xcb_expose_event_t *ev);
@@ -21,6 +21,28 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "image.h"
+#include "brush.h"
+
+typedef enum {
+	HISTORY_ACTION_STROKE,
+	HISTORY_ACTION_FILL,
+	HISTORY_ACTION_IMAGE,
+	HISTORY_ACTION_SELECTION
+} HistoryActionType;
+
+typedef enum {
+	HISTORY_SELECTION_MOVE,
+	HISTORY_SELECTION_COPY,
+	HISTORY_SELECTION_ERASE
+} HistorySelectionMode;
+
+/* canvas row y, columns [x0, x1) */
+typedef struct {
+	int y;
+	int x0, x1;
+} HistorySpan;
+
 typedef struct HistoryAtomicAction HistoryAtomicAction;
 typedef struct HistoryUserAction HistoryUserAction;
 typedef struct History History;
@@ -34,13 +56,49 @@ struct HistoryAtomicAction {
 
 struct HistoryUserAction {
 	HistoryUserAction *prev;
+	HistoryActionType type;
+
+	/* order in which the actions were done, later ones are higher */
+	unsigned long id;
+
+	/* layer it was drawn on */
+	int layer;
+
+	/* HISTORY_ACTION_STROKE, and the last of them, where the next */
+	/* one goes, and what its dabs are drawn with */
 	HistoryAtomicAction *aa;
+	HistoryAtomicAction *aa_last;
+	BrushEngine engine;
+
+	/* HISTORY_ACTION_FILL */
+	struct {
+		uint32_t color;
+		int nspans;
+		HistorySpan *spans;
+	} fill;
+
+	/* HISTORY_ACTION_IMAGE, its top left corner on the canvas */
+	struct {
+		int x, y;
+		Image *image;
+	} image;
+
+	/* HISTORY_ACTION_SELECTION, the canvas rectangle and how far */
+	/* it went, and what was in it when it has to be kept */
+	struct {
+		HistorySelectionMode mode;
+		int x, y, w, h;
+		int dx, dy;
+		Image *image;
+	} selection;
+
 	HistoryUserAction *next;
 };
 
 struct History {
 	HistoryUserAction *root;
 	HistoryUserAction *current;
+	unsigned long last_id;
 };
 
 extern History *
@@ -49,6 +107,23 @@ history_new(void);
 extern HistoryUserAction *
 history_user_action_new(void);
 
+extern HistoryUserAction *
+history_user_action_fill_new(uint32_t color, int nspans);
+
+extern HistoryUserAction *
+history_user_action_image_new(int x, int y, Image *image);
+
+extern HistoryUserAction *
+history_user_action_selection_new(HistorySelectionMode mode, int x, int y,
+		int w, int h, int dx, int dy);
+
+extern void
+history_user_action_destroy(HistoryUserAction *hua);
+
+extern void
+history_user_action_get_bounds(const HistoryUserAction *hua, int *x0, int *y0,
+		int *x1, int *y1);
+
 extern HistoryAtomicAction *
 history_atomic_action_new(int x, int y, uint32_t color, int size);
 
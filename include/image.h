@@ -0,0 +1,72 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* side of the square tiles images are kept in */
+#define IMAGE_TILE 64
+
+/* an image as tiles of premultiplied ARGB, NULL where it is */
+/* fully transparent */
+typedef struct {
+	int width, height;
+	int tiles_x, tiles_y;
+	uint32_t **tiles;
+} Image;
+
+/* decodes PPM, PGM and PAM files (and PNG files when compiled */
+/* with zlib) one row at a time */
+typedef struct ImageReader ImageReader;
+
+extern ImageReader *
+image_reader_open(const char *path, const char **error);
+
+extern int
+image_reader_width(const ImageReader *ir);
+
+extern int
+image_reader_height(const ImageReader *ir);
+
+/* the next row, as premultiplied ARGB */
+extern bool
+image_reader_read_row(ImageReader *ir, uint32_t *row);
+
+extern void
+image_reader_close(ImageReader *ir);
+
+extern Image *
+image_new(int width, int height);
+
+extern void
+image_set_row(Image *img, int y, const uint32_t *row);
+
+extern size_t
+image_size(const Image *img);
+
+extern void
+image_destroy(Image *img);
+
+extern uint8_t *
+image_encode_png(const uint32_t *px, int w, int h, size_t *size);
+
+extern uint8_t *
+image_encode_ppm(const uint32_t *px, int w, int h, size_t *size);
@@ -0,0 +1,34 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* packs the n pixels, in rows of w, into a buffer of its own: runs */
+/* of the same pixel and of pixels the same as those right above */
+/* take a few bytes, a blank chunk packs into less than a kilobyte; */
+/* it is given back with xfree */
+extern uint8_t *
+pack_pixels(const uint32_t *px, int w, int n, size_t *size);
+
+/* unpacks what pack_pixels made of n pixels in rows of w into px */
+extern void
+unpack_pixels(const uint8_t *data, size_t size, uint32_t *px, int w, int n);
@@ -0,0 +1,39 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+/* averages every 2x2 block of XRGB pixels of the rows r0 and r1 */
+/* (2n pixels each) into n pixels of dst */
+extern void
+pixel_downsample_2x2(uint32_t *dst, const uint32_t *r0, const uint32_t *r1, int n);
+
+/* color (XRGB) at the given opacity, as premultiplied ARGB */
+extern uint32_t
+pixel_premultiply(uint32_t color, uint8_t alpha);
+
+/* composites n premultiplied ARGB pixels of src over dst */
+extern void
+pixel_blend_over(uint32_t *dst, const uint32_t *src, int n);
+
+/* n XRGB pixels of hue h at lightness l, the first one with */
+/* saturation s and every next one ds further (all from 0 to 1) */
+extern void
+pixel_hsl_row(uint32_t *dst, float h, float s, float ds, float l, int n);
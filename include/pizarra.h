@@ -18,23 +18,95 @@
 
 #pragma once
 
+#include <stdio.h>
+#include <stdbool.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 
+#include "brush.h"
+
+#define ZINC_BACKGROUND_COLOR 0x1e1e1e
+
+/* number of layers, when compiled with them */
+#ifndef ZINC_LAYERS
+#define ZINC_LAYERS 4
+#endif
+
 typedef struct Pizarra Pizarra;
 
+/* draws again what belongs in the canvas rectangle x, y, w, h, */
+/* through pizarra_set_pixel, pizarra_fill_span or pizarra_replay, */
+/* which only reach inside it while it runs */
+typedef void (*PizarraLoader)(Pizarra *piz, int x, int y, int w, int h, void *data);
+
+/* canvas row y, columns [x0, x1) */
+typedef struct {
+	int y;
+	int x0, x1;
+} PizarraSpan;
+
+typedef enum {
+	PIZARRA_OP_DAB,
+	PIZARRA_OP_SPAN,
+	PIZARRA_OP_ROW,
+	PIZARRA_OP_COPY
+} PizarraOpType;
+
+/* something to draw on the canvas, in canvas coordinates: a brush */
+/* dab centered on x, y, or a span filled with the color, or a row */
+/* of premultiplied ARGB pixels blended over it, or put in place of */
+/* what is there, from x, y on */
+typedef struct {
+	PizarraOpType type;
+	int layer;
+	int x, y;
+
+	/* radius of the dab, length of the span or row */
+	int size;
+
+	/* what the dab is drawn with */
+	BrushEngine engine;
+
+	uint32_t color;
+	const uint32_t *src;
+} PizarraOp;
+
 extern Pizarra *
 pizarra_new(xcb_connection_t *conn, xcb_window_t win);
 
+extern bool
+pizarra_try_process_event(Pizarra *piz, const xcb_generic_event_t *ge);
+
+extern void
+pizarra_render_region(Pizarra *piz, int x, int y, int w, int h);
+
 extern void
 pizarra_render(Pizarra *piz);
 
+extern bool
+pizarra_has_pending_uploads(Pizarra *piz);
+
+/* readable when the render thread may have queued events read off */
+/* the connection; -1 when there is no render thread */
+extern int
+pizarra_get_pollfd(const Pizarra *piz);
+
+/* consumes what made the descriptor above readable */
+extern void
+pizarra_drain_pollfd(Pizarra *piz);
+
 extern void
 pizarra_camera_move_relative(Pizarra *piz, int offx, int offy);
 
 extern void
 pizarra_camera_move_to_center(Pizarra *piz);
 
+extern void
+pizarra_camera_zoom(Pizarra *piz, int levels, int x, int y);
+
+extern int
+pizarra_camera_get_zoom(const Pizarra *piz);
+
 extern void
 pizarra_set_viewport(Pizarra *piz, int vw, int vh);
 
@@ -44,6 +116,39 @@ pizarra_set_pixel(Pizarra *piz, int x, int y, uint32_t color);
 extern int
 pizarra_get_pixel(Pizarra *piz, int x, int y, uint32_t *color);
 
+extern void
+pizarra_blend_row(Pizarra *piz, int x, int y, const uint32_t *src, int n);
+
+extern void
+pizarra_blend_span(Pizarra *piz, int x, int y, const uint32_t *src, int n);
+
+extern void
+pizarra_blend_pixel(Pizarra *piz, int x, int y, uint32_t color, uint8_t alpha);
+
+extern int
+pizarra_flood_fill(Pizarra *piz, int x, int y, uint32_t color, PizarraSpan **spans);
+
+extern void
+pizarra_fill_span(Pizarra *piz, int y, int x0, int x1, uint32_t color);
+
+extern void
+pizarra_replay(Pizarra *piz, const PizarraOp *ops, size_t nops);
+
+extern void
+pizarra_read_row(Pizarra *piz, int x, int y, uint32_t *dst, int n);
+
+extern void
+pizarra_read_shown_row(Pizarra *piz, int x, int y, uint32_t *dst, int n);
+
+extern void
+pizarra_move_rect(Pizarra *piz, int x, int y, int w, int h, int dx, int dy, bool copy);
+
+extern void
+pizarra_erase_rect(Pizarra *piz, int x, int y, int w, int h);
+
+extern void
+pizarra_fetch(Pizarra *piz, int y, int h);
+
 extern void
 pizarra_camera_to_canvas_pos(Pizarra *piz, int x, int y, int *out_x, int *out_y);
 
@@ -53,5 +158,52 @@ pizarra_canvas_to_camera_pos(Pizarra *piz, int x, int y, int *out_x, int *out_y)
 extern void
 pizarra_clear(Pizarra *piz);
 
+#ifdef ZINC_USE_LAYERS
+extern void
+pizarra_set_layer(Pizarra *piz, int layer);
+
+extern int
+pizarra_get_layer(const Pizarra *piz);
+
+extern void
+pizarra_toggle_layer(Pizarra *piz, int layer);
+
+extern bool
+pizarra_layer_is_visible(const Pizarra *piz, int layer);
+#endif
+
+extern void
+pizarra_overlay_begin(Pizarra *piz);
+
+extern void
+pizarra_overlay_commit(Pizarra *piz);
+
+extern void
+pizarra_overlay_clear(Pizarra *piz);
+
+extern void
+pizarra_overlay_cancel(Pizarra *piz);
+
+extern void
+pizarra_overlay_clip(Pizarra *piz, int x, int y, int w, int h);
+
+extern void
+pizarra_overlay_mark(Pizarra *piz);
+
+extern void
+pizarra_overlay_rewind(Pizarra *piz);
+
+extern void
+pizarra_set_memory_budget(Pizarra *piz, size_t bytes);
+
+extern void
+pizarra_set_loader(Pizarra *piz, PizarraLoader loader, void *data);
+
+extern void
+pizarra_reload(Pizarra *piz);
+
+extern void
+pizarra_print_stats(const Pizarra *piz, FILE *fp);
+
 extern void
 pizarra_destroy(Pizarra *piz);
@@ -0,0 +1,55 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct Timelapse Timelapse;
+
+/* pixels a frame can be at most either way */
+#define TIMELAPSE_MAX_SIDE 8192
+
+/* writes frames of w by h pixels (both even, TIMELAPSE_MAX_SIDE at */
+/* most) to fp as a YUV4MPEG2 stream, fps of them a second, */
+/* converted and written on a thread of its own while the next one */
+/* is drawn */
+extern Timelapse *
+timelapse_new(FILE *fp, int w, int h, int fps);
+
+/* the w by h XRGB pixels of the next frame, to be filled in and */
+/* handed over with timelapse_push, once the writer is done with */
+/* what was there */
+extern uint32_t *
+timelapse_frame(Timelapse *tl);
+
+extern void
+timelapse_push(Timelapse *tl);
+
+/* waits for every frame pushed to be written */
+extern void
+timelapse_flush(Timelapse *tl);
+
+extern void
+timelapse_print_stats(const Timelapse *tl, FILE *fp);
+
+/* writes whatever was pushed, and lets go of the rest */
+extern void
+timelapse_destroy(Timelapse *tl);
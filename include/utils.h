@@ -19,6 +19,29 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define MIN(a,b) ((a)<(b)?(a):(b))
+#define MAX(a,b) ((a)>(b)?(a):(b))
+
+/* who the memory from the tagged allocators is for, kept apart in */
+/* the statistics */
+typedef enum {
+	ALLOC_HISTORY,
+	ALLOC_CHUNKS,
+	ALLOC_SHM,
+	ALLOC_LAYERS,
+	ALLOC_COLD,
+	ALLOC_OVERLAY,
+	ALLOC_IMAGE,
+	ALLOC_VECTOR,
+	ALLOC_PICKER,
+	ALLOC_CONTROL,
+	ALLOC_TIMELAPSE,
+	ALLOC_CLIPBOARD,
+	ALLOC_TAGS
+} AllocTag;
 
 extern void
 die(const char *fmt, ...);
@@ -28,3 +51,41 @@ xmalloc(size_t size);
 
 extern void *
 xcalloc(size_t nmemb, size_t size);
+
+extern void *
+xrealloc(void *ptr, size_t size);
+
+/* microseconds on CLOCK_MONOTONIC, what every timing is taken with */
+extern uint64_t
+now_us(void);
+
+#ifdef ZINC_USE_ALLOC_STATS
+/* as xmalloc, xcalloc and xrealloc, but the memory is counted */
+/* under the tag, and has to be given back with xfree */
+extern void *
+xmalloc_tagged(AllocTag tag, size_t size);
+
+extern void *
+xcalloc_tagged(AllocTag tag, size_t nmemb, size_t size);
+
+extern void *
+xrealloc_tagged(AllocTag tag, void *ptr, size_t size);
+
+extern void
+xfree(void *ptr);
+
+/* counts memory that did not come from malloc (e.g. shared memory */
+/* segments), given back when bytes is negative */
+extern void
+alloc_note(AllocTag tag, long bytes);
+
+extern void
+alloc_print_stats(FILE *fp);
+#else
+#define xmalloc_tagged(tag, size) xmalloc(size)
+#define xcalloc_tagged(tag, nmemb, size) xcalloc(nmemb, size)
+#define xrealloc_tagged(tag, ptr, size) xrealloc(ptr, size)
+#define xfree(ptr) free(ptr)
+#define alloc_note(tag, bytes) ((void) (tag), (void) (bytes))
+#define alloc_print_stats(fp) ((void) (fp))
+#endif
@@ -0,0 +1,44 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#include "history.h"
+
+typedef struct VectorIndex VectorIndex;
+
+extern VectorIndex *
+vector_index_new(void);
+
+extern void
+vector_index_insert(VectorIndex *vi, HistoryUserAction *hua);
+
+extern void
+vector_index_remove(VectorIndex *vi, HistoryUserAction *hua);
+
+extern int
+vector_index_query(VectorIndex *vi, int x, int y, int w, int h,
+		HistoryUserAction ***huas);
+
+extern size_t
+vector_index_count(const VectorIndex *vi);
+
+extern void
+vector_index_destroy(VectorIndex *vi);
@@ -0,0 +1,200 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "brush.h"
+
+static const char *engine_names[BRUSH_ENGINES] = {
+	[BRUSH_SOFT] = "soft",
+	[BRUSH_HARD] = "hard"
+};
+
+/* stamps and spans made so far, indexed by size */
+static uint8_t **stamps;
+static int nstamps;
+static int **spans;
+static int nspans;
+
+/* x * a / 255 for every byte of x, rounded, as pixel_premultiply */
+/* has it, inlined into the kernels */
+static inline uint32_t
+__brush_scale(uint32_t x, uint32_t a)
+{
+	uint32_t rb, ag;
+
+	rb = (x & 0xff00ff) * a + 0x800080;
+	rb = ((rb + ((rb >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+	ag = ((x >> 8) & 0xff00ff) * a + 0x800080;
+	ag = (ag + ((ag >> 8) & 0xff00ff)) & 0xff00ff00;
+
+	return rb | ag;
+}
+
+#include "brushmasks.h"
+
+static uint8_t *
+__brush_stamp_new(int size)
+{
+	int dx, dy;
+	uint8_t *stamp, *p;
+
+	p = stamp = xmalloc(4 * size * size);
+
+	for (dy = -size; dy < size; ++dy) {
+		for (dx = -size; dx < size; ++dx, ++p) {
+			if (dy * dy + dx * dx >= size * size)
+				*p = 0;
+			else
+				// fades out towards the edge
+				*p = lround(255 * (1 - sqrt(dy * dy + dx * dx) / size));
+		}
+	}
+
+	return stamp;
+}
+
+static int *
+__brush_spans_new(int size)
+{
+	int dy, w, *s;
+
+	s = xmalloc(2 * size * sizeof(int));
+
+	// the pixels whose center is inside the circle, as in the stamp
+	for (dy = -size; dy < size; ++dy) {
+		for (w = -1; w + 1 < size && (w + 1) * (w + 1) + dy * dy < size * size; ++w)
+			;
+		s[dy + size] = w;
+	}
+
+	return s;
+}
+
+/* the soft stamp, over the span of the row */
+static void
+__brush_soft_span(uint32_t *dst, int size, int dy, uint32_t color)
+{
+	int i, w;
+	uint32_t c;
+	const uint8_t *alpha;
+
+	w = spans[size][dy + size];
+	c = (color & 0xffffff) | 0xff000000;
+	alpha = &stamps[size][(dy + size) * 2 * size + size - w];
+
+	for (i = 0; i < 2 * w + 1; ++i)
+		dst[i] = __brush_scale(c, alpha[i]);
+}
+
+static void
+__brush_hard_span(uint32_t *dst, int size, int dy, uint32_t color)
+{
+	int i, w;
+	uint32_t c;
+
+	w = spans[size][dy + size];
+	c = (color & 0xffffff) | 0xff000000;
+
+	for (i = 0; i < 2 * w + 1; ++i)
+		dst[i] = c;
+}
+
+static const BrushKernel __brush_large[BRUSH_ENGINES] = {
+	[BRUSH_SOFT] = __brush_soft_span,
+	[BRUSH_HARD] = __brush_hard_span
+};
+
+extern const char *
+brush_engine_name(BrushEngine engine)
+{
+	return engine_names[engine];
+}
+
+extern BrushKernel
+brush_kernel(BrushEngine engine, int size)
+{
+	return size <= BRUSH_SMALL ? __brush_small[engine][size] : __brush_large[engine];
+}
+
+extern void
+brush_prepare(BrushEngine engine, int size)
+{
+	brush_spans(size);
+
+	if (BRUSH_SOFT == engine && size > BRUSH_SMALL)
+		brush_stamp(size);
+}
+
+extern const int *
+brush_spans(int size)
+{
+	if (size <= 0)
+		return NULL;
+
+	if (size >= nspans) {
+		spans = xrealloc(spans, (size + 1) * sizeof(int *));
+		while (nspans <= size)
+			spans[nspans++] = NULL;
+	}
+
+	if (NULL == spans[size])
+		spans[size] = __brush_spans_new(size);
+
+	return spans[size];
+}
+
+extern const uint8_t *
+brush_stamp(int size)
+{
+	if (size <= 0)
+		return NULL;
+
+	if (size >= nstamps) {
+		stamps = xrealloc(stamps, (size + 1) * sizeof(uint8_t *));
+		while (nstamps <= size)
+			stamps[nstamps++] = NULL;
+	}
+
+	if (NULL == stamps[size])
+		stamps[size] = __brush_stamp_new(size);
+
+	return stamps[size];
+}
+
+extern void
+brush_free(void)
+{
+	int i;
+
+	for (i = 0; i < nstamps; ++i)
+		free(stamps[i]);
+
+	for (i = 0; i < nspans; ++i)
+		free(spans[i]);
+
+	free(stamps);
+	free(spans);
+	stamps = NULL;
+	spans = NULL;
+	nstamps = nspans = 0;
+}
@@ -0,0 +1,638 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "utils.h"
+#include "image.h"
+#include "clipboard.h"
+
+/* largest piece of an image written to a property at once, those */
+/* bigger go in pieces of it through INCR */
+#define CLIPBOARD_PIECE (256 * 1024)
+
+/* requests waiting for an encoding, and INCR transfers going on, */
+/* at once at most */
+#define CLIPBOARD_MAX_WAITING 16
+#define CLIPBOARD_MAX_TRANSFERS 8
+
+typedef enum {
+	CLIPBOARD_PNG,
+	CLIPBOARD_PPM,
+	CLIPBOARD_FORMATS
+} ClipboardFormat;
+
+static const char *clipboard_mime[CLIPBOARD_FORMATS] = {
+	[CLIPBOARD_PNG] = "image/png",
+	[CLIPBOARD_PPM] = "image/x-portable-pixmap"
+};
+
+/* an encoded image, held by the cache and by the transfers still */
+/* sending it */
+typedef struct {
+	int refs;
+	uint8_t *data;
+	size_t size;
+} ClipboardData;
+
+typedef struct {
+	xcb_window_t requestor;
+	xcb_atom_t target;
+	xcb_atom_t property;
+	xcb_timestamp_t time;
+	ClipboardFormat format;
+	unsigned long damage;
+} ClipboardRequest;
+
+/* sent a piece at a time, each once the requestor deleted the last */
+typedef struct {
+	xcb_window_t requestor;
+	xcb_atom_t target;
+	xcb_atom_t property;
+	ClipboardData *data;
+	size_t sent;
+} ClipboardTransfer;
+
+struct Clipboard {
+	xcb_connection_t *conn;
+	xcb_window_t win;
+	ClipboardReader reader;
+	void *reader_data;
+
+	xcb_atom_t CLIPBOARD, TARGETS, TIMESTAMP, INCR, ATOM;
+	xcb_atom_t formats[CLIPBOARD_FORMATS];
+	size_t piece;
+
+	/* the canvas rectangle offered, since when, what was encoded */
+	/* of it and how many times it changed */
+	bool owned;
+	int x, y, w, h;
+	xcb_timestamp_t time;
+	ClipboardData *cache[CLIPBOARD_FORMATS];
+	unsigned long damage;
+
+	ClipboardRequest waiting[CLIPBOARD_MAX_WAITING];
+	int nwaiting;
+	ClipboardTransfer transfers[CLIPBOARD_MAX_TRANSFERS];
+	int ntransfers;
+
+	/* the encoder: the pixels of the job and what they became, */
+	/* and a pipe it writes a byte to when it is done; a job read */
+	/* before the rectangle last changed is only good for the */
+	/* requests that came before that */
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int pipe[2];
+	bool busy, ready, quit;
+	ClipboardFormat job_format;
+	uint32_t *job_px;
+	int job_w, job_h;
+	uint8_t *job_data;
+	size_t job_size;
+	uint64_t job_time;
+	unsigned long job_damage;
+
+	unsigned long requests;
+	unsigned long encodes;
+	unsigned long hits;
+	unsigned long refused;
+	unsigned long incr;
+	unsigned long long bytes;
+	uint64_t encode_total;
+	uint64_t encode_max;
+};
+
+static void *
+__clipboard_encoder(void *arg)
+{
+	uint64_t start;
+	uint8_t *data;
+	size_t size;
+	Clipboard *cb;
+
+	cb = arg;
+	pthread_mutex_lock(&cb->lock);
+
+	for (;;) {
+		if (cb->quit)
+			break;
+
+		if (!cb->busy || cb->ready) {
+			pthread_cond_wait(&cb->cond, &cb->lock);
+			continue;
+		}
+
+		// the job is left alone by the event loop until it is
+		// marked ready
+		pthread_mutex_unlock(&cb->lock);
+		start = now_us();
+		if (cb->job_format == CLIPBOARD_PNG)
+			data = image_encode_png(cb->job_px, cb->job_w, cb->job_h, &size);
+		else
+			data = image_encode_ppm(cb->job_px, cb->job_w, cb->job_h, &size);
+		pthread_mutex_lock(&cb->lock);
+
+		cb->job_data = data;
+		cb->job_size = size;
+		cb->job_time = now_us() - start;
+		cb->ready = true;
+
+		if (write(cb->pipe[1], "", 1) < 0)
+			die("can't wake the event loop up");
+	}
+
+	pthread_mutex_unlock(&cb->lock);
+	return NULL;
+}
+
+static xcb_atom_t
+__clipboard_reply_atom(xcb_connection_t *conn, xcb_intern_atom_cookie_t cookie)
+{
+	xcb_atom_t atom;
+	xcb_intern_atom_reply_t *reply;
+
+	if (NULL == (reply = xcb_intern_atom_reply(conn, cookie, NULL)))
+		die("xcb_intern_atom failed");
+
+	atom = reply->atom;
+	free(reply);
+
+	return atom;
+}
+
+static xcb_intern_atom_cookie_t
+__clipboard_intern(xcb_connection_t *conn, const char *name)
+{
+	return xcb_intern_atom(conn, 0, strlen(name), name);
+}
+
+extern Clipboard *
+clipboard_new(xcb_connection_t *conn, xcb_window_t win,
+		ClipboardReader reader, void *data)
+{
+	int f;
+	Clipboard *cb;
+	xcb_intern_atom_cookie_t cookies[5 + CLIPBOARD_FORMATS];
+
+	cb = xcalloc_tagged(ALLOC_CLIPBOARD, 1, sizeof(Clipboard));
+	cb->conn = conn;
+	cb->win = win;
+	cb->reader = reader;
+	cb->reader_data = data;
+
+	// all asked for before any answer is waited on
+	cookies[0] = __clipboard_intern(conn, "CLIPBOARD");
+	cookies[1] = __clipboard_intern(conn, "TARGETS");
+	cookies[2] = __clipboard_intern(conn, "INCR");
+	cookies[3] = __clipboard_intern(conn, "ATOM");
+	cookies[4] = __clipboard_intern(conn, "TIMESTAMP");
+	for (f = 0; f < CLIPBOARD_FORMATS; ++f)
+		cookies[5+f] = __clipboard_intern(conn, clipboard_mime[f]);
+
+	cb->CLIPBOARD = __clipboard_reply_atom(conn, cookies[0]);
+	cb->TARGETS = __clipboard_reply_atom(conn, cookies[1]);
+	cb->INCR = __clipboard_reply_atom(conn, cookies[2]);
+	cb->ATOM = __clipboard_reply_atom(conn, cookies[3]);
+	cb->TIMESTAMP = __clipboard_reply_atom(conn, cookies[4]);
+	for (f = 0; f < CLIPBOARD_FORMATS; ++f)
+		cb->formats[f] = __clipboard_reply_atom(conn, cookies[5+f]);
+
+	// a ChangeProperty request carries the data, and 24 bytes
+	cb->piece = MIN(CLIPBOARD_PIECE, xcb_get_maximum_request_length(conn) * 4 - 24);
+
+	if (pipe(cb->pipe) < 0)
+		die("can't create a pipe");
+
+	fcntl(cb->pipe[0], F_SETFL, fcntl(cb->pipe[0], F_GETFL) | O_NONBLOCK);
+
+	pthread_mutex_init(&cb->lock, NULL);
+	pthread_cond_init(&cb->cond, NULL);
+
+	if (pthread_create(&cb->thread, NULL, __clipboard_encoder, cb) != 0)
+		die("pthread_create failed");
+
+	return cb;
+}
+
+static void
+__clipboard_data_unref(ClipboardData *d)
+{
+	if (NULL != d && 0 == --d->refs) {
+		xfree(d->data);
+		xfree(d);
+	}
+}
+
+static void
+__clipboard_drop_cache(Clipboard *cb)
+{
+	int f;
+
+	for (f = 0; f < CLIPBOARD_FORMATS; ++f) {
+		__clipboard_data_unref(cb->cache[f]);
+		cb->cache[f] = NULL;
+	}
+
+	cb->damage++;
+}
+
+static void
+__clipboard_notify(Clipboard *cb, const ClipboardRequest *req, xcb_atom_t property)
+{
+	union {
+		xcb_selection_notify_event_t ev;
+		char bytes[32];
+	} msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.ev.response_type = XCB_SELECTION_NOTIFY;
+	msg.ev.time = req->time;
+	msg.ev.requestor = req->requestor;
+	msg.ev.selection = cb->CLIPBOARD;
+	msg.ev.target = req->target;
+	msg.ev.property = property;
+
+	xcb_send_event(cb->conn, 0, req->requestor, XCB_EVENT_MASK_NO_EVENT, msg.bytes);
+}
+
+static void
+__clipboard_refuse(Clipboard *cb, const ClipboardRequest *req)
+{
+	cb->refused++;
+	__clipboard_notify(cb, req, XCB_NONE);
+}
+
+static void
+__clipboard_transfer_end(Clipboard *cb, int i)
+{
+	int j;
+	ClipboardTransfer *t;
+
+	t = &cb->transfers[i];
+	__clipboard_data_unref(t->data);
+
+	// the requestor window is not ours, its events are let go
+	// once no other transfer to it is left
+	for (j = 0; j < cb->ntransfers; ++j)
+		if (j != i && cb->transfers[j].requestor == t->requestor)
+			break;
+
+	if (j == cb->ntransfers)
+		xcb_change_window_attributes(cb->conn, t->requestor, XCB_CW_EVENT_MASK,
+				(const uint32_t []) { XCB_EVENT_MASK_NO_EVENT });
+
+	cb->transfers[i] = cb->transfers[--cb->ntransfers];
+}
+
+/* writes the image to the property the requestor asked for, whole, */
+/* or starts an INCR transfer of it */
+static void
+__clipboard_send(Clipboard *cb, const ClipboardRequest *req, ClipboardData *d)
+{
+	uint32_t size;
+	ClipboardTransfer *t;
+
+	if (d->size <= cb->piece) {
+		xcb_change_property(cb->conn, XCB_PROP_MODE_REPLACE, req->requestor,
+				req->property, req->target, 8, d->size, d->data);
+		__clipboard_notify(cb, req, req->property);
+		cb->bytes += d->size;
+		return;
+	}
+
+	// the oldest one was most likely left behind by its requestor
+	if (cb->ntransfers == CLIPBOARD_MAX_TRANSFERS)
+		__clipboard_transfer_end(cb, 0);
+
+	t = &cb->transfers[cb->ntransfers++];
+	t->requestor = req->requestor;
+	t->target = req->target;
+	t->property = req->property;
+	t->data = d;
+	t->sent = 0;
+	d->refs++;
+
+	// its deleting the property is what asks for the next piece,
+	// the size given is only a lower bound
+	size = MIN(d->size, UINT32_MAX);
+	xcb_change_window_attributes(cb->conn, req->requestor, XCB_CW_EVENT_MASK,
+			(const uint32_t []) { XCB_EVENT_MASK_PROPERTY_CHANGE });
+	xcb_change_property(cb->conn, XCB_PROP_MODE_REPLACE, req->requestor,
+			req->property, cb->INCR, 32, 1, &size);
+	__clipboard_notify(cb, req, req->property);
+	cb->incr++;
+}
+
+/* the next piece of the transfer, an empty one once all was sent */
+static void
+__clipboard_transfer_next(Clipboard *cb, int i)
+{
+	size_t n;
+	ClipboardTransfer *t;
+
+	t = &cb->transfers[i];
+	n = MIN(cb->piece, t->data->size - t->sent);
+
+	xcb_change_property(cb->conn, XCB_PROP_MODE_REPLACE, t->requestor,
+			t->property, t->target, 8, n, &t->data->data[t->sent]);
+
+	t->sent += n;
+	cb->bytes += n;
+
+	if (0 == n)
+		__clipboard_transfer_end(cb, i);
+}
+
+/* hands the pixels of the rectangle to the encoder, for the first */
+/* request waiting on a format not in the cache */
+static void
+__clipboard_start(Clipboard *cb)
+{
+	int i;
+	ClipboardFormat f;
+
+	if (cb->busy || 0 == cb->nwaiting)
+		return;
+
+	for (i = 0; i < cb->nwaiting && NULL != cb->cache[cb->waiting[i].format]; ++i)
+		;
+
+	if (i == cb->nwaiting)
+		return;
+
+	f = cb->waiting[i].format;
+
+	// read here, the canvas is not to be touched by the encoder
+	cb->job_px = xmalloc_tagged(ALLOC_CLIPBOARD, (size_t)(cb->w) * cb->h
+			* sizeof(uint32_t));
+	cb->reader(cb->x, cb->y, cb->w, cb->h, cb->job_px, cb->reader_data);
+
+	pthread_mutex_lock(&cb->lock);
+	cb->job_format = f;
+	cb->job_w = cb->w;
+	cb->job_h = cb->h;
+	cb->job_damage = cb->damage;
+	cb->busy = true;
+	pthread_cond_signal(&cb->cond);
+	pthread_mutex_unlock(&cb->lock);
+
+	cb->encodes++;
+}
+
+static void
+__clipboard_request(Clipboard *cb, const xcb_selection_request_event_t *ev)
+{
+	int f;
+	ClipboardRequest req;
+	xcb_atom_t targets[2 + CLIPBOARD_FORMATS];
+
+	req.requestor = ev->requestor;
+	req.target = ev->target;
+	// obsolete clients leave it to the target
+	req.property = XCB_NONE == ev->property ? ev->target : ev->property;
+	req.time = ev->time;
+	req.damage = cb->damage;
+
+	cb->requests++;
+
+	if (!cb->owned || ev->selection != cb->CLIPBOARD || (XCB_CURRENT_TIME != ev->time
+				&& ev->time < cb->time)) {
+		__clipboard_refuse(cb, &req);
+		return;
+	}
+
+	if (ev->target == cb->TARGETS) {
+		targets[0] = cb->TARGETS;
+		targets[1] = cb->TIMESTAMP;
+		for (f = 0; f < CLIPBOARD_FORMATS; ++f)
+			targets[2+f] = cb->formats[f];
+		xcb_change_property(cb->conn, XCB_PROP_MODE_REPLACE, req.requestor,
+				req.property, cb->ATOM, 32, 2 + CLIPBOARD_FORMATS, targets);
+		__clipboard_notify(cb, &req, req.property);
+		return;
+	}
+
+	// when the selection was taken, as ICCCM asks every owner to say
+	if (ev->target == cb->TIMESTAMP) {
+		xcb_change_property(cb->conn, XCB_PROP_MODE_REPLACE, req.requestor,
+				req.property, XCB_ATOM_INTEGER, 32, 1, &cb->time);
+		__clipboard_notify(cb, &req, req.property);
+		return;
+	}
+
+	for (f = 0; f < CLIPBOARD_FORMATS && cb->formats[f] != ev->target; ++f)
+		;
+
+	if (f == CLIPBOARD_FORMATS || cb->nwaiting == CLIPBOARD_MAX_WAITING) {
+		__clipboard_refuse(cb, &req);
+		return;
+	}
+
+	req.format = f;
+
+	if (NULL != cb->cache[f]) {
+		cb->hits++;
+		__clipboard_send(cb, &req, cb->cache[f]);
+		return;
+	}
+
+	cb->waiting[cb->nwaiting++] = req;
+	__clipboard_start(cb);
+}
+
+extern bool
+clipboard_set(Clipboard *cb, int x, int y, int w, int h, xcb_timestamp_t time)
+{
+	xcb_get_selection_owner_reply_t *reply;
+
+	if (w <= 0 || h <= 0 || (size_t)(w) * h > CLIPBOARD_MAX_PIXELS)
+		return false;
+
+	__clipboard_drop_cache(cb);
+	cb->x = x;
+	cb->y = y;
+	cb->w = w;
+	cb->h = h;
+	cb->time = time;
+
+	xcb_set_selection_owner(cb->conn, cb->win, cb->CLIPBOARD, time);
+	reply = xcb_get_selection_owner_reply(cb->conn,
+			xcb_get_selection_owner(cb->conn, cb->CLIPBOARD), NULL);
+	cb->owned = NULL != reply && reply->owner == cb->win;
+	free(reply);
+
+	return true;
+}
+
+extern void
+clipboard_damage(Clipboard *cb, int x0, int y0, int x1, int y1)
+{
+	if (!cb->owned || x0 >= cb->x + cb->w || x1 <= cb->x
+			|| y0 >= cb->y + cb->h || y1 <= cb->y)
+		return;
+
+	__clipboard_drop_cache(cb);
+}
+
+extern bool
+clipboard_try_process_event(Clipboard *cb, const xcb_generic_event_t *ev)
+{
+	int i;
+	const xcb_property_notify_event_t *pev;
+	const xcb_selection_clear_event_t *cev;
+
+	switch (ev->response_type & ~0x80) {
+	case XCB_SELECTION_REQUEST:
+		if (((const xcb_selection_request_event_t *)(ev))->owner != cb->win)
+			return false;
+		__clipboard_request(cb, (const xcb_selection_request_event_t *)(ev));
+		xcb_flush(cb->conn);
+		return true;
+	case XCB_SELECTION_CLEAR:
+		cev = (const xcb_selection_clear_event_t *)(ev);
+		if (cev->owner != cb->win || cev->selection != cb->CLIPBOARD)
+			return false;
+		// the transfers going on still have their data
+		cb->owned = false;
+		__clipboard_drop_cache(cb);
+		return true;
+	case XCB_PROPERTY_NOTIFY:
+		pev = (const xcb_property_notify_event_t *)(ev);
+		if (pev->state != XCB_PROPERTY_DELETE)
+			return false;
+		for (i = 0; i < cb->ntransfers; ++i) {
+			if (cb->transfers[i].requestor == pev->window
+					&& cb->transfers[i].property == pev->atom) {
+				__clipboard_transfer_next(cb, i);
+				xcb_flush(cb->conn);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	return false;
+}
+
+extern int
+clipboard_get_pollfd(const Clipboard *cb)
+{
+	return cb->pipe[0];
+}
+
+/* the encoding done goes to the requests waiting on its format */
+/* made before it was read, and into the cache unless the */
+/* rectangle changed meanwhile */
+extern void
+clipboard_process(Clipboard *cb)
+{
+	int i, n;
+	char byte;
+	ClipboardData *d;
+	ClipboardFormat f;
+
+	while (read(cb->pipe[0], &byte, 1) > 0)
+		;
+
+	pthread_mutex_lock(&cb->lock);
+
+	if (!cb->ready) {
+		pthread_mutex_unlock(&cb->lock);
+		return;
+	}
+
+	d = xmalloc_tagged(ALLOC_CLIPBOARD, sizeof(ClipboardData));
+	d->refs = 1;
+	d->data = cb->job_data;
+	d->size = cb->job_size;
+	f = cb->job_format;
+	cb->encode_total += cb->job_time;
+	cb->encode_max = MAX(cb->encode_max, cb->job_time);
+	cb->busy = cb->ready = false;
+
+	pthread_mutex_unlock(&cb->lock);
+
+	xfree(cb->job_px);
+	cb->job_px = NULL;
+
+	for (n = 0, i = 0; i < cb->nwaiting; ++i) {
+		if (cb->waiting[i].format == f && cb->waiting[i].damage <= cb->job_damage)
+			__clipboard_send(cb, &cb->waiting[i], d);
+		else
+			cb->waiting[n++] = cb->waiting[i];
+	}
+
+	cb->nwaiting = n;
+
+	if (cb->job_damage == cb->damage && cb->owned && NULL == cb->cache[f])
+		cb->cache[f] = d;
+	else
+		__clipboard_data_unref(d);
+
+	__clipboard_start(cb);
+	xcb_flush(cb->conn);
+}
+
+extern void
+clipboard_print_stats(const Clipboard *cb, FILE *fp)
+{
+	if (0 == cb->requests)
+		return;
+
+	fprintf(fp, "clipboard: %lu requests (%lu refused), %lu encodes, avg %.2f ms, "
+			"max %.2f ms, %lu from the cache, %lu INCR transfers, %llu KiB sent\n",
+			cb->requests, cb->refused, cb->encodes, cb->encodes > 0
+			? cb->encode_total / 1000.0 / cb->encodes : 0.0,
+			cb->encode_max / 1000.0, cb->hits, cb->incr, cb->bytes / 1024);
+}
+
+extern void
+clipboard_destroy(Clipboard *cb)
+{
+	pthread_mutex_lock(&cb->lock);
+	cb->quit = true;
+	pthread_cond_signal(&cb->cond);
+	pthread_mutex_unlock(&cb->lock);
+
+	pthread_join(cb->thread, NULL);
+	pthread_mutex_destroy(&cb->lock);
+	pthread_cond_destroy(&cb->cond);
+
+	if (cb->ready)
+		xfree(cb->job_data);
+
+	while (cb->ntransfers > 0)
+		__clipboard_transfer_end(cb, cb->ntransfers - 1);
+
+	__clipboard_drop_cache(cb);
+	xfree(cb->job_px);
+	close(cb->pipe[0]);
+	close(cb->pipe[1]);
+	xfree(cb);
+}
@@ -0,0 +1,336 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "utils.h"
+#include "control.h"
+
+/* bytes read from a client at a time, and reads per client before */
+/* the window gets its turn again */
+#define CONTROL_BUFFER_SIZE (64 * 1024)
+#define CONTROL_READS 16
+
+typedef struct {
+	int fd;
+	uint8_t *buf;
+	size_t len;
+
+	/* brush of the strokes to come */
+	uint32_t color;
+	int size;
+	BrushEngine engine;
+
+	/* stroke whose points are still arriving, left to go */
+	ControlPoint *points;
+	int npoints, cappoints;
+	int left;
+} ControlClient;
+
+struct ControlServer {
+	int fd;
+	char *path;
+	ControlClient clients[CONTROL_MAX_CLIENTS];
+	int nclients;
+
+	/* statistics */
+	unsigned long connections;
+	unsigned long commands;
+	unsigned long points;
+	unsigned long long bytes;
+};
+
+static void
+__control_set_nonblocking(int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+extern ControlServer *
+control_new(const char *path)
+{
+	int fd;
+	ControlServer *server;
+	struct sockaddr_un addr;
+	struct stat st;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		die("socket path too long: %s", path);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	// a socket left behind by a zinc that did not exit cleanly
+	// is taken over, one still answered is left to its zinc and
+	// anything else is not touched
+	if (0 == lstat(path, &st) && S_ISSOCK(st.st_mode)) {
+		if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+			die("can't create socket: %s", strerror(errno));
+		if (0 == connect(fd, (struct sockaddr *)(&addr), sizeof(addr)))
+			die("%s is in use by another zinc", path);
+		if (ECONNREFUSED == errno)
+			unlink(path);
+		close(fd);
+	}
+
+	server = xcalloc_tagged(ALLOC_CONTROL, 1, sizeof(ControlServer));
+	server->path = xmalloc_tagged(ALLOC_CONTROL, strlen(path) + 1);
+	strcpy(server->path, path);
+
+	if ((server->fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		die("can't create socket: %s", strerror(errno));
+
+	if (bind(server->fd, (struct sockaddr *)(&addr), sizeof(addr)) < 0)
+		die("can't bind to %s: %s", path, strerror(errno));
+
+	if (listen(server->fd, CONTROL_MAX_CLIENTS) < 0)
+		die("can't listen on %s: %s", path, strerror(errno));
+
+	__control_set_nonblocking(server->fd);
+
+	return server;
+}
+
+/* the descriptors to wait on for connections and commands */
+extern int
+control_get_pollfds(const ControlServer *server, struct pollfd *pfds, int max)
+{
+	int i, n;
+
+	for (n = 0, i = -1; i < server->nclients && n < max; ++i, ++n) {
+		pfds[n].fd = i < 0 ? server->fd : server->clients[i].fd;
+		pfds[n].events = POLLIN;
+		pfds[n].revents = 0;
+	}
+
+	return n;
+}
+
+static void
+__control_accept(ControlServer *server)
+{
+	int fd;
+	ControlClient *client;
+
+	while ((fd = accept(server->fd, NULL, NULL)) >= 0) {
+		if (server->nclients == CONTROL_MAX_CLIENTS) {
+			close(fd);
+			continue;
+		}
+
+		__control_set_nonblocking(fd);
+
+		client = &server->clients[server->nclients++];
+		memset(client, 0, sizeof(ControlClient));
+		client->fd = fd;
+		client->buf = xmalloc_tagged(ALLOC_CONTROL, CONTROL_BUFFER_SIZE);
+		client->color = 0xffffff;
+		client->size = 5;
+
+		server->connections++;
+	}
+}
+
+static void
+__control_drop(ControlServer *server, int i)
+{
+	ControlClient *client;
+
+	client = &server->clients[i];
+	close(client->fd);
+	xfree(client->buf);
+	xfree(client->points);
+
+	server->clients[i] = server->clients[--server->nclients];
+}
+
+/* hands over the commands that arrived whole and keeps the rest, */
+/* false if the client sent something that is not a command */
+static bool
+__control_parse(ControlServer *server, ControlClient *client,
+		ControlCommandHandler handler, void *data)
+{
+	int i, n;
+	size_t off;
+	ControlHeader hdr;
+	ControlCommand cmd;
+
+	off = 0;
+
+	while (true) {
+		if (client->left > 0) {
+			n = MIN((client->len - off) / sizeof(ControlPoint), (size_t)(client->left));
+
+			if (0 == n)
+				break;
+
+			memcpy(&client->points[client->npoints], &client->buf[off],
+					n * sizeof(ControlPoint));
+
+			for (i = client->npoints; i < client->npoints + n; ++i)
+				if (client->points[i].x < -CONTROL_MAX_COORD
+						|| client->points[i].x > CONTROL_MAX_COORD
+						|| client->points[i].y < -CONTROL_MAX_COORD
+						|| client->points[i].y > CONTROL_MAX_COORD)
+					return false;
+
+			client->npoints += n;
+			client->left -= n;
+			off += n * sizeof(ControlPoint);
+
+			if (client->left > 0)
+				continue;
+
+			cmd = (ControlCommand) { .op = CONTROL_STROKE, .color = client->color,
+				.size = client->size, .engine = client->engine,
+				.points = client->points, .npoints = client->npoints };
+			handler(&cmd, data);
+
+			server->points += client->npoints;
+			continue;
+		}
+
+		if (client->len - off < sizeof(ControlHeader))
+			break;
+
+		memcpy(&hdr, &client->buf[off], sizeof(ControlHeader));
+		off += sizeof(ControlHeader);
+		server->commands++;
+
+		switch (hdr.op) {
+		case CONTROL_COLOR:
+			client->color = hdr.a & 0xffffff;
+			break;
+		case CONTROL_SIZE:
+			if (hdr.a < 1 || hdr.a > BRUSH_MAX_SIZE)
+				return false;
+			client->size = hdr.a;
+			break;
+		case CONTROL_BRUSH:
+			if (hdr.a < 0 || hdr.a >= BRUSH_ENGINES)
+				return false;
+			client->engine = hdr.a;
+			break;
+		case CONTROL_STROKE:
+			if (hdr.a < 1 || hdr.a > CONTROL_MAX_POINTS)
+				return false;
+			if (hdr.a > client->cappoints) {
+				client->cappoints = hdr.a;
+				client->points = xrealloc_tagged(ALLOC_CONTROL, client->points,
+						hdr.a * sizeof(ControlPoint));
+			}
+			client->npoints = 0;
+			client->left = hdr.a;
+			break;
+		case CONTROL_CAMERA:
+			if (hdr.a < -CONTROL_MAX_COORD || hdr.a > CONTROL_MAX_COORD
+					|| hdr.b < -CONTROL_MAX_COORD || hdr.b > CONTROL_MAX_COORD)
+				return false;
+			cmd = (ControlCommand) { .op = hdr.op, .a = hdr.a, .b = hdr.b };
+			handler(&cmd, data);
+			break;
+		case CONTROL_UNDO:
+		case CONTROL_REDO:
+			cmd = (ControlCommand) { .op = hdr.op, .a = hdr.a, .b = hdr.b };
+			handler(&cmd, data);
+			break;
+		default:
+			return false;
+		}
+	}
+
+	memmove(client->buf, &client->buf[off], client->len - off);
+	client->len -= off;
+
+	return true;
+}
+
+/* takes in the connections and commands waiting, without blocking, */
+/* and returns how many commands were handed over */
+extern int
+control_process(ControlServer *server, ControlCommandHandler handler, void *data)
+{
+	int i, reads;
+	ssize_t n;
+	unsigned long commands;
+	ControlClient *client;
+
+	commands = server->commands;
+
+	__control_accept(server);
+
+	for (i = server->nclients - 1; i >= 0; --i) {
+		client = &server->clients[i];
+
+		// many commands a read, a few reads a client, so a
+		// busy one can't keep the window from being drawn
+		for (reads = 0; reads < CONTROL_READS; ++reads) {
+			n = read(client->fd, &client->buf[client->len],
+					CONTROL_BUFFER_SIZE - client->len);
+
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				break;
+
+			if (n > 0) {
+				client->len += n;
+				server->bytes += n;
+			}
+
+			// gone, or sent something that is not a command
+			if (n <= 0 || !__control_parse(server, client, handler, data)) {
+				__control_drop(server, i);
+				break;
+			}
+		}
+	}
+
+	return server->commands - commands;
+}
+
+extern void
+control_print_stats(const ControlServer *server, FILE *fp)
+{
+	fprintf(fp, "control: %lu connections, %lu commands, %lu stroke points, %llu KiB\n",
+			server->connections, server->commands, server->points,
+			server->bytes / 1024);
+}
+
+extern void
+control_destroy(ControlServer *server)
+{
+	while (server->nclients > 0)
+		__control_drop(server, server->nclients - 1);
+
+	close(server->fd);
+	unlink(server->path);
+	xfree(server->path);
+	xfree(server);
+}
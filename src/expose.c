@@ -0,0 +1,50 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+#include <stdbool.h>
+#include <xcb/xcb.h>
+
+#include "utils.h"
+#include "expose.h"
+
+extern bool
+expose_add(Expose *ex, const xcb_expose_event_t *ev)
+{
+	xcb_rectangle_t *r;
+
+	if (ex->done) {
+		ex->nrects = 0;
+		ex->done = false;
+	}
+
+	if (ex->nrects < EXPOSE_MAX_RECTS) {
+		r = &ex->rects[ex->nrects++];
+		r->x = ev->x;
+		r->y = ev->y;
+		r->width = ev->width;
+		r->height = ev->height;
+	} else {
+		r = &ex->rects[ex->nrects - 1];
+		r->width = MAX(r->x + r->width, ev->x + ev->width) - MIN(r->x, ev->x);
+		r->height = MAX(r->y + r->height, ev->y + ev->height) - MIN(r->y, ev->y);
+		r->x = MIN(r->x, ev->x);
+		r->y = MIN(r->y, ev->y);
+	}
+
+	return (ex->done = 0 == ev->count);
+}
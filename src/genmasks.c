@@ -0,0 +1,94 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+/* writes brushmasks.h to standard output: for every brush engine, */
+/* a kernel for each of the small sizes with its mask spelled out, */
+/* one store a pixel, no loop left to run */
+
+#include <math.h>
+#include <stdio.h>
+
+#define SMALL 8
+
+static const char *engines[] = { "soft", "hard" };
+
+/* half width of row dy of a dab, as brush_spans has it */
+static int
+span(int size, int dy)
+{
+	int w;
+
+	for (w = -1; w + 1 < size && (w + 1) * (w + 1) + dy * dy < size * size; ++w)
+		;
+
+	return w;
+}
+
+static void
+kernel(int engine, int size)
+{
+	int dx, dy, w;
+
+	printf("static void\n__brush_%s_%d(uint32_t *dst, int size, int dy, uint32_t color)\n{\n",
+			engines[engine], size);
+	printf("\tuint32_t c;\n\n\t(void) size;\n\tc = (color & 0xffffff) | 0xff000000;\n\n\tswitch (dy) {\n");
+
+	for (dy = -size; dy < size; ++dy) {
+		if ((w = span(size, dy)) < 0)
+			continue;
+		printf("\tcase %d:\n", dy);
+		for (dx = -w; dx <= w; ++dx) {
+			if (0 == engine)
+				// as brush_stamp fades it out towards the edge
+				printf("\t\tdst[%d] = __brush_scale(c, %ld);\n", dx + w,
+						lround(255 * (1 - sqrt(dy * dy + dx * dx) / size)));
+			else
+				printf("\t\tdst[%d] = c;\n", dx + w);
+		}
+		printf("\t\tbreak;\n");
+	}
+
+	printf("\t}\n}\n\n");
+}
+
+int
+main(void)
+{
+	int engine, size;
+
+	printf("/* made by genmasks, not to be edited */\n\n");
+	printf("#define BRUSH_SMALL %d\n\n", SMALL);
+
+	for (engine = 0; engine < 2; ++engine)
+		for (size = 1; size <= SMALL; ++size)
+			kernel(engine, size);
+
+	printf("static const BrushKernel __brush_small[][BRUSH_SMALL+1] = {\n");
+
+	for (engine = 0; engine < 2; ++engine) {
+		printf("\t{ NULL");
+		for (size = 1; size <= SMALL; ++size)
+			printf(", __brush_%s_%d", engines[engine], size);
+		printf(" },\n");
+	}
+
+	printf("};\n");
+
+	return 0;
+}
@@ -17,6 +17,7 @@
 */
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "utils.h"
@@ -25,7 +26,7 @@
 static void
 __history_atomic_action_destroy(HistoryAtomicAction *haa)
 {
-	free(haa);
+	xfree(haa);
 }
 
 static void
@@ -44,7 +45,12 @@ static void
 __history_user_action_destroy(HistoryUserAction *hua)
 {
 	__history_atomic_action_list_destroy(hua->aa);
-	free(hua);
+	xfree(hua->fill.spans);
+	if (NULL != hua->image.image)
+		image_destroy(hua->image.image);
+	if (NULL != hua->selection.image)
+		image_destroy(hua->selection.image);
+	xfree(hua);
 }
 
 static void
@@ -63,9 +69,10 @@ extern History *
 history_new(void)
 {
 	History *hist;
-	hist = xmalloc(sizeof(History));
+	hist = xmalloc_tagged(ALLOC_HISTORY, sizeof(History));
 	hist->root = history_user_action_new();
 	hist->current = hist->root;
+	hist->last_id = 0;
 	return hist;
 }
 
@@ -73,18 +80,110 @@ extern HistoryUserAction *
 history_user_action_new(void)
 {
 	HistoryUserAction *hua;
-	hua = xmalloc(sizeof(HistoryUserAction));
-	hua->next = NULL;
-	hua->prev = NULL;
-	hua->aa = NULL;
+	hua = xcalloc_tagged(ALLOC_HISTORY, 1, sizeof(HistoryUserAction));
+	hua->type = HISTORY_ACTION_STROKE;
 	return hua;
 }
 
+extern HistoryUserAction *
+history_user_action_fill_new(uint32_t color, int nspans)
+{
+	HistoryUserAction *hua;
+	hua = history_user_action_new();
+	hua->type = HISTORY_ACTION_FILL;
+	hua->fill.color = color;
+	hua->fill.nspans = nspans;
+	hua->fill.spans = xmalloc_tagged(ALLOC_HISTORY, nspans * sizeof(HistorySpan));
+	return hua;
+}
+
+/* the action takes the image over */
+extern HistoryUserAction *
+history_user_action_image_new(int x, int y, Image *image)
+{
+	HistoryUserAction *hua;
+	hua = history_user_action_new();
+	hua->type = HISTORY_ACTION_IMAGE;
+	hua->image.x = x;
+	hua->image.y = y;
+	hua->image.image = image;
+	return hua;
+}
+
+extern HistoryUserAction *
+history_user_action_selection_new(HistorySelectionMode mode, int x, int y,
+		int w, int h, int dx, int dy)
+{
+	HistoryUserAction *hua;
+	hua = history_user_action_new();
+	hua->type = HISTORY_ACTION_SELECTION;
+	hua->selection.mode = mode;
+	hua->selection.x = x;
+	hua->selection.y = y;
+	hua->selection.w = w;
+	hua->selection.h = h;
+	hua->selection.dx = dx;
+	hua->selection.dy = dy;
+	return hua;
+}
+
+/* for actions never handed to history_do */
+extern void
+history_user_action_destroy(HistoryUserAction *hua)
+{
+	__history_user_action_destroy(hua);
+}
+
+/* canvas area the action reaches into, [x0, x1) by [y0, y1), */
+/* empty for an empty stroke */
+extern void
+history_user_action_get_bounds(const HistoryUserAction *hua, int *x0, int *y0,
+		int *x1, int *y1)
+{
+	int i;
+	const HistoryAtomicAction *haa;
+
+	*x0 = *y0 = INT32_MAX;
+	*x1 = *y1 = INT32_MIN;
+
+	switch (hua->type) {
+	case HISTORY_ACTION_STROKE:
+		for (haa = hua->aa; haa; haa = haa->next) {
+			*x0 = MIN(*x0, haa->x - haa->size);
+			*y0 = MIN(*y0, haa->y - haa->size);
+			*x1 = MAX(*x1, haa->x + haa->size);
+			*y1 = MAX(*y1, haa->y + haa->size);
+		}
+		break;
+	case HISTORY_ACTION_FILL:
+		for (i = 0; i < hua->fill.nspans; ++i) {
+			*x0 = MIN(*x0, hua->fill.spans[i].x0);
+			*y0 = MIN(*y0, hua->fill.spans[i].y);
+			*x1 = MAX(*x1, hua->fill.spans[i].x1);
+			*y1 = MAX(*y1, hua->fill.spans[i].y + 1);
+		}
+		break;
+	case HISTORY_ACTION_IMAGE:
+		*x0 = hua->image.x;
+		*y0 = hua->image.y;
+		*x1 = hua->image.x + hua->image.image->width;
+		*y1 = hua->image.y + hua->image.image->height;
+		break;
+	case HISTORY_ACTION_SELECTION:
+		// where it was and where it went, with what is between
+		*x0 = hua->selection.x + MIN(0, hua->selection.dx);
+		*y0 = hua->selection.y + MIN(0, hua->selection.dy);
+		*x1 = hua->selection.x + hua->selection.w + MAX(0, hua->selection.dx);
+		*y1 = hua->selection.y + hua->selection.h + MAX(0, hua->selection.dy);
+		break;
+	}
+}
+
 extern HistoryAtomicAction *
 history_atomic_action_new(int x, int y, uint32_t color, int size)
 {
 	HistoryAtomicAction *haa;
-	haa = xmalloc(sizeof(HistoryAtomicAction));
+	haa = xmalloc_tagged(ALLOC_HISTORY, sizeof(HistoryAtomicAction));
 	haa->x = x;
 	haa->y = y;
 	haa->color = color;
@@ -97,20 +196,14 @@ extern void
 history_user_action_push_atomic(HistoryUserAction *hua,
 		HistoryAtomicAction *haa)
 {
-	HistoryAtomicAction *last;
-
 	// check if there is no atomic actions
 	// created yet
-	if (NULL == hua->aa) {
+	if (NULL == hua->aa)
 		hua->aa = haa;
-		return;
-	}
-
-	// get last node
-	for (last = hua->aa; last->next; last = last->next)
-		;
+	else
+		hua->aa_last->next = haa;
 
-	last->next = haa;
+	hua->aa_last = haa;
 }
 
 extern void
@@ -122,6 +215,7 @@ history_do(History *hist, HistoryUserAction *hua)
 	// link
 	hist->current->next = hua;
 	hua->prev = hist->current;
+	hua->id = ++hist->last_id;
 
 	// update position in history
 	hist->current = hua;
@@ -149,5 +243,5 @@ extern void
 history_destroy(History *hist)
 {
 	__history_user_action_list_destroy(hist->root);
-	free(hist);
+	xfree(hist);
 }
@@ -0,0 +1,879 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef ZINC_USE_PNG
+#include <zlib.h>
+#endif
+
+#include "utils.h"
+#include "pixel.h"
+#include "image.h"
+
+/* largest side of an image that is accepted */
+#define IMAGE_MAX_SIDE (1 << 16)
+
+typedef enum {
+	IMAGE_FORMAT_PNM,
+	IMAGE_FORMAT_PNG
+} ImageFormat;
+
+typedef enum {
+	IMAGE_GRAY,
+	IMAGE_GRAY_ALPHA,
+	IMAGE_RGB,
+	IMAGE_RGB_ALPHA,
+	IMAGE_PALETTE
+} ImageLayout;
+
+struct ImageReader {
+	FILE *fp;
+	ImageFormat format;
+	ImageLayout layout;
+
+	int width, height;
+	int row;
+
+	/* samples per pixel, bits per sample and largest sample */
+	int channels;
+	int depth;
+	int maxval;
+
+	/* the raw bytes of the row being read, and of the one */
+	/* before it, which PNG filters refer to */
+	size_t stride;
+	uint8_t *line;
+	uint8_t *prev;
+
+	/* PNG palette (ARGB) and transparent colour */
+	uint32_t palette[256];
+	bool has_key;
+	uint16_t key[3];
+
+#ifdef ZINC_USE_PNG
+	z_stream zs;
+	uint8_t in[8192];
+	uint32_t idat_left;
+#endif
+};
+
+static int
+__pnm_getc(FILE *fp)
+{
+	int c;
+
+	// comments run up to the end of the line
+	if ((c = fgetc(fp)) == '#')
+		while ((c = fgetc(fp)) != EOF && c != '\n')
+			;
+
+	return c;
+}
+
+static bool
+__pnm_read_int(FILE *fp, int *value)
+{
+	int c;
+
+	while ((c = __pnm_getc(fp)) == ' ' || c == '\t' || c == '\n' || c == '\r')
+		;
+
+	if (c < '0' || c > '9')
+		return false;
+
+	for (*value = 0; c >= '0' && c <= '9'; c = fgetc(fp))
+		if ((*value = *value * 10 + (c - '0')) > IMAGE_MAX_SIDE)
+			return false;
+
+	return true;
+}
+
+static const char *
+__pam_read_header(ImageReader *ir)
+{
+	char line[128], tupltype[64];
+	int depth;
+
+	depth = 0;
+	tupltype[0] = '\0';
+
+	while (NULL != fgets(line, sizeof(line), ir->fp)) {
+		if (0 == strncmp(line, "ENDHDR", 6)) {
+			if (0 == strcmp(tupltype, "GRAYSCALE") || (depth == 1 && !tupltype[0]))
+				ir->layout = IMAGE_GRAY;
+			else if (0 == strcmp(tupltype, "GRAYSCALE_ALPHA") || (depth == 2 && !tupltype[0]))
+				ir->layout = IMAGE_GRAY_ALPHA;
+			else if (0 == strcmp(tupltype, "RGB") || (depth == 3 && !tupltype[0]))
+				ir->layout = IMAGE_RGB;
+			else if (0 == strcmp(tupltype, "RGB_ALPHA") || (depth == 4 && !tupltype[0]))
+				ir->layout = IMAGE_RGB_ALPHA;
+			else
+				return "unsupported PAM tuple type";
+			// as many samples a pixel as the tuple type has
+			ir->channels = ir->layout == IMAGE_GRAY ? 1 : ir->layout
+				== IMAGE_GRAY_ALPHA ? 2 : ir->layout == IMAGE_RGB ? 3 : 4;
+			if (depth != ir->channels)
+				return "PAM depth does not match its tuple type";
+			return NULL;
+		}
+
+		if (sscanf(line, "WIDTH %d", &ir->width) == 1
+				|| sscanf(line, "HEIGHT %d", &ir->height) == 1
+				|| sscanf(line, "DEPTH %d", &depth) == 1
+				|| sscanf(line, "MAXVAL %d", &ir->maxval) == 1
+				|| sscanf(line, "TUPLTYPE %63s", tupltype) == 1
+				|| line[0] == '#')
+			continue;
+	}
+
+	return "truncated PAM header";
+}
+
+static const char *
+__pnm_open(ImageReader *ir, int type)
+{
+	const char *error;
+
+	ir->format = IMAGE_FORMAT_PNM;
+
+	switch (type) {
+	case '5':
+	case '6':
+		ir->layout = type == '5' ? IMAGE_GRAY : IMAGE_RGB;
+		ir->channels = type == '5' ? 1 : 3;
+		if (!__pnm_read_int(ir->fp, &ir->width)
+				|| !__pnm_read_int(ir->fp, &ir->height)
+				|| !__pnm_read_int(ir->fp, &ir->maxval))
+			return "bad PNM header";
+		// a single whitespace character goes before the pixels,
+		// which was eaten along with the maxval
+		break;
+	case '7':
+		fgetc(ir->fp);
+		if (NULL != (error = __pam_read_header(ir)))
+			return error;
+		break;
+	default:
+		return "only binary PNM files (P5, P6 and P7) are supported";
+	}
+
+	if (ir->maxval < 1 || ir->maxval > 65535)
+		return "bad PNM maxval";
+
+	ir->depth = ir->maxval > 255 ? 16 : 8;
+
+	return NULL;
+}
+
+#ifdef ZINC_USE_PNG
+static uint32_t
+__png_u32(const uint8_t *p)
+{
+	return (uint32_t)(p[0]) << 24 | (uint32_t)(p[1]) << 16
+		| (uint32_t)(p[2]) << 8 | p[3];
+}
+
+static const char *
+__png_open(ImageReader *ir)
+{
+	int i;
+	uint8_t header[8], ihdr[13], entry[3];
+	uint32_t length;
+
+	if (fread(header, 1, 8, ir->fp) != 8 || fread(ihdr, 1, 13, ir->fp) != 13
+			|| __png_u32(header) != 13 || memcmp(&header[4], "IHDR", 4) != 0)
+		return "bad PNG header";
+
+	ir->format = IMAGE_FORMAT_PNG;
+	ir->width = __png_u32(&ihdr[0]);
+	ir->height = __png_u32(&ihdr[4]);
+	ir->depth = ihdr[8];
+
+	switch (ihdr[9]) {
+	case 0: ir->layout = IMAGE_GRAY; ir->channels = 1; break;
+	case 2: ir->layout = IMAGE_RGB; ir->channels = 3; break;
+	case 3: ir->layout = IMAGE_PALETTE; ir->channels = 1; break;
+	case 4: ir->layout = IMAGE_GRAY_ALPHA; ir->channels = 2; break;
+	case 6: ir->layout = IMAGE_RGB_ALPHA; ir->channels = 4; break;
+	default: return "bad PNG colour type";
+	}
+
+	if (ihdr[12] != 0)
+		return "interlaced PNG files are not supported";
+
+	// the bit depths every colour type allows
+	switch (ihdr[9]) {
+	case 0:
+		if (ir->depth != 1 && ir->depth != 2 && ir->depth != 4
+				&& ir->depth != 8 && ir->depth != 16)
+			return "bad PNG bit depth";
+		break;
+	case 3:
+		if (ir->depth != 1 && ir->depth != 2 && ir->depth != 4 && ir->depth != 8)
+			return "bad PNG bit depth";
+		break;
+	default:
+		if (ir->depth != 8 && ir->depth != 16)
+			return "bad PNG bit depth";
+		break;
+	}
+
+	ir->maxval = ir->layout == IMAGE_PALETTE ? 255 : (1 << ir->depth) - 1;
+
+	for (i = 0; i < 256; ++i)
+		ir->palette[i] = 0xff000000;
+
+	// everything up to the first IDAT, which is where the pixels
+	// start, only the palette and transparency matter
+	fseek(ir->fp, 4, SEEK_CUR);
+
+	for (;;) {
+		if (fread(header, 1, 8, ir->fp) != 8)
+			return "truncated PNG file";
+
+		length = __png_u32(header);
+
+		if (0 == memcmp(&header[4], "IDAT", 4)) {
+			ir->idat_left = length;
+			break;
+		} else if (0 == memcmp(&header[4], "PLTE", 4) && length <= 768) {
+			for (i = 0; i < (int)(length / 3); ++i) {
+				if (fread(entry, 1, 3, ir->fp) != 3)
+					return "truncated PNG palette";
+				ir->palette[i] = 0xff000000 | entry[0] << 16 | entry[1] << 8 | entry[2];
+			}
+			length -= i * 3;
+		} else if (0 == memcmp(&header[4], "tRNS", 4) && ir->layout == IMAGE_PALETTE
+				&& length <= 256) {
+			for (i = 0; i < (int)(length); ++i)
+				ir->palette[i] = (ir->palette[i] & 0xffffff) | (uint32_t)(fgetc(ir->fp)) << 24;
+			length = 0;
+		} else if (0 == memcmp(&header[4], "tRNS", 4) && (ir->layout == IMAGE_GRAY
+					|| ir->layout == IMAGE_RGB) && length == 2 * (uint32_t)(ir->channels)) {
+			for (i = 0; i < ir->channels; ++i) {
+				if (fread(entry, 1, 2, ir->fp) != 2)
+					return "truncated PNG transparency";
+				ir->key[i] = entry[0] << 8 | entry[1];
+			}
+			ir->has_key = true;
+			length = 0;
+		} else if (0 == memcmp(&header[4], "IEND", 4)) {
+			return "PNG file without pixels";
+		}
+
+		fseek(ir->fp, length + 4, SEEK_CUR);
+	}
+
+	if (inflateInit(&ir->zs) != Z_OK)
+		return "can't initialize zlib";
+
+	return NULL;
+}
+
+/* inflates exactly n bytes into dst, going through as many IDAT */
+/* chunks as it takes */
+static bool
+__png_inflate(ImageReader *ir, uint8_t *dst, size_t n)
+{
+	int ret;
+	size_t len;
+	uint8_t header[8];
+
+	ir->zs.next_out = dst;
+	ir->zs.avail_out = n;
+
+	while (ir->zs.avail_out > 0) {
+		if (0 == ir->zs.avail_in) {
+			while (0 == ir->idat_left) {
+				// skip the CRC of the last one
+				if (fseek(ir->fp, 4, SEEK_CUR) != 0 || fread(header, 1, 8, ir->fp) != 8
+						|| memcmp(&header[4], "IDAT", 4) != 0)
+					return false;
+				ir->idat_left = __png_u32(header);
+			}
+
+			len = fread(ir->in, 1, MIN(sizeof(ir->in), ir->idat_left), ir->fp);
+			if (0 == len)
+				return false;
+
+			ir->idat_left -= len;
+			ir->zs.next_in = ir->in;
+			ir->zs.avail_in = len;
+		}
+
+		ret = inflate(&ir->zs, Z_NO_FLUSH);
+
+		if (ret == Z_STREAM_END)
+			return 0 == ir->zs.avail_out;
+
+		if (ret != Z_OK && ret != Z_BUF_ERROR)
+			return false;
+	}
+
+	return true;
+}
+
+static inline int
+__png_paeth(int a, int b, int c)
+{
+	int p, pa, pb, pc;
+
+	p = a + b - c;
+	pa = abs(p - a);
+	pb = abs(p - b);
+	pc = abs(p - c);
+
+	return (pa <= pb && pa <= pc) ? a : pb <= pc ? b : c;
+}
+
+static bool
+__png_read_line(ImageReader *ir)
+{
+	size_t i, bpp;
+	uint8_t filter, *line, *prev, *tmp;
+
+	if (!__png_inflate(ir, &filter, 1) || !__png_inflate(ir, ir->line, ir->stride))
+		return false;
+
+	// the filters work on whole bytes, of pixels at least one
+	bpp = (ir->channels * ir->depth + 7) / 8;
+	line = ir->line;
+	prev = ir->prev;
+
+	switch (filter) {
+	case 0:
+		break;
+	case 1:
+		for (i = bpp; i < ir->stride; ++i)
+			line[i] += line[i-bpp];
+		break;
+	case 2:
+		for (i = 0; i < ir->stride; ++i)
+			line[i] += prev[i];
+		break;
+	case 3:
+		for (i = 0; i < ir->stride; ++i)
+			line[i] += ((i >= bpp ? line[i-bpp] : 0) + prev[i]) / 2;
+		break;
+	case 4:
+		for (i = 0; i < ir->stride; ++i)
+			line[i] += __png_paeth(i >= bpp ? line[i-bpp] : 0, prev[i],
+					i >= bpp ? prev[i-bpp] : 0);
+		break;
+	default:
+		return false;
+	}
+
+	// the row just read is the previous one of the next
+	tmp = ir->prev;
+	ir->prev = ir->line;
+	ir->line = tmp;
+
+	return true;
+}
+#endif
+
+extern ImageReader *
+image_reader_open(const char *path, const char **error)
+{
+	uint8_t magic[8];
+	ImageReader *ir;
+
+	ir = xcalloc(1, sizeof(ImageReader));
+
+	if (NULL == (ir->fp = fopen(path, "rb"))) {
+		*error = "can't open file";
+		free(ir);
+		return NULL;
+	}
+
+	*error = NULL;
+
+	if (fread(magic, 1, 2, ir->fp) != 2) {
+		*error = "empty file";
+	} else if (magic[0] == 'P') {
+		*error = __pnm_open(ir, magic[1]);
+	} else if (magic[0] == 0x89 && magic[1] == 'P') {
+#ifdef ZINC_USE_PNG
+		if (fread(&magic[2], 1, 6, ir->fp) != 6 || memcmp(magic, "\x89PNG\r\n\x1a\n", 8) != 0)
+			*error = "bad PNG signature";
+		else
+			*error = __png_open(ir);
+#else
+		*error = "compiled without PNG support";
+#endif
+	} else {
+		*error = "unknown image format";
+	}
+
+	if (NULL == *error && (ir->width <= 0 || ir->height <= 0
+				|| ir->width > IMAGE_MAX_SIDE || ir->height > IMAGE_MAX_SIDE))
+		*error = "bad image size";
+
+	if (NULL != *error) {
+		fclose(ir->fp);
+		free(ir);
+		return NULL;
+	}
+
+	ir->stride = ((size_t)(ir->width) * ir->channels * ir->depth + 7) / 8;
+	ir->line = xcalloc(ir->stride, 1);
+	ir->prev = xcalloc(ir->stride, 1);
+
+	return ir;
+}
+
+extern int
+image_reader_width(const ImageReader *ir)
+{
+	return ir->width;
+}
+
+extern int
+image_reader_height(const ImageReader *ir)
+{
+	return ir->height;
+}
+
+/* sample i of the row as stored, of depth bits */
+static inline int
+__image_sample(const ImageReader *ir, const uint8_t *line, int i)
+{
+	int bit;
+
+	switch (ir->depth) {
+	case 16:
+		return line[2*i] << 8 | line[2*i+1];
+	case 8:
+		return line[i];
+	default:
+		bit = i * ir->depth;
+		return (line[bit/8] >> (8 - ir->depth - bit % 8)) & ((1 << ir->depth) - 1);
+	}
+}
+
+extern bool
+image_reader_read_row(ImageReader *ir, uint32_t *row)
+{
+	int x, c, s[4];
+	bool keyed;
+	const uint8_t *line;
+
+	if (ir->row >= ir->height)
+		return false;
+
+#ifdef ZINC_USE_PNG
+	if (ir->format == IMAGE_FORMAT_PNG) {
+		if (!__png_read_line(ir))
+			return false;
+		line = ir->prev;
+	} else
+#endif
+	{
+		if (fread(ir->line, 1, ir->stride, ir->fp) != ir->stride)
+			return false;
+		line = ir->line;
+	}
+
+	for (x = 0; x < ir->width; ++x) {
+		keyed = ir->has_key;
+
+		for (c = 0; c < ir->channels; ++c) {
+			s[c] = __image_sample(ir, line, x * ir->channels + c);
+			keyed = keyed && (c >= 3 || s[c] == ir->key[c]);
+			if (ir->layout != IMAGE_PALETTE)
+				s[c] = (s[c] * 255 + ir->maxval / 2) / ir->maxval;
+		}
+
+		switch (ir->layout) {
+		case IMAGE_GRAY:
+			row[x] = pixel_premultiply(s[0] * 0x010101, keyed ? 0 : 0xff);
+			break;
+		case IMAGE_GRAY_ALPHA:
+			row[x] = pixel_premultiply(s[0] * 0x010101, s[1]);
+			break;
+		case IMAGE_RGB:
+			row[x] = pixel_premultiply(s[0] << 16 | s[1] << 8 | s[2], keyed ? 0 : 0xff);
+			break;
+		case IMAGE_RGB_ALPHA:
+			row[x] = pixel_premultiply(s[0] << 16 | s[1] << 8 | s[2], s[3]);
+			break;
+		case IMAGE_PALETTE:
+			row[x] = pixel_premultiply(ir->palette[s[0]], ir->palette[s[0]] >> 24);
+			break;
+		}
+	}
+
+	ir->row++;
+
+	return true;
+}
+
+extern void
+image_reader_close(ImageReader *ir)
+{
+#ifdef ZINC_USE_PNG
+	if (ir->format == IMAGE_FORMAT_PNG)
+		inflateEnd(&ir->zs);
+#endif
+	fclose(ir->fp);
+	free(ir->line);
+	free(ir->prev);
+	free(ir);
+}
+
+extern Image *
+image_new(int width, int height)
+{
+	Image *img;
+
+	img = xcalloc_tagged(ALLOC_IMAGE, 1, sizeof(Image));
+	img->width = width;
+	img->height = height;
+	img->tiles_x = (width + IMAGE_TILE - 1) / IMAGE_TILE;
+	img->tiles_y = (height + IMAGE_TILE - 1) / IMAGE_TILE;
+	img->tiles = xcalloc_tagged(ALLOC_IMAGE, img->tiles_x * img->tiles_y, sizeof(uint32_t *));
+
+	return img;
+}
+
+extern void
+image_set_row(Image *img, int y, const uint32_t *row)
+{
+	int i, tx, n;
+	uint32_t **tile;
+
+	for (tx = 0; tx < img->tiles_x; ++tx) {
+		n = MIN(IMAGE_TILE, img->width - tx * IMAGE_TILE);
+		tile = &img->tiles[(y / IMAGE_TILE) * img->tiles_x + tx];
+
+		// fully transparent tiles are never allocated
+		if (NULL == *tile) {
+			for (i = 0; i < n && 0 == row[tx*IMAGE_TILE+i]; ++i)
+				;
+			if (i == n)
+				continue;
+			*tile = xcalloc_tagged(ALLOC_IMAGE, IMAGE_TILE * IMAGE_TILE, sizeof(uint32_t));
+		}
+
+		memcpy(&(*tile)[(y % IMAGE_TILE) * IMAGE_TILE], &row[tx*IMAGE_TILE],
+				n * sizeof(uint32_t));
+	}
+}
+
+extern size_t
+image_size(const Image *img)
+{
+	int t;
+	size_t size;
+
+	size = 0;
+
+	for (t = 0; t < img->tiles_x * img->tiles_y; ++t)
+		if (NULL != img->tiles[t])
+			size += IMAGE_TILE * IMAGE_TILE * sizeof(uint32_t);
+
+	return size;
+}
+
+extern void
+image_destroy(Image *img)
+{
+	int t;
+
+	for (t = 0; t < img->tiles_x * img->tiles_y; ++t)
+		xfree(img->tiles[t]);
+
+	xfree(img->tiles);
+	xfree(img);
+}
+
+/* a growing buffer the encoders write to */
+typedef struct {
+	uint8_t *data;
+	size_t size, capacity;
+} ImageBuffer;
+
+static uint8_t *
+__image_buffer_reserve(ImageBuffer *b, size_t n)
+{
+	if (b->size + n > b->capacity) {
+		b->capacity = MAX(b->capacity * 2, b->size + n);
+		b->data = xrealloc_tagged(ALLOC_IMAGE, b->data, b->capacity);
+	}
+
+	return &b->data[b->size];
+}
+
+static void
+__image_buffer_put(ImageBuffer *b, const void *src, size_t n)
+{
+	memcpy(__image_buffer_reserve(b, n), src, n);
+	b->size += n;
+}
+
+static void
+__image_buffer_put_u32(ImageBuffer *b, uint32_t v)
+{
+	uint8_t *p;
+
+	p = __image_buffer_reserve(b, 4);
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+	b->size += 4;
+}
+
+static uint8_t *
+__image_buffer_finish(ImageBuffer *b, size_t *size)
+{
+	*size = b->size;
+	return xrealloc_tagged(ALLOC_IMAGE, b->data, MAX(b->size, 1));
+}
+
+/* the CRC of PNG chunks, over their type and data */
+static uint32_t
+__png_crc(const uint8_t *p, size_t n)
+{
+	int k;
+	size_t i;
+	uint32_t c, table[256];
+
+	for (i = 0; i < 256; ++i) {
+		for (c = i, k = 0; k < 8; ++k)
+			c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		table[i] = c;
+	}
+
+	for (c = 0xffffffff, i = 0; i < n; ++i)
+		c = table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+
+	return c ^ 0xffffffff;
+}
+
+/* the length and CRC of the chunk that started at offset */
+static void
+__png_chunk_end(ImageBuffer *b, size_t offset)
+{
+	uint32_t length;
+
+	length = b->size - offset - 8;
+	b->data[offset] = length >> 24;
+	b->data[offset+1] = length >> 16;
+	b->data[offset+2] = length >> 8;
+	b->data[offset+3] = length;
+	__image_buffer_put_u32(b, __png_crc(&b->data[offset+4], length + 4));
+}
+
+static size_t
+__png_chunk_begin(ImageBuffer *b, const char *type)
+{
+	size_t offset;
+
+	offset = b->size;
+	__image_buffer_put_u32(b, 0);
+	__image_buffer_put(b, type, 4);
+
+	return offset;
+}
+
+/* row y of the pixels as PNG has it, RGB after the filter byte: */
+/* each byte less the one of the pixel to its left when deflated, */
+/* which then packs runs of the same colour, as is when stored */
+static void
+__png_filter_row(const uint32_t *px, int w, int y, uint8_t *line)
+{
+	int x, i;
+	uint8_t *p;
+
+	p = line + 1;
+
+	for (x = 0; x < w; ++x) {
+		*p++ = px[y*w+x] >> 16;
+		*p++ = px[y*w+x] >> 8;
+		*p++ = px[y*w+x];
+	}
+
+#ifdef ZINC_USE_PNG
+	line[0] = 1;
+	for (i = 3 * w; i > 3; --i)
+		line[i] -= line[i-3];
+#else
+	(void) i;
+	line[0] = 0;
+#endif
+}
+
+#ifndef ZINC_USE_PNG
+static uint32_t
+__png_adler(uint32_t adler, const uint8_t *p, size_t n)
+{
+	size_t i, run;
+	uint32_t a, b;
+
+	a = adler & 0xffff;
+	b = adler >> 16;
+
+	// sums of up to 5552 bytes can not overflow before the modulo
+	while (n > 0) {
+		run = MIN(n, 5552);
+		for (i = 0; i < run; ++i) {
+			a += p[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		p += run;
+		n -= run;
+	}
+
+	return b << 16 | a;
+}
+#endif
+
+/* the w by h XRGB pixels as an RGB PNG file, in a buffer of its */
+/* own, given back with xfree; deflated when compiled with zlib, */
+/* stored as is otherwise */
+extern uint8_t *
+image_encode_png(const uint32_t *px, int w, int h, size_t *size)
+{
+	int y;
+	size_t stride, idat;
+	uint8_t *line, ihdr[13];
+	ImageBuffer b;
+#ifdef ZINC_USE_PNG
+	z_stream zs;
+#else
+	size_t left, inblock, n, at;
+	uint32_t adler;
+	uint8_t block[5];
+#endif
+
+	memset(&b, 0, sizeof(b));
+	stride = 1 + 3 * (size_t)(w);
+	line = xmalloc(stride);
+
+	__image_buffer_put(&b, "\x89PNG\r\n\x1a\n", 8);
+
+	ihdr[0] = w >> 24; ihdr[1] = w >> 16; ihdr[2] = w >> 8; ihdr[3] = w;
+	ihdr[4] = h >> 24; ihdr[5] = h >> 16; ihdr[6] = h >> 8; ihdr[7] = h;
+	ihdr[8] = 8;
+	ihdr[9] = 2;
+	ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+	idat = __png_chunk_begin(&b, "IHDR");
+	__image_buffer_put(&b, ihdr, sizeof(ihdr));
+	__png_chunk_end(&b, idat);
+
+	// a single IDAT, as long as the whole stream
+	idat = __png_chunk_begin(&b, "IDAT");
+
+#ifdef ZINC_USE_PNG
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK)
+		die("deflateInit failed");
+
+	for (y = 0; y <= h; ++y) {
+		if (y < h) {
+			__png_filter_row(px, w, y, line);
+			zs.next_in = line;
+			zs.avail_in = stride;
+		}
+		do {
+			__image_buffer_reserve(&b, 65536);
+			zs.next_out = &b.data[b.size];
+			zs.avail_out = 65536;
+			deflate(&zs, y < h ? Z_NO_FLUSH : Z_FINISH);
+			b.size += 65536 - zs.avail_out;
+		} while (0 == zs.avail_out || (y == h && 0 != zs.avail_in));
+	}
+
+	deflateEnd(&zs);
+#else
+	// blocks of at most 65535 bytes, the last one marked as such
+	__image_buffer_put(&b, "\x78\x01", 2);
+	left = stride * h;
+	inblock = 0;
+	adler = 1;
+
+	for (y = 0; y < h; ++y) {
+		__png_filter_row(px, w, y, line);
+		adler = __png_adler(adler, line, stride);
+		for (at = 0; at < stride; at += n) {
+			if (0 == inblock) {
+				inblock = MIN(left, 65535);
+				block[0] = left == inblock;
+				block[1] = inblock;
+				block[2] = inblock >> 8;
+				block[3] = ~block[1];
+				block[4] = ~block[2];
+				__image_buffer_put(&b, block, 5);
+			}
+			n = MIN(stride - at, inblock);
+			__image_buffer_put(&b, &line[at], n);
+			inblock -= n;
+			left -= n;
+		}
+	}
+
+	__image_buffer_put_u32(&b, adler);
+#endif
+
+	__png_chunk_end(&b, idat);
+
+	idat = __png_chunk_begin(&b, "IEND");
+	__png_chunk_end(&b, idat);
+
+	free(line);
+
+	return __image_buffer_finish(&b, size);
+}
+
+/* the w by h XRGB pixels as a binary PPM file, in a buffer of its */
+/* own, given back with xfree */
+extern uint8_t *
+image_encode_ppm(const uint32_t *px, int w, int h, size_t *size)
+{
+	int n;
+	size_t i;
+	uint8_t *p;
+	char header[64];
+	ImageBuffer b;
+
+	memset(&b, 0, sizeof(b));
+	n = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", w, h);
+	__image_buffer_put(&b, header, n);
+
+	p = __image_buffer_reserve(&b, (size_t)(w) * h * 3);
+
+	for (i = 0; i < (size_t)(w) * h; ++i) {
+		*p++ = px[i] >> 16;
+		*p++ = px[i] >> 8;
+		*p++ = px[i];
+	}
+
+	b.size += (size_t)(w) * h * 3;
+
+	return __image_buffer_finish(&b, size);
+}
@@ -0,0 +1,150 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include "utils.h"
+#include "pack.h"
+
+/* every piece starts with a 16 bit header, the kind of piece in */
+/* the top two bits and the pixels it covers, less one, in the */
+/* rest; a literal is followed by its pixels, a run by the pixel */
+/* it repeats, and a copy of the row above by nothing */
+#define PACK_LITERAL 0
+#define PACK_RUN 1
+#define PACK_UP 2
+#define PACK_MAX_COUNT (1 << 14)
+
+typedef struct {
+	uint8_t *data;
+	size_t size;
+	size_t capacity;
+} PackBuffer;
+
+static void
+__pack_put(PackBuffer *b, const void *src, size_t n)
+{
+	if (b->size + n > b->capacity) {
+		b->capacity = b->capacity * 2 + n;
+		b->data = xrealloc_tagged(ALLOC_COLD, b->data, b->capacity);
+	}
+
+	memcpy(&b->data[b->size], src, n);
+	b->size += n;
+}
+
+static void
+__pack_header(PackBuffer *b, int kind, int count)
+{
+	uint16_t header;
+	header = kind << 14 | (count - 1);
+	__pack_put(b, &header, sizeof(header));
+}
+
+static void
+__pack_literal(PackBuffer *b, const uint32_t *px, int from, int to)
+{
+	int count;
+
+	for (; from < to; from += count) {
+		count = to - from < PACK_MAX_COUNT ? to - from : PACK_MAX_COUNT;
+		__pack_header(b, PACK_LITERAL, count);
+		__pack_put(b, &px[from], count * sizeof(uint32_t));
+	}
+}
+
+extern uint8_t *
+pack_pixels(const uint32_t *px, int w, int n, size_t *size)
+{
+	int i, lit, run, up, max;
+	PackBuffer b;
+
+	b.data = NULL;
+	b.size = b.capacity = 0;
+
+	for (i = lit = 0; i < n; ) {
+		max = n - i < PACK_MAX_COUNT ? n - i : PACK_MAX_COUNT;
+
+		for (run = 1; run < max && px[i + run] == px[i]; ++run)
+			;
+
+		for (up = 0; i >= w && up < max && px[i + up] == px[i + up - w]; ++up)
+			;
+
+		// a single pixel is not worth ending a literal for
+		if (run < 2 && up < 2) {
+			++i;
+			continue;
+		}
+
+		__pack_literal(&b, px, lit, i);
+
+		if (up >= run) {
+			__pack_header(&b, PACK_UP, up);
+			i += up;
+		} else {
+			__pack_header(&b, PACK_RUN, run);
+			__pack_put(&b, &px[i], sizeof(uint32_t));
+			i += run;
+		}
+
+		lit = i;
+	}
+
+	__pack_literal(&b, px, lit, n);
+
+	*size = b.size;
+
+	return xrealloc_tagged(ALLOC_COLD, b.data, b.size > 0 ? b.size : 1);
+}
+
+extern void
+unpack_pixels(const uint8_t *data, size_t size, uint32_t *px, int w, int n)
+{
+	int i, k, count;
+	uint16_t header;
+	uint32_t value;
+	size_t at;
+
+	for (at = 0, i = 0; at + sizeof(header) <= size && i < n; i += count) {
+		memcpy(&header, &data[at], sizeof(header));
+		at += sizeof(header);
+		count = (header & (PACK_MAX_COUNT - 1)) + 1;
+
+		switch (header >> 14) {
+		case PACK_LITERAL:
+			memcpy(&px[i], &data[at], count * sizeof(uint32_t));
+			at += count * sizeof(uint32_t);
+			break;
+		case PACK_RUN:
+			memcpy(&value, &data[at], sizeof(value));
+			at += sizeof(value);
+			for (k = 0; k < count; ++k)
+				px[i + k] = value;
+			break;
+		case PACK_UP:
+			// the pixels may overlap those they are copied from
+			// when the run is longer than a row
+			for (k = 0; k < count; ++k)
+				px[i + k] = px[i + k - w];
+			break;
+		}
+	}
+}
@@ -20,11 +20,16 @@
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
 #include <xcb/xcb_image.h>
+#include <xcb/shm.h>
 
 #include "picker.h"
+#include "expose.h"
+#include "pixel.h"
 #include "utils.h"
 
 #define PADDING 10
@@ -43,8 +48,9 @@
 #define HUE_RECT_X2 (HUE_RECT_X1 + HUE_RECT_WIDTH)
 #define HUE_RECT_Y2 (HUE_RECT_Y1 + HUE_RECT_HEIGHT)
 
-#define MIN(a,b) ((a)<(b)?(a):(b))
-#define MAX(a,b) ((a)>(b)?(a):(b))
+/* the strips above and left of the gradient and right of the hue */
+/* bar the indicators are drawn on */
+#define INDICATOR_LENGTH (PADDING - 6)
 
 typedef struct Color Color;
 
@@ -62,9 +68,23 @@ struct Picker {
 	xcb_connection_t *conn;
 	xcb_window_t win;
 	xcb_gcontext_t gc;
-	xcb_image_t *img;
+	uint8_t depth;
 	PickerOnColorChangeHandler occ;
 	Color color;
+
+	/* px is a MIT-SHM segment the server reads the uploads from */
+	bool shm;
+	xcb_shm_seg_t seg;
+
+	/* hue the gradient in px was made for */
+	bool has_gradient;
+	float gradient_hue;
+
+	/* where the indicators are drawn in px, -1 if nowhere yet */
+	int saturation_x;
+	int lightness_y;
+	int hue_y;
+	Expose exposed;
 };
 
 /***********************************************/
@@ -168,6 +188,38 @@ __color_to_uint32(const Color color)
 			((int)(color.b) <<  0));
 }
 
+static bool
+__picker_check_shm(xcb_connection_t *conn)
+{
+	xcb_generic_error_t *error;
+	xcb_shm_query_version_reply_t *reply;
+
+	reply = xcb_shm_query_version_reply(conn,
+			xcb_shm_query_version(conn), &error);
+
+	free(error);
+
+	if (NULL == reply)
+		return false;
+
+	free(reply);
+	return true;
+}
+
+/* the hue bar never changes, it is drawn once */
+static void
+__picker_draw_hue_bar(Picker *picker)
+{
+	int dx, dy;
+	uint32_t col;
+
+	for (dy = 0; dy < HUE_RECT_HEIGHT; dy++) {
+		col = __color_to_uint32(__color_make_hsl(((float)(dy))/HUE_RECT_HEIGHT, 1.0, 0.5));
+		for (dx = 0; dx < HUE_RECT_WIDTH; dx++)
+			picker->px[(PADDING+dy)*picker->width+HUE_RECT_X1+dx] = col;
+	}
+}
+
 extern Picker *
 picker_new(xcb_connection_t *conn, xcb_window_t parent_win, PickerOnColorChangeHandler occ)
 {
@@ -176,6 +228,8 @@ picker_new(xcb_connection_t *conn, xcb_window_t parent_win, PickerOnColorChangeH
 	size_t szpx;
 	xcb_screen_t *scr;
 	uint8_t depth;
+	int shmid;
+	xcb_generic_error_t *error;
 
 	w = HUE_RECT_X2 + PADDING;
 	h = HUE_RECT_Y2 + PADDING;
@@ -186,7 +240,7 @@ picker_new(xcb_connection_t *conn, xcb_window_t parent_win, PickerOnColorChangeH
 	assert(scr != NULL);
 
 	szpx = w * h * sizeof(uint32_t);
-	picker = xcalloc(1, sizeof(Picker));
+	picker = xcalloc_tagged(ALLOC_PICKER, 1, sizeof(Picker));
 	depth = scr->root_depth;
 
 	picker->visible = false;
@@ -213,47 +267,150 @@ picker_new(xcb_connection_t *conn, xcb_window_t parent_win, PickerOnColorChangeH
 
 	xcb_create_gc(conn, picker->gc, picker->win, 0, NULL);
 
-	picker->px = xcalloc(w * h, sizeof(uint32_t));
+	picker->depth = depth;
+	picker->shm = __picker_check_shm(conn);
+
+	if (picker->shm) {
+		shmid = shmget(IPC_PRIVATE, szpx, IPC_CREAT | 0600);
+		picker->px = shmid < 0 ? (void *)(-1) : shmat(shmid, NULL, 0);
+
+		if ((void *)(-1) != picker->px) {
+			memset(picker->px, 0, szpx);
+			picker->seg = xcb_generate_id(conn);
+			// a server on another machine has the extension but
+			// can not reach the segment
+			error = xcb_request_check(conn, xcb_shm_attach_checked(conn,
+						picker->seg, shmid, 0));
+			if (NULL != error) {
+				free(error);
+				shmdt(picker->px);
+				picker->px = (void *)(-1);
+			}
+		}
+
+		if (shmid >= 0)
+			shmctl(shmid, IPC_RMID, NULL);
+
+		// the uploads go through xcb_put_image just as well
+		picker->shm = (void *)(-1) != picker->px;
+	}
 
-	picker->img = xcb_image_create_native(conn, w, h,
-			XCB_IMAGE_FORMAT_Z_PIXMAP, depth, picker->px,
-			szpx, (uint8_t *)(picker->px));
+	if (picker->shm)
+		alloc_note(ALLOC_SHM, szpx);
+	else
+		picker->px = xcalloc_tagged(ALLOC_PICKER, w * h, sizeof(uint32_t));
+
+	picker->saturation_x = picker->lightness_y = picker->hue_y = -1;
+	__picker_draw_hue_bar(picker);
 
 	return picker;
 }
 
 static void
-__picker_draw(Picker *picker)
+__picker_put_rect(Picker *picker, int x, int y, int w, int h)
 {
-	int dx, dy;
-	Color col;
+	int row;
+	uint32_t *rows;
+
+	x = MAX(x, 0);
+	y = MAX(y, 0);
+	w = MIN(w, picker->width - x);
+	h = MIN(h, picker->height - y);
+
+	if (w <= 0 || h <= 0)
+		return;
+
+	// the server reads the rectangle straight from px, without
+	// it going through the connection
+	if (picker->shm) {
+		xcb_shm_put_image(picker->conn, picker->win, picker->gc,
+				picker->width, picker->height, x, y, w, h, x, y,
+				picker->depth, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, picker->seg, 0);
+		return;
+	}
 
-	memset(picker->px, 0, picker->width * picker->height * sizeof(uint32_t));
+	rows = xmalloc(w * h * sizeof(uint32_t));
 
-	for (dy = PADDING - 5; dy < PADDING - 1; ++dy)
-		picker->px[(dy)*picker->width+(PADDING+(int)((1-picker->color.s)*SATURATION_LIGHTNESS_RECT_WIDTH))] = 0xffffff;
+	for (row = 0; row < h; ++row)
+		memcpy(&rows[row*w], &picker->px[(y+row)*picker->width+x],
+				w * sizeof(uint32_t));
 
-	for (dx = PADDING - 5; dx < PADDING - 1; ++dx)
-		picker->px[(PADDING + (int)((1-picker->color.l)*SATURATION_LIGHTNESS_RECT_HEIGHT))*picker->width+dx] = 0xffffff;
+	xcb_put_image(picker->conn, XCB_IMAGE_FORMAT_Z_PIXMAP, picker->win,
+			picker->gc, w, h, x, y, 0, picker->depth,
+			w * h * sizeof(uint32_t), (const uint8_t *)(rows));
 
-	for (dx = 1; dx < PADDING - 5; ++dx)
-		picker->px[(PADDING + (int)(picker->color.h*HUE_RECT_HEIGHT))*picker->width+HUE_RECT_X2+dx] = 0xffffff;
+	free(rows);
+}
 
-	for (dy = 0; dy < SATURATION_LIGHTNESS_RECT_HEIGHT; dy++) {
-		for (dx = 0; dx < SATURATION_LIGHTNESS_RECT_WIDTH; dx++) {
-			col = __color_make_hsl(picker->color.h, 1-(float)dx/SATURATION_LIGHTNESS_RECT_WIDTH, 1-(float)dy/SATURATION_LIGHTNESS_RECT_HEIGHT);
-			picker->px[(PADDING+dy)*picker->width+PADDING+dx] = __color_to_uint32(col);
+/* moves the indicator on a strip of px from *at to 'to', along x */
+/* (at y0) or y (at x0), and sends what changed */
+static void
+__picker_move_indicator(Picker *picker, int *at, int to, bool along_x,
+		int x0, int y0)
+{
+	int i, lo, hi;
+
+	if (*at == to)
+		return;
+
+	for (i = 0; i < INDICATOR_LENGTH; ++i) {
+		if (along_x) {
+			if (*at >= 0)
+				picker->px[(y0+i)*picker->width+*at] = 0;
+			picker->px[(y0+i)*picker->width+to] = 0xffffff;
+		} else {
+			if (*at >= 0)
+				picker->px[*at*picker->width+x0+i] = 0;
+			picker->px[to*picker->width+x0+i] = 0xffffff;
 		}
 	}
 
-	for (dy = 0; dy < HUE_RECT_HEIGHT; dy++) {
-		col = __color_make_hsl(((float)(dy))/HUE_RECT_HEIGHT, 1.0, 0.5);
-		for (dx = 0; dx < HUE_RECT_WIDTH; dx++) {
-			picker->px[(PADDING+dy)*picker->width+HUE_RECT_X1+dx] = __color_to_uint32(col);
-		}
+	lo = *at >= 0 ? MIN(*at, to) : to;
+	hi = *at >= 0 ? MAX(*at, to) : to;
+
+	if (along_x)
+		__picker_put_rect(picker, lo, y0, hi - lo + 1, INDICATOR_LENGTH);
+	else
+		__picker_put_rect(picker, x0, lo, INDICATOR_LENGTH, hi - lo + 1);
+
+	*at = to;
+}
+
+/* brings px up to date with the color and sends the parts of it */
+/* that changed: the gradient only when the hue did, and otherwise */
+/* the indicator strips */
+static void
+__picker_draw(Picker *picker)
+{
+	int dy;
+
+	if (!picker->has_gradient || picker->gradient_hue != picker->color.h) {
+		for (dy = 0; dy < SATURATION_LIGHTNESS_RECT_HEIGHT; dy++)
+			pixel_hsl_row(&picker->px[(PADDING+dy)*picker->width+PADDING],
+					picker->color.h, 1, -1.0f/SATURATION_LIGHTNESS_RECT_WIDTH,
+					1-(float)dy/SATURATION_LIGHTNESS_RECT_HEIGHT,
+					SATURATION_LIGHTNESS_RECT_WIDTH);
+
+		picker->has_gradient = true;
+		picker->gradient_hue = picker->color.h;
+
+		__picker_put_rect(picker, SATURATION_LIGHTNESS_RECT_X1,
+				SATURATION_LIGHTNESS_RECT_Y1, SATURATION_LIGHTNESS_RECT_WIDTH,
+				SATURATION_LIGHTNESS_RECT_HEIGHT);
 	}
 
-	xcb_image_put(picker->conn, picker->win, picker->gc, picker->img, 0, 0, 0);
+	__picker_move_indicator(picker, &picker->saturation_x,
+			PADDING+(int)((1-picker->color.s)*SATURATION_LIGHTNESS_RECT_WIDTH),
+			true, 0, PADDING - 5);
+
+	__picker_move_indicator(picker, &picker->lightness_y,
+			PADDING+(int)((1-picker->color.l)*SATURATION_LIGHTNESS_RECT_HEIGHT),
+			false, PADDING - 5, 0);
+
+	__picker_move_indicator(picker, &picker->hue_y,
+			PADDING+(int)(picker->color.h*HUE_RECT_HEIGHT),
+			false, HUE_RECT_X2 + 1, 0);
+
 	xcb_flush(picker->conn);
 }
 
@@ -280,9 +437,22 @@ __picker_select_at(Picker *picker, int x, int y)
 static bool
 __h_picker_expose(Picker *picker, const xcb_expose_event_t *ev)
 {
+	int i;
+	const xcb_rectangle_t *r;
+
 	if (ev->window != picker->win)
 		return false;
-	__picker_draw(picker);
+
+	// the image is already up to date, only the exposed
+	// rectangles need to be sent again once all arrived
+	if (!expose_add(&picker->exposed, ev))
+		return true;
+
+	for (i = 0, r = picker->exposed.rects; i < picker->exposed.nrects; ++i, ++r)
+		__picker_put_rect(picker, r->x, r->y, r->width, r->height);
+
+	xcb_flush(picker->conn);
+
 	return true;
 }
 
@@ -382,7 +552,14 @@ extern void
 picker_destroy(Picker *picker)
 {
 	xcb_free_gc(picker->conn, picker->gc);
-	xcb_image_destroy(picker->img);
+	if (picker->shm) {
+		xcb_shm_detach(picker->conn, picker->seg);
+		shmdt(picker->px);
+		alloc_note(ALLOC_SHM, -(long)(picker->width * picker->height
+					* sizeof(uint32_t)));
+	} else {
+		xfree(picker->px);
+	}
 	xcb_destroy_window(picker->conn, picker->win);
-	free(picker);
+	xfree(picker);
 }
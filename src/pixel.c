@@ -0,0 +1,199 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "pixel.h"
+
+static inline uint32_t
+__pixel_avg4(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+	uint32_t rb, g;
+
+	// red and blue are far enough apart to be summed together
+	rb = (a & 0xff00ff) + (b & 0xff00ff) + (c & 0xff00ff) + (d & 0xff00ff);
+	g = (a & 0xff00) + (b & 0xff00) + (c & 0xff00) + (d & 0xff00);
+
+	return (((rb + 0x020002) >> 2) & 0xff00ff) | (((g + 0x0200) >> 2) & 0xff00);
+}
+
+extern void
+pixel_downsample_2x2(uint32_t *dst, const uint32_t *r0, const uint32_t *r1, int n)
+{
+	int i;
+
+	i = 0;
+
+#ifdef __SSE2__
+	// four output pixels at a time: the rows are averaged first,
+	// then the even and odd columns are split apart and averaged,
+	// pavgb rounds up twice, which is at most one level too bright
+	for (; i + 4 <= n; i += 4) {
+		__m128i a, b, even, odd;
+
+		a = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(&r0[2*i])),
+				_mm_loadu_si128((const __m128i *)(&r1[2*i])));
+		b = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(&r0[2*i+4])),
+				_mm_loadu_si128((const __m128i *)(&r1[2*i+4])));
+
+		even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a),
+					_mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+		odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a),
+					_mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+
+		_mm_storeu_si128((__m128i *)(&dst[i]), _mm_avg_epu8(even, odd));
+	}
+#endif
+
+	for (; i < n; ++i)
+		dst[i] = __pixel_avg4(r0[2*i], r0[2*i+1], r1[2*i], r1[2*i+1]);
+}
+
+/* x * a / 255 for every byte of x, rounded */
+static inline uint32_t
+__pixel_scale(uint32_t x, uint32_t a)
+{
+	uint32_t rb, ag;
+
+	rb = (x & 0xff00ff) * a + 0x800080;
+	rb = ((rb + ((rb >> 8) & 0xff00ff)) >> 8) & 0xff00ff;
+	ag = ((x >> 8) & 0xff00ff) * a + 0x800080;
+	ag = (ag + ((ag >> 8) & 0xff00ff)) & 0xff00ff00;
+
+	return rb | ag;
+}
+
+extern uint32_t
+pixel_premultiply(uint32_t color, uint8_t alpha)
+{
+	return __pixel_scale((color & 0xffffff) | 0xff000000, alpha);
+}
+
+extern void
+pixel_blend_over(uint32_t *dst, const uint32_t *src, int n)
+{
+	int i;
+	uint32_t sa;
+
+	i = 0;
+
+#ifdef __SSE2__
+	// four pixels at a time, widened to 16 bits a channel so the
+	// products fit, then divided by 255 the same way as below
+	for (; i + 4 <= n; i += 4) {
+		__m128i s, d, lo, hi, alo, ahi, zero, bias, full;
+
+		s = _mm_loadu_si128((const __m128i *)(&src[i]));
+		d = _mm_loadu_si128((const __m128i *)(&dst[i]));
+		zero = _mm_setzero_si128();
+		bias = _mm_set1_epi16(0x80);
+		full = _mm_set1_epi16(0xff);
+
+		alo = _mm_unpacklo_epi8(s, zero);
+		ahi = _mm_unpackhi_epi8(s, zero);
+		alo = _mm_sub_epi16(full, _mm_shufflehi_epi16(_mm_shufflelo_epi16(alo,
+						_MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)));
+		ahi = _mm_sub_epi16(full, _mm_shufflehi_epi16(_mm_shufflelo_epi16(ahi,
+						_MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3)));
+
+		lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), alo), bias);
+		hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ahi), bias);
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+		_mm_storeu_si128((__m128i *)(&dst[i]),
+				_mm_add_epi8(s, _mm_packus_epi16(lo, hi)));
+	}
+#endif
+
+	for (; i < n; ++i) {
+		sa = src[i] >> 24;
+		if (0xff == sa)
+			dst[i] = src[i];
+		else if (0 != sa)
+			dst[i] = src[i] + __pixel_scale(dst[i], 0xff - sa);
+	}
+}
+
+/* how much of the lighter end a channel t away on the hue circle */
+/* gets, from 0 to 1 */
+static float
+__pixel_hue_weight(float t)
+{
+	if (t < 0) t += 1;
+	if (t > 1) t -= 1;
+	if (t < 1.0f/6) return 6 * t;
+	if (t < 1.0f/2) return 1;
+	if (t < 2.0f/3) return (2.0f/3 - t) * 6;
+	return 0;
+}
+
+static inline uint32_t
+__pixel_channel(float v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : (uint32_t)(v);
+}
+
+extern void
+pixel_hsl_row(uint32_t *dst, float h, float s, float ds, float l, int n)
+{
+	int i, c;
+	float m, a[3], b[3];
+
+	// with the hue and lightness fixed every channel goes in a
+	// straight line with the saturation: l + s * min(l, 1 - l)
+	// * (2w - 1), w being the weight of the channel on the hue
+	m = 255 * (l < 0.5f ? l : 1 - l);
+
+	for (c = 0; c < 3; ++c) {
+		b[c] = m * (2 * __pixel_hue_weight(h + (1 - c) / 3.0f) - 1);
+		a[c] = 255 * l + s * b[c];
+		b[c] *= ds;
+	}
+
+	i = 0;
+
+#ifdef __SSE2__
+	// four pixels at a time, each channel worked out the same way
+	// as below and truncated, so both paths agree
+	for (; i + 4 <= n; i += 4) {
+		__m128 idx, lo, hi;
+		__m128i px[3];
+
+		idx = _mm_set_ps(i + 3, i + 2, i + 1, i);
+		lo = _mm_setzero_ps();
+		hi = _mm_set1_ps(255);
+
+		for (c = 0; c < 3; ++c)
+			px[c] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(
+									_mm_set1_ps(a[c]), _mm_mul_ps(idx,
+										_mm_set1_ps(b[c]))), lo), hi));
+
+		_mm_storeu_si128((__m128i *)(&dst[i]), _mm_or_si128(_mm_or_si128(
+						_mm_slli_epi32(px[0], 16), _mm_slli_epi32(px[1], 8)), px[2]));
+	}
+#endif
+
+	for (; i < n; ++i)
+		dst[i] = __pixel_channel(a[0] + (float)(i) * b[0]) << 16
+				| __pixel_channel(a[1] + (float)(i) * b[1]) << 8
+				| __pixel_channel(a[2] + (float)(i) * b[2]);
+}
@@ -17,41 +17,477 @@
 */
 
 #include <stdbool.h>
+#include <limits.h>
 #include <string.h>
 #include <assert.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef ZINC_USE_RENDER_THREAD
+#include <sched.h>
+#include <semaphore.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+#if defined(ZINC_USE_RENDER_THREAD) || defined(ZINC_USE_LAYERS)
+#include <stdatomic.h>
+#endif
 #include <xcb/xcb.h>
+#include <xcb/xcbext.h>
 #include <xcb/xproto.h>
-#include <xcb/xcb_image.h>
 #include <xcb/shm.h>
+#ifdef ZINC_USE_PRESENT
+#include <xcb/present.h>
+#endif
+#ifdef ZINC_USE_XRENDER
+#include <xcb/render.h>
+#endif
 #include <sys/shm.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include "pizarra.h"
+#include "pixel.h"
+#include "brush.h"
+#include "pack.h"
 #include "utils.h"
 
+/* how many frames of scrolling ahead of the camera a chunk is prepared */
+#define ZINC_PREFETCH_FRAMES 8
+
+/* how many of the last scroll copies are remembered to place */
+/* the GraphicsExpose events that they generate */
+#define ZINC_SCROLL_HISTORY 8
+
+/* frame time the non-SHM uploads are spread over, with the */
+/* least that is sent per frame however slow the link is */
+#define ZINC_UPLOAD_FRAME_MS 16
+#define ZINC_UPLOAD_MIN_BYTES (64 * 1024)
+
+/* initial guess of the link throughput, in bytes per second */
+#define ZINC_UPLOAD_INITIAL_RATE (8.0 * 1024 * 1024)
+
+/* size of the PutImage request header */
+#define X_PUT_IMAGE_HEADER 24
+
+/* number of back pixmaps handed over through the Present extension */
+#define ZINC_PRESENT_BUFFERS 2
+
+/* number of halvings of the chunk pyramids, the furthest the */
+/* camera zooms out */
+#define ZINC_MIP_LEVELS 6
+
+/* furthest the camera goes from the canvas origin, either way, so */
+/* its position scaled by the zoom still fits an int */
+#define ZINC_CAMERA_REACH (1 << 24)
+
+/* zoom steps per halving when the server does the scaling, and */
+/* the filter it scales with ("nearest" is sharper, and faster) */
+#define ZINC_XRENDER_ZOOM_STEPS 4
+#ifndef ZINC_XRENDER_FILTER
+#define ZINC_XRENDER_FILTER "bilinear"
+#endif
+
+/* number of pending spans a flood fill keeps track of, past */
+/* that it looks around what it filled so far again */
+#define ZINC_FILL_STACK 65536
+
+/* number of commands that fit between the input and render threads */
+#define ZINC_RENDER_QUEUE_SIZE 1024
+
+/* with a loader set, chunks within this many chunk heights of */
+/* the camera are loaded, and those further than twice as far */
+/* give their memory back */
+#define ZINC_RESIDENT_MARGIN 1
+
+/* side of the square tiles the layers are kept in */
+#define ZINC_LAYER_TILE 64
+
+/* room the stroke overlay grows by past what it needs, so a */
+/* stroke going one way is not copied over on every step */
+#define ZINC_OVERLAY_MARGIN 128
+
+/* side of the square tiles a replay is split into, each drawn by */
+/* a single thread, a whole number of layer tiles */
+#define ZINC_REPLAY_TILE 128
+
+/* replays with fewer operations are drawn on the calling thread */
+#define ZINC_REPLAY_MIN_OPS 4096
+
+/* threads replays are drawn on, 0 for one per online processor */
+#ifndef ZINC_REPLAY_THREADS
+#define ZINC_REPLAY_THREADS 0
+#endif
+#define ZINC_REPLAY_MAX_THREADS 64
+
+#if ZINC_REPLAY_TILE % ZINC_LAYER_TILE != 0
+#error "ZINC_REPLAY_TILE has to be a multiple of ZINC_LAYER_TILE"
+#endif
+
+/* what a frozen chunk is packed as: each layer, or px itself */
+#ifdef ZINC_USE_LAYERS
+#define ZINC_PLANES ZINC_LAYERS
+#else
+#define ZINC_PLANES 1
+#endif
+
 typedef struct {
 	int x;
 	int y;
 } Vector2;
 
+/* a rectangle by its corners, empty when x0 >= x1 */
+typedef struct {
+	int x0, y0;
+	int x1, y1;
+} Box;
+
+/* camera as seen by the renderer */
+typedef struct {
+	Vector2 pos;
+	int width;
+	int height;
+
+	/* zoom level in steps, and the canvas pixels per window */
+	/* pixel it stands for, in 16.16 fixed point */
+	int zoom;
+	int32_t scale;
+} View;
+
+/* pixel memory of a chunk, before it is registered with the X server */
+typedef struct {
+	int shmid;
+	uint32_t *px;
+} ChunkMemory;
+
+#ifndef ZINC_NO_PREFETCH
+typedef enum {
+	PREFETCH_UP,
+	PREFETCH_DOWN
+} PrefetchDirection;
+
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool quit;
+	bool shm;
+	size_t size;
+	bool wanted[2];
+	bool ready[2];
+	ChunkMemory mem[2];
+} Prefetcher;
+#endif
+
+typedef struct {
+	/* measured link throughput, in bytes per second */
+	double rate;
+
+	/* round trip used to time the last batch of uploads */
+	bool probing;
+	unsigned int probe_sequence;
+	size_t probe_bytes;
+	uint64_t probe_start;
+
+	uint64_t bytes_total;
+} Uploader;
+
+/* frame the zoomed out views are composed in, from the chunk pyramids */
+typedef struct {
+	int width;
+	int height;
+	uint32_t *px;
+
+	bool shm;
+	xcb_shm_seg_t seg;
+	xcb_pixmap_t pixmap;
+
+	/* the server may read px until the reply to this arrives */
+	bool busy;
+	unsigned int sequence;
+
+	/* zoomed out frames, composing time in microseconds, and */
+	/* the tallest canvas */
+	/* it was measured on, in chunks */
+	unsigned long frames;
+	uint64_t time_total;
+	uint64_t time_max;
+	int chunks_max;
+} Overview;
+
+/* an overlay pixel drawn over since the mark, as it was before */
+typedef struct {
+	int x, y;
+	uint32_t px;
+} OverlayTrace;
+
+/* the stroke being drawn, kept apart from the canvas until it */
+/* is merged into it or dropped */
+typedef struct {
+	bool active;
+
+	/* canvas area the buffers cover, what was drawn on, and */
+	/* what is still to be composed over the canvas */
+	Box area;
+	Box drawn;
+	Box dirty;
+
+	/* premultiplied ARGB */
+	uint32_t *px;
+
+#ifndef ZINC_USE_LAYERS
+	/* the canvas under it, the layers hold it otherwise */
+	uint32_t *under;
+#endif
+
+	/* canvas area what is drawn on it is kept within, if any */
+	bool clipped;
+	Box clip;
+
+	/* drawn over since the mark, oldest first, to be put back */
+	bool marked;
+	OverlayTrace *traces;
+	size_t ntraces, captraces;
+
+	unsigned long merged;
+	unsigned long dropped;
+	unsigned long rewinds;
+} Overlay;
+
+#ifdef ZINC_USE_XRENDER
+/* zoomed out frames scaled on the server from the chunk pixmaps */
+typedef struct {
+	bool enabled;
+	xcb_render_pictformat_t format;
+	xcb_render_picture_t window;
+} XRender;
+#endif
+
+#ifdef ZINC_USE_PRESENT
+typedef struct {
+	xcb_pixmap_t pixmap;
+	bool idle;
+} PresentBuffer;
+
+typedef struct {
+	bool enabled;
+	uint8_t opcode;
+	uint32_t eid;
+	PresentBuffer buffers[ZINC_PRESENT_BUFFERS];
+	int width;
+	int height;
+
+	/* serial and target of the last frame handed over, and the */
+	/* vblank the last one completed at and when (server clock, us) */
+	uint32_t serial;
+	uint64_t target;
+	uint64_t msc;
+	uint64_t ust;
+
+	/* time between vblanks, and how long before one a frame has */
+	/* to be handed over to make it, both as measured, in us */
+	uint64_t interval_us;
+	uint64_t margin_us;
+	unsigned long missed;
+
+	/* a frame was handed over and has not completed yet, */
+	/* and whether another one was asked for in the meantime */
+	bool pending;
+	bool wanted;
+
+	/* when the frame waiting to be composed, and the one */
+	/* in flight, were first asked for (CLOCK_MONOTONIC, us) */
+	uint64_t wanted_us;
+	uint64_t pending_us;
+
+	/* input-to-present latency, in microseconds */
+	unsigned long frames;
+	uint64_t latency_total;
+	uint64_t latency_max;
+} Presenter;
+#endif
+
+#ifdef ZINC_USE_RENDER_THREAD
+typedef enum {
+	RENDER_FRAME,
+	RENDER_DAMAGE,
+	RENDER_REGION,
+	RENDER_CLEAR,
+	RENDER_EVENT,
+	RENDER_QUIT
+} RenderCommandType;
+
+typedef struct {
+	RenderCommandType type;
+	union {
+		struct {
+			View view;
+			uint64_t when;
+		} frame;
+		struct {
+			struct Chunk *chunk;
+			Box box;
+		} damage;
+		struct {
+			int x, y;
+			int w, h;
+		} region;
+		/* copy of an event that belongs to the renderer */
+		uint8_t event[64];
+	} u;
+} RenderCommand;
+
+/* single producer (input thread), single consumer (render thread) */
+typedef struct {
+	_Atomic size_t head;
+	_Atomic size_t tail;
+	RenderCommand cmds[ZINC_RENDER_QUEUE_SIZE];
+} RenderQueue;
+
+typedef struct {
+	pthread_t thread;
+	sem_t wakeup;
+	RenderQueue queue;
+
+	/* held by the input thread while it links a new chunk, and */
+	/* by the render thread while it walks the list */
+	pthread_mutex_t chunks_lock;
+
+	/* written to after every pass, the replies the renderer waits */
+	/* for may bring events along that xcb keeps in its queue */
+	/* without the socket being readable any more */
+	int pipe[2];
+
+	/* the last frame did not fit in the queue */
+	bool deferred;
+} Renderer;
+#endif
+
+/* part of a chunk drawn by a single thread, and the operations */
+/* that reach into it, in the order they were given */
+typedef struct {
+	struct Chunk *chunk;
+	Box area;
+	size_t first;
+	size_t count;
+} ReplayTile;
+
+typedef struct {
+	/* workers, the calling thread being one more */
+	pthread_t threads[ZINC_REPLAY_MAX_THREADS];
+	int nthreads;
+	bool started;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t finish;
+	unsigned long generation;
+	int running;
+	bool quit;
+
+	/* replay being drawn: tile ops are indexes into ops, in order */
+	const PizarraOp *ops;
+	size_t *order;
+	ReplayTile *tiles;
+	int ntiles;
+	int next;
+
+	/* replays, operations drawn, and the time they took in */
+	/* microseconds */
+	unsigned long replays;
+	size_t ops_total;
+	uint64_t time_total;
+	uint64_t time_max;
+} Replayer;
+
+/* a span of the row above or below y that still has to be */
+/* looked at, y + dy is the row */
+typedef struct {
+	int y;
+	int x0, x1;
+	int dy;
+} FillSeed;
+
+#ifdef ZINC_USE_LAYERS
+/* a tile of a layer, shared by the places a selection was copied */
+/* to until one of them is drawn on */
+typedef struct {
+	atomic_int refs;
+	uint32_t px[ZINC_LAYER_TILE * ZINC_LAYER_TILE];
+} LayerTile;
+
+/* a tile a move lands on, and what it gets: the tile it came from */
+/* when the move lines them up, or else the pixels, area sized */
+typedef struct {
+	struct Chunk *chunk;
+	int t;
+	Box area;
+	bool whole;
+	LayerTile *tile;
+	uint32_t *px;
+} MovePiece;
+
+/* layer tiles in memory, those shared counted once */
+static atomic_long layer_tiles;
+#endif
+
 typedef struct Chunk {
 	int index;
 	int width;
 	int height;
+
+	/* NULL while the chunk is evicted, see PizarraLoader */
 	uint32_t *px;
 
+	/* area modified since the last render */
+	Box damage;
+
+	/* area the renderer still has to bring up to date on the X */
+	/* side: the window for MIT-SHM chunks, where the pixmap */
+	/* shares the memory, the pixmap itself otherwise */
+	Box stale;
+
+	/* the chunk at 1/2, 1/4, ... of its size, allocated on the */
+	/* first zoomed out frame, and the area that changed since */
+	/* they were last brought up to date */
+	uint32_t *mips[ZINC_MIP_LEVELS];
+	Box mip_dirty;
+
+#ifdef ZINC_USE_XRENDER
+	/* picture of the pixmap, created on the first zoomed out frame */
+	xcb_render_picture_t picture;
+#endif
+
+#ifdef ZINC_USE_LAYERS
+	/* tiles of premultiplied ARGB of every layer, NULL where the */
+	/* layer was never drawn on, px holds them composed, and the */
+	/* tiles it has to be brought up to date in */
+	LayerTile **tiles[ZINC_LAYERS];
+	bool *recompose;
+	bool has_recompose;
+#endif
+
+	/* while frozen the memory is given back, and px is NULL as for */
+	/* an evicted chunk, but what it held is kept packed, with the */
+	/* planes that were blank left NULL */
+	bool frozen;
+	uint8_t *cold[ZINC_PLANES];
+	size_t cold_size[ZINC_PLANES];
+
+	/* whether it is in view, and when it last was, see clock */
+	bool in_view;
+	unsigned long seen;
+
 	/* X11 */
 	int shm;
 	xcb_gcontext_t gc;
-	union {
-		struct {
-			int id;
-			xcb_shm_seg_t seg;
-			xcb_pixmap_t pixmap;
-		} shm;
-		xcb_image_t *image;
+	xcb_pixmap_t pixmap;
+	struct {
+		int id;
+		xcb_shm_seg_t seg;
 	} x;
 
 	struct Chunk *next;
@@ -66,10 +502,107 @@ struct Pizarra {
 	int viewport_width;
 	int viewport_height;
 
+	/* camera zoom level, see View, and the steps it takes to */
+	/* halve the size */
+	int zoom;
+	int zoom_steps;
+
+	/* smoothed vertical scroll speed, in pixels per move */
+	float velocity;
+
+	/* flood fills, and the time they took in microseconds */
+	unsigned long fills;
+	uint64_t fill_time_total;
+	uint64_t fill_time_max;
+
+	/* draws the content of chunks again as they are loaded, */
+	/* and the canvas area it is allowed to touch meanwhile */
+	PizarraLoader loader;
+	void *loader_data;
+	bool clipping;
+	Box clip;
+	unsigned long evictions;
+	unsigned long reloads;
+
+	/* bytes of pixels the chunks may take, 0 for no limit, past */
+	/* it those out of view seen the longest ago are frozen; */
+	/* the times the residency was looked at, chunks that came into */
+	/* view and how many of them were still in memory, and the time */
+	/* it took to thaw them, in microseconds */
+	size_t budget;
+	unsigned long clock;
+	unsigned long visits;
+	unsigned long hits;
+	unsigned long freezes;
+	unsigned long thaws;
+	uint64_t thaw_time_total;
+	uint64_t thaw_time_max;
+
+	/* selections moved or copied, and the layer tiles they got to */
+	/* share rather than copy */
+	unsigned long moves;
+	unsigned long tiles_shared;
+
+#ifdef ZINC_USE_LAYERS
+	/* layer drawn on, the ones shown, and the tiles composed */
+	int layer;
+	bool layer_visible[ZINC_LAYERS];
+	unsigned long recomposed;
+#endif
+
+	/* everything below up to the chunks belongs to the renderer */
+	View view;
+
+	/* whether the window holds the canvas as seen from shown */
+	bool has_shown;
+	View shown;
+
+	/* camera position right after each of the last scroll copies, */
+	/* indexed by the sequence number of the copy request */
+	struct {
+		uint16_t sequence;
+		Vector2 pos;
+	} scrolls[ZINC_SCROLL_HISTORY];
+	int scroll_next;
+	int scroll_count;
+
 	Chunk *root;
 
+	/* whether the chunks are backed by MIT-SHM pixmaps */
+	bool shm;
+	uint8_t depth;
+
+	Overview overview;
+	Overlay overlay;
+	Replayer replayer;
+
+#ifdef ZINC_USE_XRENDER
+	XRender xrender;
+#endif
+
+	/* non-SHM uploads */
+	Uploader upload;
+	size_t max_request;
+
+#ifndef ZINC_NO_PREFETCH
+	Prefetcher prefetch;
+#endif
+
+#ifdef ZINC_USE_PRESENT
+	Presenter present;
+#endif
+
+#ifdef ZINC_USE_RENDER_THREAD
+	Renderer renderer;
+#endif
+
+	/* number of frames rendered */
+	unsigned long frames;
+
 	xcb_connection_t *conn;
 	xcb_window_t win;
+	xcb_gcontext_t scroll_gc;
+	xcb_gcontext_t bg_gc;
 };
 
 static int
@@ -101,62 +634,115 @@ __x_check_mit_shm_extension(xcb_connection_t *conn)
 	return 0;
 }
 
-static Chunk *
-__chunk_new(xcb_connection_t *conn, xcb_window_t win, int w, int h)
+static void
+__chunk_memory_alloc(ChunkMemory *mem, bool shm, size_t size)
 {
-	Chunk *c;
-	size_t szpx;
+	if (shm) {
+		mem->shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+
+		if (mem->shmid < 0)
+			die("shmget failed");
+
+		mem->px = shmat(mem->shmid, NULL, 0);
+
+		if (mem->px == (void *) -1) {
+			shmctl(mem->shmid, IPC_RMID, NULL);
+			die("shmat failed");
+		}
+
+		alloc_note(ALLOC_SHM, size);
+	} else {
+		mem->shmid = -1;
+		mem->px = xmalloc_tagged(ALLOC_CHUNKS, size);
+	}
+
+	// touch every page now, so the first stroke or upload
+	// does not pay for the page faults
+	memset(mem->px, 0, size);
+}
+
+#ifndef ZINC_NO_PREFETCH
+static void
+__chunk_memory_free(ChunkMemory *mem, bool shm, size_t size)
+{
+	if (shm) {
+		shmctl(mem->shmid, IPC_RMID, NULL);
+		shmdt(mem->px);
+		alloc_note(ALLOC_SHM, -(long)(size));
+	} else {
+		xfree(mem->px);
+	}
+}
+#endif
+
+/* gives the chunk its memory and its X side */
+static void
+__chunk_attach(xcb_connection_t *conn, xcb_window_t win, Chunk *c,
+		bool shm, const ChunkMemory *prepared)
+{
+	int w, h;
 	xcb_screen_t *scr;
 	uint8_t depth;
-
-	assert(conn != NULL);
-	assert(w > 0);
-	assert(h > 0);
+	ChunkMemory mem;
 
 	scr = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
 	assert(scr != NULL);
 
-	szpx = w * h * sizeof(uint32_t);
-	c = xcalloc(1, sizeof(Chunk));
+	w = c->width;
+	h = c->height;
 	depth = scr->root_depth;
 
-	c->width = w;
-	c->height = h;
+	if (NULL != prepared)
+		mem = *prepared;
+	else
+		__chunk_memory_alloc(&mem, shm, w * h * sizeof(uint32_t));
+
+	c->px = mem.px;
 
+	// copies from the chunk pixmap can never be obscured, so
+	// there is no need for the server to answer with NoExpose
 	c->gc = xcb_generate_id(conn);
-	xcb_create_gc(conn, c->gc, win, 0, NULL);
+	xcb_create_gc(conn, c->gc, win, XCB_GC_GRAPHICS_EXPOSURES,
+			(const uint32_t []) { 0 });
 
-	if (__x_check_mit_shm_extension(conn)) {
+	c->pixmap = xcb_generate_id(conn);
+
+	if (shm) {
 		c->shm = 1;
 
-		c->x.shm.seg = xcb_generate_id(conn);
-		c->x.shm.pixmap = xcb_generate_id(conn);
-		c->x.shm.id = shmget(IPC_PRIVATE, szpx, IPC_CREAT | 0600);
+		c->x.id = mem.shmid;
+		c->x.seg = xcb_generate_id(conn);
 
-		if (c->x.shm.id < 0)
-			die("shmget failed");
+		xcb_shm_attach(conn, c->x.seg, c->x.id, 0);
+		shmctl(c->x.id, IPC_RMID, NULL);
 
-		c->px = shmat(c->x.shm.id, NULL, 0);
+		xcb_shm_create_pixmap(conn, c->pixmap, win, w, h,
+				depth, c->x.seg, 0);
+	} else {
+		// a server side copy of the chunk, so only what changes
+		// ever has to travel, it starts as blank as the memory
+		c->shm = 0;
+		xcb_create_pixmap(conn, depth, c->pixmap, win, w, h);
+		xcb_poly_fill_rectangle(conn, c->pixmap, c->gc, 1,
+				(const xcb_rectangle_t []) {{ 0, 0, w, h }});
+	}
+}
 
-		if (c->px == (void *) -1) {
-			shmctl(c->x.shm.id, IPC_RMID, NULL);
-			die("shmat failed");
-		}
+static Chunk *
+__chunk_new(xcb_connection_t *conn, xcb_window_t win, int w, int h,
+		bool shm, const ChunkMemory *prepared)
+{
+	Chunk *c;
 
-		xcb_shm_attach(conn, c->x.shm.seg, c->x.shm.id, 0);
-		shmctl(c->x.shm.id, IPC_RMID, NULL);
-		memset(c->px, 0, szpx);
+	assert(conn != NULL);
+	assert(w > 0);
+	assert(h > 0);
 
-		xcb_shm_create_pixmap(conn, c->x.shm.pixmap, win, w, h,
-				depth, c->x.shm.seg, 0);
-	} else {
-		c->shm = 0;
-		c->px = xcalloc(w * h, sizeof(uint32_t));
+	c = xcalloc_tagged(ALLOC_CHUNKS, 1, sizeof(Chunk));
+	c->width = w;
+	c->height = h;
 
-		c->x.image = xcb_image_create_native(conn, w, h,
-				XCB_IMAGE_FORMAT_Z_PIXMAP, depth, c->px,
-				szpx, (uint8_t *)(c->px));
-	}
+	__chunk_attach(conn, win, c, shm, prepared);
 
 	return c;
 }
@@ -186,232 +772,3972 @@ __chunk_get_rect(const Chunk *c, int *x, int *y, int *w, int *h)
 	*h = c->height;
 }
 
-static void
-__chunk_prepend(xcb_connection_t *conn, xcb_window_t win, Chunk *c, int width, int height)
-{
-	Chunk *first;
-	first = __chunk_first(c);
-	first->previous = __chunk_new(conn, win, width, height);
-	first->previous->next = first;
-	first->previous->index = first->index - 1;
-}
-
-static void
-__chunk_append(xcb_connection_t *conn, xcb_window_t win, Chunk *c, int width, int height)
+static inline bool
+__box_empty(const Box *b)
 {
-	Chunk *last;
-	last = __chunk_last(c);
-	last->next = __chunk_new(conn, win, width, height);
-	last->next->previous = last;
-	last->next->index = last->index + 1;
+	return b->x0 >= b->x1 || b->y0 >= b->y1;
 }
 
-static void
-__chunk_destroy(xcb_connection_t *conn, Chunk *chunk)
+static inline void
+__box_add(Box *b, int x, int y, int w, int h)
 {
-	xcb_free_gc(conn, chunk->gc);
-
-	if (chunk->shm) {
-		shmctl(chunk->x.shm.id, IPC_RMID, NULL);
-		xcb_shm_detach(conn, chunk->x.shm.seg);
-		shmdt(chunk->px);
-		xcb_free_pixmap(conn, chunk->x.shm.pixmap);
+	if (__box_empty(b)) {
+		b->x0 = x;
+		b->y0 = y;
+		b->x1 = x + w;
+		b->y1 = y + h;
 	} else {
-		xcb_image_destroy(chunk->x.image);
+		b->x0 = MIN(b->x0, x);
+		b->y0 = MIN(b->y0, y);
+		b->x1 = MAX(b->x1, x + w);
+		b->y1 = MAX(b->y1, y + h);
 	}
+}
 
-	free(chunk);
+static inline void
+__box_clear(Box *b)
+{
+	b->x0 = b->y0 = 0;
+	b->x1 = b->y1 = 0;
 }
 
-static void
-__pizarra_get_rect(const Pizarra *piz, int *x, int *y, int *w, int *h)
+static inline int64_t
+__floor_div(int64_t a, int64_t b)
 {
-	const Chunk *first, *last;
+	return a / b - (a % b != 0 && a < 0);
+}
 
-	first = __chunk_first(piz->root);
-	last = __chunk_last(piz->root);
+static inline int64_t
+__ceil_div(int64_t a, int64_t b)
+{
+	return -__floor_div(-a, b);
+}
 
-	*x = 0;
-	*y = first->index * piz->root->height;
-	*w = piz->root->width;
-	*h = (last->index - first->index + 1) * piz->root->height;
+/* canvas pixels per window pixel at a zoom level, in 16.16 fixed point */
+static int32_t
+__zoom_scale(int zoom, int steps)
+{
+	return lround(65536.0 * exp2((double)(zoom) / steps));
 }
 
+/* hands damage over to the renderer side of the chunk */
 static void
-__pizarra_get_viewport_rect(const Pizarra *piz, int *x, int *y, int *w, int *h)
+__chunk_mark_stale(Chunk *c, const Box *b)
 {
-	*x = piz->pos.x;
-	*y = piz->pos.y;
-	*w = piz->viewport_width;
-	*h = piz->viewport_height;
+	__box_add(&c->stale, b->x0, b->y0, b->x1 - b->x0, b->y1 - b->y0);
+	__box_add(&c->mip_dirty, b->x0, b->y0, b->x1 - b->x0, b->y1 - b->y0);
 }
 
 static void
-__pizarra_regenerate_chunks(Pizarra *piz)
+__chunk_mip_size(const Chunk *c, int level, int *w, int *h)
 {
-	int x, y, w, h;
-	int cx, cy, cw, ch;
-	bool done;
-
-regenerate:
-	done = true;
-	__pizarra_get_viewport_rect(piz, &x, &y, &w, &h);
-	__pizarra_get_rect(piz, &cx, &cy, &cw, &ch);
+	*w = __ceil_div(c->width, 1 << level);
+	*h = __ceil_div(c->height, 1 << level);
+}
 
-	if (y < cy) {
-		__chunk_prepend(piz->conn, piz->win, __chunk_first(piz->root),
-				piz->root->width, piz->root->height);
-		done = false;
-	}
+/* filters what changed down through every level of the pyramid, */
+/* each one from the one above it */
+static void
+__chunk_update_mips(Chunk *c)
+{
+	int level, sw, sh, dw, dh;
+	int x0, y0, x1, y1, y, n;
+	const uint32_t *src, *r0, *r1;
+	uint32_t *dst, edge0[2], edge1[2];
 
-	if (y + h > cy + ch) {
-		__chunk_append(piz->conn, piz->win, __chunk_last(piz->root),
-				piz->root->width, piz->root->height);
-		done = false;
+	if (NULL == c->mips[0]) {
+		for (level = 1; level <= ZINC_MIP_LEVELS; ++level) {
+			__chunk_mip_size(c, level, &dw, &dh);
+			c->mips[level-1] = xmalloc_tagged(ALLOC_CHUNKS,
+					dw * dh * sizeof(uint32_t));
+		}
+		__box_add(&c->mip_dirty, 0, 0, c->width, c->height);
 	}
 
-	if (!done)
-		goto regenerate;
-}
+	if (__box_empty(&c->mip_dirty))
+		return;
 
-static void
-__pizarra_keep_visible(Pizarra *piz)
-{
-	if (piz->pos.x > piz->root->width)
-		piz->pos.x = piz->root->width;
+	src = c->px;
+	sw = c->width;
+	sh = c->height;
 
-	if (piz->pos.x < -piz->viewport_width)
-		piz->pos.x = -piz->viewport_width;
-}
+	for (level = 1; level <= ZINC_MIP_LEVELS; ++level) {
+		dst = c->mips[level-1];
+		__chunk_mip_size(c, level, &dw, &dh);
 
-static inline uint32_t *
-__pizarra_get_pixel_ptr(Pizarra *piz, int x, int y)
-{
-	int chunkx, chunky;
-	Chunk *chunk;
+		x0 = c->mip_dirty.x0 >> level;
+		y0 = c->mip_dirty.y0 >> level;
+		x1 = MIN(__ceil_div(c->mip_dirty.x1, 1 << level), dw);
+		y1 = MIN(__ceil_div(c->mip_dirty.y1, 1 << level), dh);
 
-	x += piz->pos.x;
-	y += piz->pos.y;
+		for (y = y0; y < y1; ++y) {
+			r0 = &src[2*y*sw];
+			r1 = &src[MIN(2*y+1, sh-1)*sw];
+			n = MIN(x1, sw / 2) - x0;
 
-	for (chunk = __chunk_first(piz->root); chunk; chunk = chunk->next) {
-		chunkx = 0;
-		chunky = chunk->index * chunk->height;
+			if (n > 0)
+				pixel_downsample_2x2(&dst[y*dw+x0], &r0[2*x0], &r1[2*x0], n);
 
-		if (x >= chunkx && x < chunkx + chunk->width
-				&& y >= chunky && y < chunky + chunk->height) {
-			return &chunk->px[(y-chunky)*chunk->width+(x-chunkx)];
+			// an odd width leaves the last column on its own
+			if (x1 > sw / 2) {
+				edge0[0] = edge0[1] = r0[sw-1];
+				edge1[0] = edge1[1] = r1[sw-1];
+				pixel_downsample_2x2(&dst[y*dw+dw-1], edge0, edge1, 1);
+			}
 		}
+
+		src = dst;
+		sw = dw;
+		sh = dh;
 	}
 
-	return NULL;
+	__box_clear(&c->mip_dirty);
 }
 
-extern Pizarra *
-pizarra_new(xcb_connection_t *conn, xcb_window_t win)
+#ifdef ZINC_USE_LAYERS
+static inline int
+__chunk_tiles_x(const Chunk *c)
 {
-	Pizarra *piz;
-	xcb_screen_t *scr;
-	int width, height;
-
-	assert(conn != NULL);
+	return __ceil_div(c->width, ZINC_LAYER_TILE);
+}
+
+static inline int
+__chunk_tiles(const Chunk *c)
+{
+	return __chunk_tiles_x(c) * __ceil_div(c->height, ZINC_LAYER_TILE);
+}
+
+static LayerTile *
+__layer_tile_ref(LayerTile *tile)
+{
+	if (NULL != tile)
+		atomic_fetch_add(&tile->refs, 1);
+	return tile;
+}
+
+static void
+__layer_tile_unref(LayerTile *tile)
+{
+	if (NULL != tile && 1 == atomic_fetch_sub(&tile->refs, 1)) {
+		atomic_fetch_sub(&layer_tiles, 1);
+		xfree(tile);
+	}
+}
+
+/* the pixels of the tile in the slot, about to be written: blank */
+/* if there is none, a copy of it if it is shared */
+static uint32_t *
+__layer_tile_own(LayerTile **slot)
+{
+	LayerTile *tile;
+
+	if (NULL == *slot || atomic_load(&(*slot)->refs) > 1) {
+		tile = xcalloc_tagged(ALLOC_LAYERS, 1, sizeof(LayerTile));
+		atomic_init(&tile->refs, 1);
+		atomic_fetch_add(&layer_tiles, 1);
+		if (NULL != *slot)
+			memcpy(tile->px, (*slot)->px, sizeof(tile->px));
+		__layer_tile_unref(*slot);
+		*slot = tile;
+	}
+
+	return (*slot)->px;
+}
+
+/* slot of tile t of the layer, marked for composing again */
+static LayerTile **
+__chunk_layer_slot(Chunk *c, int layer, int t)
+{
+	if (NULL == c->tiles[layer])
+		c->tiles[layer] = xcalloc_tagged(ALLOC_LAYERS, __chunk_tiles(c), sizeof(LayerTile *));
+
+	if (NULL == c->recompose)
+		c->recompose = xcalloc_tagged(ALLOC_LAYERS, __chunk_tiles(c), sizeof(bool));
+
+	c->recompose[t] = true;
+	c->has_recompose = true;
+
+	return &c->tiles[layer][t];
+}
+
+/* tile t of the layer, about to be written */
+static uint32_t *
+__chunk_layer_tile(Chunk *c, int layer, int t)
+{
+	return __layer_tile_own(__chunk_layer_slot(c, layer, t));
+}
+
+/* pixel x, y (relative to the chunk) of the layer, which is */
+/* about to be written */
+static uint32_t *
+__chunk_layer_pixel(Chunk *c, int layer, int x, int y)
+{
+	uint32_t *tile;
+
+	tile = __chunk_layer_tile(c, layer, (y / ZINC_LAYER_TILE)
+			* __chunk_tiles_x(c) + x / ZINC_LAYER_TILE);
+
+	return &tile[(y % ZINC_LAYER_TILE) * ZINC_LAYER_TILE + x % ZINC_LAYER_TILE];
+}
+
+static void
+__chunk_layer_span(Chunk *c, int layer, int y, int x0, int x1, uint32_t color)
+{
+	int i, x, end;
+	uint32_t *tile;
+
+	for (x = x0; x < x1; x = end) {
+		end = MIN(x1, (x / ZINC_LAYER_TILE + 1) * ZINC_LAYER_TILE);
+		tile = __chunk_layer_tile(c, layer, (y / ZINC_LAYER_TILE)
+				* __chunk_tiles_x(c) + x / ZINC_LAYER_TILE);
+		tile = &tile[(y % ZINC_LAYER_TILE) * ZINC_LAYER_TILE];
+		for (i = x; i < end; ++i)
+			tile[i % ZINC_LAYER_TILE] = 0xff000000 | color;
+	}
+}
+
+/* blends premultiplied ARGB pixels over [x0, x1) of row y of the */
+/* layer, src starting at x0 */
+static void
+__chunk_layer_blend_span(Chunk *c, int layer, int y, int x0, int x1, const uint32_t *src)
+{
+	int x, end;
+	uint32_t *tile;
+
+	for (x = x0; x < x1; x = end) {
+		end = MIN(x1, (x / ZINC_LAYER_TILE + 1) * ZINC_LAYER_TILE);
+		tile = __chunk_layer_tile(c, layer, (y / ZINC_LAYER_TILE)
+				* __chunk_tiles_x(c) + x / ZINC_LAYER_TILE);
+		pixel_blend_over(&tile[(y % ZINC_LAYER_TILE) * ZINC_LAYER_TILE
+				+ x % ZINC_LAYER_TILE], &src[x - x0], end - x);
+	}
+}
+
+/* n pixels of row y (relative to the chunk) of the layer from x */
+/* on, blank where it was never drawn on */
+static void
+__chunk_layer_read(const Chunk *c, int layer, int y, int x, uint32_t *dst, int n)
+{
+	int i, end;
+	const LayerTile *tile;
+
+	for (i = x; i < x + n; i = end) {
+		end = MIN(x + n, (i / ZINC_LAYER_TILE + 1) * ZINC_LAYER_TILE);
+		tile = NULL == c->tiles[layer] ? NULL : c->tiles[layer][(y / ZINC_LAYER_TILE)
+				* __chunk_tiles_x(c) + i / ZINC_LAYER_TILE];
+		if (NULL == tile)
+			memset(&dst[i - x], 0, (end - i) * sizeof(uint32_t));
+		else
+			memcpy(&dst[i - x], &tile->px[(y % ZINC_LAYER_TILE) * ZINC_LAYER_TILE
+					+ i % ZINC_LAYER_TILE], (end - i) * sizeof(uint32_t));
+	}
+}
+
+/* rectangle of tile t, relative to the chunk */
+static Box
+__chunk_layer_tile_box(const Chunk *c, int t)
+{
+	Box b;
+
+	b.x0 = (t % __chunk_tiles_x(c)) * ZINC_LAYER_TILE;
+	b.y0 = (t / __chunk_tiles_x(c)) * ZINC_LAYER_TILE;
+	b.x1 = MIN(b.x0 + ZINC_LAYER_TILE, c->width);
+	b.y1 = MIN(b.y0 + ZINC_LAYER_TILE, c->height);
+
+	return b;
+}
+
+/* marks for composing again every tile the layer has */
+static void
+__chunk_layer_touch(Chunk *c, int layer)
+{
+	int t;
+
+	if (NULL == c->tiles[layer])
+		return;
+
+	for (t = 0; t < __chunk_tiles(c); ++t) {
+		if (NULL != c->tiles[layer][t]) {
+			c->recompose[t] = true;
+			c->has_recompose = true;
+		}
+	}
+}
+
+/* marks for composing again the tiles within the box */
+static void
+__chunk_layer_mark(Chunk *c, const Box *b)
+{
+	int tx, ty;
+
+	if (__box_empty(b))
+		return;
+
+	if (NULL == c->recompose)
+		c->recompose = xcalloc_tagged(ALLOC_LAYERS, __chunk_tiles(c), sizeof(bool));
+
+	for (ty = b->y0 / ZINC_LAYER_TILE; ty <= (b->y1 - 1) / ZINC_LAYER_TILE; ++ty)
+		for (tx = b->x0 / ZINC_LAYER_TILE; tx <= (b->x1 - 1) / ZINC_LAYER_TILE; ++tx)
+			c->recompose[ty * __chunk_tiles_x(c) + tx] = true;
+
+	c->has_recompose = true;
+}
+
+static void
+__chunk_layers_free(Chunk *c)
+{
+	int layer, t;
+
+	for (layer = 0; layer < ZINC_LAYERS; ++layer) {
+		if (NULL == c->tiles[layer])
+			continue;
+		for (t = 0; t < __chunk_tiles(c); ++t)
+			__layer_tile_unref(c->tiles[layer][t]);
+		xfree(c->tiles[layer]);
+		c->tiles[layer] = NULL;
+	}
+
+	xfree(c->recompose);
+	c->recompose = NULL;
+	c->has_recompose = false;
+}
+#endif
+
+static void
+__chunk_prepend(Chunk *c, Chunk *new)
+{
+	Chunk *first;
+	first = __chunk_first(c);
+	new->next = first;
+	new->index = first->index - 1;
+	first->previous = new;
+}
+
+static void
+__chunk_append(Chunk *c, Chunk *new)
+{
+	Chunk *last;
+	last = __chunk_last(c);
+	new->previous = last;
+	new->index = last->index + 1;
+	last->next = new;
+}
+
+/* gives back everything but the place of the chunk in the list */
+static void
+__chunk_detach(xcb_connection_t *conn, Chunk *chunk)
+{
+	int level;
+
+	for (level = 0; level < ZINC_MIP_LEVELS; ++level) {
+		xfree(chunk->mips[level]);
+		chunk->mips[level] = NULL;
+	}
+
+#ifdef ZINC_USE_XRENDER
+	if (0 != chunk->picture)
+		xcb_render_free_picture(conn, chunk->picture);
+	chunk->picture = 0;
+#endif
+
+	xcb_free_gc(conn, chunk->gc);
+
+	xcb_free_pixmap(conn, chunk->pixmap);
+
+	if (chunk->shm) {
+		shmctl(chunk->x.id, IPC_RMID, NULL);
+		xcb_shm_detach(conn, chunk->x.seg);
+		shmdt(chunk->px);
+		alloc_note(ALLOC_SHM, -(long)(chunk->width * chunk->height
+					* sizeof(uint32_t)));
+	} else {
+		xfree(chunk->px);
+	}
+
+#ifdef ZINC_USE_LAYERS
+	__chunk_layers_free(chunk);
+#endif
+
+	chunk->px = NULL;
+	__box_clear(&chunk->damage);
+	__box_clear(&chunk->stale);
+	__box_clear(&chunk->mip_dirty);
+}
+
+/* drops what the frozen chunk held, it is left blank */
+static void
+__chunk_cold_free(Chunk *c)
+{
+	int plane;
+
+	for (plane = 0; plane < ZINC_PLANES; ++plane) {
+		xfree(c->cold[plane]);
+		c->cold[plane] = NULL;
+		c->cold_size[plane] = 0;
+	}
+}
+
+static void
+__chunk_destroy(xcb_connection_t *conn, Chunk *chunk)
+{
+	if (NULL != chunk->px)
+		__chunk_detach(conn, chunk);
+
+	__chunk_cold_free(chunk);
+
+	xfree(chunk);
+}
+
+static void
+__pizarra_get_rect(const Pizarra *piz, int *x, int *y, int *w, int *h)
+{
+	const Chunk *first, *last;
+
+	first = __chunk_first(piz->root);
+	last = __chunk_last(piz->root);
+
+	*x = 0;
+	*y = first->index * piz->root->height;
+	*w = piz->root->width;
+	*h = (last->index - first->index + 1) * piz->root->height;
+}
+
+static void
+__pizarra_get_viewport_rect(const Pizarra *piz, int *x, int *y, int *w, int *h)
+{
+	*x = piz->pos.x;
+	*y = piz->pos.y;
+	*w = piz->viewport_width;
+	*h = piz->viewport_height;
+}
+
+static void
+__pizarra_get_view_rect(const Pizarra *piz, int *x, int *y, int *w, int *h)
+{
+	*x = piz->view.pos.x;
+	*y = piz->view.pos.y;
+	*w = __ceil_div((int64_t)(piz->view.width) * piz->view.scale, 65536);
+	*h = __ceil_div((int64_t)(piz->view.height) * piz->view.scale, 65536);
+}
+
+#ifndef ZINC_NO_PREFETCH
+static void *
+__prefetch_worker(void *arg)
+{
+	Prefetcher *pf;
+	ChunkMemory mem;
+	PrefetchDirection dir;
+
+	pf = arg;
+	pthread_mutex_lock(&pf->lock);
+
+	for (;;) {
+		if (pf->quit)
+			break;
+
+		if (pf->wanted[PREFETCH_UP] && !pf->ready[PREFETCH_UP])
+			dir = PREFETCH_UP;
+		else if (pf->wanted[PREFETCH_DOWN] && !pf->ready[PREFETCH_DOWN])
+			dir = PREFETCH_DOWN;
+		else {
+			pthread_cond_wait(&pf->cond, &pf->lock);
+			continue;
+		}
+
+		pf->wanted[dir] = false;
+
+		// the expensive part (shmget, page faults) happens
+		// without holding the lock
+		pthread_mutex_unlock(&pf->lock);
+		__chunk_memory_alloc(&mem, pf->shm, pf->size);
+		pthread_mutex_lock(&pf->lock);
+
+		pf->mem[dir] = mem;
+		pf->ready[dir] = true;
+	}
+
+	pthread_mutex_unlock(&pf->lock);
+	return NULL;
+}
+
+static void
+__prefetch_init(Prefetcher *pf, bool shm, size_t size)
+{
+	pf->quit = false;
+	pf->shm = shm;
+	pf->size = size;
+	pf->wanted[PREFETCH_UP] = pf->wanted[PREFETCH_DOWN] = false;
+	pf->ready[PREFETCH_UP] = pf->ready[PREFETCH_DOWN] = false;
+
+	pthread_mutex_init(&pf->lock, NULL);
+	pthread_cond_init(&pf->cond, NULL);
+
+	if (pthread_create(&pf->thread, NULL, __prefetch_worker, pf) != 0)
+		die("can't create prefetch thread");
+}
+
+static void
+__prefetch_request(Prefetcher *pf, PrefetchDirection dir)
+{
+	pthread_mutex_lock(&pf->lock);
+	if (!pf->ready[dir] && !pf->wanted[dir]) {
+		pf->wanted[dir] = true;
+		pthread_cond_signal(&pf->cond);
+	}
+	pthread_mutex_unlock(&pf->lock);
+}
+
+static bool
+__prefetch_take(Prefetcher *pf, PrefetchDirection dir, ChunkMemory *mem)
+{
+	bool ready;
+
+	pthread_mutex_lock(&pf->lock);
+	if ((ready = pf->ready[dir])) {
+		*mem = pf->mem[dir];
+		pf->ready[dir] = false;
+	}
+	pthread_mutex_unlock(&pf->lock);
+
+	return ready;
+}
+
+static void
+__prefetch_destroy(Prefetcher *pf)
+{
+	int dir;
+
+	pthread_mutex_lock(&pf->lock);
+	pf->quit = true;
+	pthread_cond_signal(&pf->cond);
+	pthread_mutex_unlock(&pf->lock);
+
+	pthread_join(pf->thread, NULL);
+
+	for (dir = PREFETCH_UP; dir <= PREFETCH_DOWN; ++dir)
+		if (pf->ready[dir])
+			__chunk_memory_free(&pf->mem[dir], pf->shm, pf->size);
+
+	pthread_cond_destroy(&pf->cond);
+	pthread_mutex_destroy(&pf->lock);
+}
+
+static void
+__pizarra_prefetch(Pizarra *piz)
+{
+	int x, y, w, h;
+	int cx, cy, cw, ch;
+	float ahead;
+
+	__pizarra_get_viewport_rect(piz, &x, &y, &w, &h);
+	__pizarra_get_rect(piz, &cx, &cy, &cw, &ch);
+
+	// the next chunk is needed once the camera gets within
+	// a few frames worth of scrolling of the canvas edge
+	ahead = (piz->velocity < 0 ? -piz->velocity : piz->velocity)
+		* ZINC_PREFETCH_FRAMES;
+
+	if (piz->velocity < 0 && y - cy < ahead + piz->root->height)
+		__prefetch_request(&piz->prefetch, PREFETCH_UP);
+
+	if (piz->velocity > 0 && (cy + ch) - (y + h) < ahead + piz->root->height)
+		__prefetch_request(&piz->prefetch, PREFETCH_DOWN);
+}
+#endif
+
+static void
+__pizarra_lock_chunks(Pizarra *piz)
+{
+#ifdef ZINC_USE_RENDER_THREAD
+	pthread_mutex_lock(&piz->renderer.chunks_lock);
+#else
+	(void) piz;
+#endif
+}
+
+static void
+__pizarra_unlock_chunks(Pizarra *piz)
+{
+#ifdef ZINC_USE_RENDER_THREAD
+	pthread_mutex_unlock(&piz->renderer.chunks_lock);
+#else
+	(void) piz;
+#endif
+}
+
+static void
+__pizarra_regenerate_chunks(Pizarra *piz)
+{
+	int x, y, w, h;
+	int cx, cy, cw, ch;
+	bool done;
+	Chunk *new;
+	ChunkMemory *prepared;
+#ifndef ZINC_NO_PREFETCH
+	ChunkMemory mem;
+#endif
+
+	// the overview does not grow the canvas, what lies past
+	// either end of it is shown blank
+	if (piz->zoom > 0)
+		return;
+
+regenerate:
+	done = true;
+	__pizarra_get_viewport_rect(piz, &x, &y, &w, &h);
+	__pizarra_get_rect(piz, &cx, &cy, &cw, &ch);
+
+	if (y < cy) {
+		prepared = NULL;
+#ifndef ZINC_NO_PREFETCH
+		if (__prefetch_take(&piz->prefetch, PREFETCH_UP, &mem))
+			prepared = &mem;
+#endif
+		new = __chunk_new(piz->conn, piz->win, piz->root->width,
+				piz->root->height, piz->shm, prepared);
+		__pizarra_lock_chunks(piz);
+		__chunk_prepend(piz->root, new);
+		__pizarra_unlock_chunks(piz);
+		done = false;
+	}
+
+	if (y + h > cy + ch) {
+		prepared = NULL;
+#ifndef ZINC_NO_PREFETCH
+		if (__prefetch_take(&piz->prefetch, PREFETCH_DOWN, &mem))
+			prepared = &mem;
+#endif
+		new = __chunk_new(piz->conn, piz->win, piz->root->width,
+				piz->root->height, piz->shm, prepared);
+		__pizarra_lock_chunks(piz);
+		__chunk_append(piz->root, new);
+		__pizarra_unlock_chunks(piz);
+		done = false;
+	}
+
+	if (!done)
+		goto regenerate;
+
+#ifndef ZINC_NO_PREFETCH
+	__pizarra_prefetch(piz);
+#endif
+}
+
+static void
+__pizarra_keep_visible(Pizarra *piz)
+{
+	int width;
+
+	width = __floor_div((int64_t)(piz->viewport_width)
+			* __zoom_scale(piz->zoom, piz->zoom_steps), 65536);
+
+	if (piz->pos.x > piz->root->width)
+		piz->pos.x = piz->root->width;
+
+	if (piz->pos.x < -width)
+		piz->pos.x = -width;
+}
+
+static void
+__pizarra_thaw(Pizarra *piz, Chunk *c);
+
+/* the chunk, thawed first if it was frozen, NULL if it was evicted */
+static Chunk *
+__pizarra_resident(Pizarra *piz, Chunk *c)
+{
+	if (c->frozen)
+		__pizarra_thaw(piz, c);
+
+	return NULL != c->px ? c : NULL;
+}
+
+static inline Chunk *
+__pizarra_get_chunk_at(Pizarra *piz, int x, int y)
+{
+	Chunk *chunk;
+
+	if (x < 0 || x >= piz->root->width)
+		return NULL;
+
+	if (piz->clipping && (x < piz->clip.x0 || x >= piz->clip.x1
+				|| y < piz->clip.y0 || y >= piz->clip.y1))
+		return NULL;
+
+	for (chunk = __chunk_first(piz->root); chunk; chunk = chunk->next)
+		if (y >= chunk->index * chunk->height
+				&& y < (chunk->index + 1) * chunk->height)
+			return __pizarra_resident(piz, chunk);
+
+	return NULL;
+}
+
+/* the chunk holding canvas row y, NULL when there is none or it */
+/* was evicted, thawed if it was frozen; the search starts from, */
+/* and moves, the hint */
+static Chunk *
+__pizarra_chunk_of_row(Pizarra *piz, Chunk **hint, int y)
+{
+	Chunk *c;
+
+	c = NULL != *hint ? *hint : piz->root;
+
+	while (NULL != c && y < c->index * c->height)
+		c = c->previous;
+
+	while (NULL != c && y >= (c->index + 1) * c->height)
+		c = c->next;
+
+	if (NULL == c)
+		return NULL;
+
+	*hint = c;
+
+	return __pizarra_resident(piz, c);
+}
+
+static inline uint32_t *
+__overlay_pixel(Overlay *ov, int x, int y)
+{
+	return &ov->px[(y - ov->area.y0) * (ov->area.x1 - ov->area.x0) + x - ov->area.x0];
+}
+
+#ifndef ZINC_USE_LAYERS
+static inline uint32_t *
+__overlay_under(Overlay *ov, int x, int y)
+{
+	return &ov->under[(y - ov->area.y0) * (ov->area.x1 - ov->area.x0) + x - ov->area.x0];
+}
+
+/* copies the canvas within [x0, x1) of the rows of the box under */
+/* the overlay */
+static void
+__overlay_save_under(Pizarra *piz, const Box *b)
+{
+	int row;
+	Overlay *ov;
+	Chunk *hint, *c;
+
+	ov = &piz->overlay;
+	hint = NULL;
+
+	for (row = b->y0; row < b->y1; ++row) {
+		if (NULL == (c = __pizarra_chunk_of_row(piz, &hint, row)))
+			memset(__overlay_under(ov, b->x0, row), 0, (b->x1 - b->x0) * sizeof(uint32_t));
+		else
+			memcpy(__overlay_under(ov, b->x0, row), &c->px[(row - c->index
+						* c->height) * c->width + b->x0],
+					(b->x1 - b->x0) * sizeof(uint32_t));
+	}
+}
+#endif
+
+/* makes room in the overlay for the rectangle */
+static void
+__overlay_grow(Pizarra *piz, int x, int y, int w, int h)
+{
+	int row, ow;
+	Box area;
+	Overlay *ov, old;
+
+	ov = &piz->overlay;
+
+	if (!__box_empty(&ov->area) && x >= ov->area.x0 && y >= ov->area.y0
+			&& x + w <= ov->area.x1 && y + h <= ov->area.y1)
+		return;
+
+	area = ov->area;
+	__box_add(&area, x - ZINC_OVERLAY_MARGIN, y - ZINC_OVERLAY_MARGIN,
+			w + 2 * ZINC_OVERLAY_MARGIN, h + 2 * ZINC_OVERLAY_MARGIN);
+	area.x0 = MAX(area.x0, 0);
+	area.x1 = MIN(area.x1, piz->root->width);
+
+	old = *ov;
+	ow = old.area.x1 - old.area.x0;
+	ov->area = area;
+	ov->px = xcalloc_tagged(ALLOC_OVERLAY, (area.x1 - area.x0) * (area.y1 - area.y0),
+			sizeof(uint32_t));
+
+#ifndef ZINC_USE_LAYERS
+	ov->under = xmalloc_tagged(ALLOC_OVERLAY, (area.x1 - area.x0)
+			* (area.y1 - area.y0) * sizeof(uint32_t));
+	__overlay_save_under(piz, &area);
+#endif
+
+	// what was there keeps its place on the canvas, the canvas
+	// under it is only known from before it was drawn on
+	for (row = old.area.y0; row < old.area.y1; ++row) {
+		memcpy(__overlay_pixel(ov, old.area.x0, row),
+				__overlay_pixel(&old, old.area.x0, row), ow * sizeof(uint32_t));
+#ifndef ZINC_USE_LAYERS
+		memcpy(__overlay_under(ov, old.area.x0, row),
+				__overlay_under(&old, old.area.x0, row), ow * sizeof(uint32_t));
+#endif
+	}
+
+	xfree(old.px);
+#ifndef ZINC_USE_LAYERS
+	xfree(old.under);
+#endif
+}
+
+/* blends n premultiplied ARGB pixels over the overlay, from x, y */
+/* on, keeping what was under them while it is marked */
+static void
+__overlay_blend_span(Pizarra *piz, int x, int y, const uint32_t *src, int n)
+{
+	int i;
+	Overlay *ov;
+
+	ov = &piz->overlay;
+
+	if (ov->clipped) {
+		if (y < ov->clip.y0 || y >= ov->clip.y1)
+			return;
+		i = MAX(x, ov->clip.x0) - x;
+		n = MIN(x + n, ov->clip.x1) - x - i;
+		if (n <= 0)
+			return;
+		x += i;
+		src += i;
+	}
+
+	__overlay_grow(piz, x, y, n, 1);
+
+	if (ov->marked) {
+		if (ov->ntraces + n > ov->captraces) {
+			ov->captraces = MAX(ov->captraces * 2, MAX(ov->ntraces + n, 1024));
+			ov->traces = xrealloc_tagged(ALLOC_OVERLAY, ov->traces,
+					ov->captraces * sizeof(OverlayTrace));
+		}
+		for (i = 0; i < n; ++i)
+			ov->traces[ov->ntraces++] = (OverlayTrace) { x + i, y,
+				*__overlay_pixel(ov, x + i, y) };
+	}
+
+	pixel_blend_over(__overlay_pixel(ov, x, y), src, n);
+	__box_add(&ov->drawn, x, y, n, 1);
+	__box_add(&ov->dirty, x, y, n, 1);
+}
+
+static void
+__overlay_blend(Pizarra *piz, int x, int y, uint32_t src)
+{
+	__overlay_blend_span(piz, x, y, &src, 1);
+}
+
+/* shows the canvas with the overlay over it where it changed */
+static void
+__overlay_compose(Pizarra *piz, const Box *b)
+{
+	int row, x0, x1;
+	Chunk *hint, *c;
+#ifndef ZINC_USE_LAYERS
+	int i;
+	uint32_t *dst;
+	Overlay *ov;
+
+	ov = &piz->overlay;
+#endif
+
+	hint = NULL;
+	x0 = b->x0;
+	x1 = b->x1;
+
+	for (row = b->y0; row < b->y1; ++row) {
+		if (NULL == (c = __pizarra_chunk_of_row(piz, &hint, row)))
+			continue;
+#ifdef ZINC_USE_LAYERS
+		// the layers above the one drawn on still go over it
+		__chunk_layer_mark(c, &(const Box) { x0, row - c->index * c->height,
+				x1, row - c->index * c->height + 1 });
+#else
+		dst = &c->px[(row - c->index * c->height) * c->width + x0];
+		memcpy(dst, __overlay_under(ov, x0, row), (x1 - x0) * sizeof(uint32_t));
+		pixel_blend_over(dst, __overlay_pixel(ov, x0, row), x1 - x0);
+		for (i = 0; i < x1 - x0; ++i)
+			dst[i] &= 0xffffff;
+		__box_add(&c->damage, x0, row - c->index * c->height, x1 - x0, 1);
+#endif
+	}
+}
+
+static void
+__overlay_end(Pizarra *piz)
+{
+	Overlay *ov;
+
+	ov = &piz->overlay;
+
+	xfree(ov->px);
+#ifndef ZINC_USE_LAYERS
+	xfree(ov->under);
+	ov->under = NULL;
+#endif
+	xfree(ov->traces);
+	ov->traces = NULL;
+	ov->ntraces = ov->captraces = 0;
+	ov->marked = false;
+	ov->clipped = false;
+	ov->px = NULL;
+	ov->active = false;
+	__box_clear(&ov->area);
+	__box_clear(&ov->drawn);
+	__box_clear(&ov->dirty);
+}
+
+static void
+__pizarra_update_residency(Pizarra *piz);
+
+/* adds chunks to either end of the canvas until it takes in row */
+/* y, with a loader they stay evicted unless near the camera */
+static void
+__pizarra_grow_to(Pizarra *piz, int y)
+{
+	int cx, cy, cw, ch;
+	Chunk *new;
+
+	for (;;) {
+		__pizarra_get_rect(piz, &cx, &cy, &cw, &ch);
+
+		if (y >= cy && y < cy + ch)
+			break;
+
+		if (NULL != piz->loader) {
+			new = xcalloc_tagged(ALLOC_CHUNKS, 1, sizeof(Chunk));
+			new->width = piz->root->width;
+			new->height = piz->root->height;
+		} else {
+			new = __chunk_new(piz->conn, piz->win, piz->root->width,
+					piz->root->height, piz->shm, NULL);
+		}
+
+		__pizarra_lock_chunks(piz);
+		if (y < cy)
+			__chunk_prepend(piz->root, new);
+		else
+			__chunk_append(piz->root, new);
+		__pizarra_unlock_chunks(piz);
+
+		__pizarra_update_residency(piz);
+	}
+}
+
+/* has the loader draw the chunk content, which starts blank */
+static void
+__pizarra_load_chunk(Pizarra *piz, Chunk *chunk)
+{
+	int cx, cy, cw, ch;
+#ifndef ZINC_USE_LAYERS
+	Box b;
+#endif
+
+	__chunk_get_rect(chunk, &cx, &cy, &cw, &ch);
+
+	piz->clipping = true;
+	piz->clip = (Box) { cx, cy, cx + cw, cy + ch };
+	piz->loader(piz, cx, cy, cw, ch, piz->loader_data);
+	piz->clipping = false;
+
+#ifndef ZINC_USE_LAYERS
+	// a stroke going on over the chunk goes back over what the
+	// loader drew
+	b.x0 = piz->overlay.area.x0;
+	b.x1 = piz->overlay.area.x1;
+	b.y0 = MAX(piz->overlay.area.y0, cy);
+	b.y1 = MIN(piz->overlay.area.y1, cy + ch);
+
+	if (piz->overlay.active && !__box_empty(&b)) {
+		__overlay_save_under(piz, &b);
+		__overlay_compose(piz, &b);
+	}
+#endif
+
+	__box_add(&chunk->damage, 0, 0, cw, ch);
+	piz->reloads++;
+}
+
+/* gives the evicted chunk its memory back and has it drawn */
+static void
+__pizarra_bring_in(Pizarra *piz, Chunk *chunk)
+{
+	ChunkMemory mem;
+
+	// the page faults are taken before the renderer is held up
+	__chunk_memory_alloc(&mem, piz->shm, chunk->width
+			* chunk->height * sizeof(uint32_t));
+	__pizarra_lock_chunks(piz);
+	__chunk_attach(piz->conn, piz->win, chunk, piz->shm, &mem);
+	__pizarra_unlock_chunks(piz);
+	__pizarra_load_chunk(piz, chunk);
+}
+
+/* packs what the chunk holds away and gives its memory back */
+static void
+__pizarra_freeze(Pizarra *piz, Chunk *c)
+{
+	int n;
+#ifdef ZINC_USE_LAYERS
+	int t, layer;
+	uint32_t *px;
+#else
+	int i;
+#endif
+
+#ifdef ZINC_USE_LAYERS
+	// each layer is packed as its tiles one after the other, those
+	// never drawn on as blank ones
+	n = __chunk_tiles(c) * ZINC_LAYER_TILE * ZINC_LAYER_TILE;
+	px = NULL;
+
+	for (layer = 0; layer < ZINC_LAYERS; ++layer) {
+		for (t = 0; NULL != c->tiles[layer] && t < __chunk_tiles(c); ++t)
+			if (NULL != c->tiles[layer][t])
+				break;
+
+		if (NULL == c->tiles[layer] || t == __chunk_tiles(c))
+			continue;
+
+		if (NULL == px)
+			px = xmalloc(n * sizeof(uint32_t));
+
+		for (t = 0; t < __chunk_tiles(c); ++t) {
+			if (NULL == c->tiles[layer][t])
+				memset(&px[t * ZINC_LAYER_TILE * ZINC_LAYER_TILE], 0,
+						sizeof(((LayerTile *)(NULL))->px));
+			else
+				memcpy(&px[t * ZINC_LAYER_TILE * ZINC_LAYER_TILE],
+						c->tiles[layer][t]->px, sizeof(c->tiles[layer][t]->px));
+		}
+
+		c->cold[layer] = pack_pixels(px, ZINC_LAYER_TILE, n, &c->cold_size[layer]);
+	}
+
+	free(px);
+#else
+	n = c->width * c->height;
+
+	for (i = 0; i < n && 0 == c->px[i]; ++i)
+		;
+
+	if (i < n)
+		c->cold[0] = pack_pixels(c->px, c->width, n, &c->cold_size[0]);
+#endif
+
+	__pizarra_lock_chunks(piz);
+	__chunk_detach(piz->conn, c);
+	__pizarra_unlock_chunks(piz);
+
+	c->frozen = true;
+	piz->freezes++;
+}
+
+/* gives the frozen chunk its memory back, with what it held */
+static void
+__pizarra_thaw(Pizarra *piz, Chunk *c)
+{
+	uint64_t elapsed;
+	ChunkMemory mem;
+#ifdef ZINC_USE_LAYERS
+	int i, n, t, layer;
+	uint32_t *px, *tile;
+#endif
+
+	elapsed = now_us();
+
+	__chunk_memory_alloc(&mem, piz->shm, c->width * c->height * sizeof(uint32_t));
+
+#ifndef ZINC_USE_LAYERS
+	if (NULL != c->cold[0])
+		unpack_pixels(c->cold[0], c->cold_size[0], mem.px, c->width,
+				c->width * c->height);
+#endif
+
+	__pizarra_lock_chunks(piz);
+	__chunk_attach(piz->conn, piz->win, c, piz->shm, &mem);
+	__pizarra_unlock_chunks(piz);
+
+#ifdef ZINC_USE_LAYERS
+	n = __chunk_tiles(c) * ZINC_LAYER_TILE * ZINC_LAYER_TILE;
+	px = NULL;
+
+	for (layer = 0; layer < ZINC_LAYERS; ++layer) {
+		if (NULL == c->cold[layer])
+			continue;
+
+		if (NULL == px)
+			px = xmalloc(n * sizeof(uint32_t));
+
+		unpack_pixels(c->cold[layer], c->cold_size[layer], px, ZINC_LAYER_TILE, n);
+
+		// only the tiles with something on them come back
+		for (t = 0; t < __chunk_tiles(c); ++t) {
+			tile = &px[t * ZINC_LAYER_TILE * ZINC_LAYER_TILE];
+			for (i = 0; i < ZINC_LAYER_TILE * ZINC_LAYER_TILE && 0 == tile[i]; ++i)
+				;
+			if (i < ZINC_LAYER_TILE * ZINC_LAYER_TILE)
+				memcpy(__chunk_layer_tile(c, layer, t), tile,
+						ZINC_LAYER_TILE * ZINC_LAYER_TILE * sizeof(uint32_t));
+		}
+	}
+
+	free(px);
+
+	// composed again with the layers shown now
+	__chunk_layer_mark(c, &(const Box) { 0, 0, c->width, c->height });
+#endif
+
+	__chunk_cold_free(c);
+	c->frozen = false;
+	c->seen = piz->clock;
+	__box_add(&c->damage, 0, 0, c->width, c->height);
+
+	elapsed = now_us() - elapsed;
+	piz->thaws++;
+	piz->thaw_time_total += elapsed;
+	piz->thaw_time_max = MAX(piz->thaw_time_max, elapsed);
+}
+
+/* bytes of pixels the chunks in memory take */
+static size_t
+__pizarra_resident_size(const Pizarra *piz)
+{
+	size_t size;
+	const Chunk *c;
+
+	for (size = 0, c = __chunk_first(piz->root); c; c = c->next)
+		if (NULL != c->px)
+			size += (size_t)(c->width) * c->height * sizeof(uint32_t);
+
+#ifdef ZINC_USE_LAYERS
+	size += atomic_load(&layer_tiles) * sizeof(LayerTile);
+#endif
+
+	return size;
+}
+
+/* frees the chunks out of view seen the longest ago, until the */
+/* pixels fit in the budget: frozen, or evicted with a loader, */
+/* which draws them again for less */
+static void
+__pizarra_enforce_budget(Pizarra *piz)
+{
+	Box *ov;
+	Chunk *c, *oldest;
+
+	if (0 == piz->budget)
+		return;
+
+	ov = &piz->overlay.area;
+
+	while (__pizarra_resident_size(piz) > piz->budget) {
+		for (oldest = NULL, c = __chunk_first(piz->root); c; c = c->next) {
+			// the overlay is composed over the chunks it is on
+			if (NULL == c->px || c->in_view || (piz->overlay.active
+						&& ov->y0 < (c->index + 1) * c->height
+						&& ov->y1 > c->index * c->height))
+				continue;
+			if (NULL == oldest || c->seen < oldest->seen)
+				oldest = c;
+		}
+
+		if (NULL == oldest)
+			break;
+
+		if (NULL != piz->loader) {
+			__pizarra_lock_chunks(piz);
+			__chunk_detach(piz->conn, oldest);
+			__pizarra_unlock_chunks(piz);
+			piz->evictions++;
+		} else {
+			__pizarra_freeze(piz, oldest);
+		}
+	}
+}
+
+/* thaws the chunks coming into view, and with a loader keeps in */
+/* memory only those near the camera, the rest are drawn again by */
+/* it when they come back into view; past the budget, those seen */
+/* the longest ago are freed too */
+static void
+__pizarra_update_residency(Pizarra *piz)
+{
+	int y, h, cy0, cy1, margin;
+	bool in_view;
+	Chunk *chunk;
+
+	y = piz->pos.y;
+	h = __ceil_div((int64_t)(piz->viewport_height)
+			* __zoom_scale(piz->zoom, piz->zoom_steps), 65536);
+	margin = ZINC_RESIDENT_MARGIN * piz->root->height;
+	piz->clock++;
+
+	for (chunk = __chunk_first(piz->root); chunk; chunk = chunk->next) {
+		cy0 = chunk->index * chunk->height;
+		cy1 = cy0 + chunk->height;
+		in_view = cy1 > y && cy0 < y + h;
+
+		if (in_view && !chunk->in_view) {
+			piz->visits++;
+			if (NULL != chunk->px)
+				piz->hits++;
+		}
+
+		chunk->in_view = in_view;
+
+		if (in_view)
+			chunk->seen = piz->clock;
+
+		if (chunk->frozen && in_view) {
+			__pizarra_thaw(piz, chunk);
+		} else if (NULL == piz->loader) {
+			continue;
+		} else if (NULL != chunk->px && (cy1 <= y - 2 * margin || cy0 >= y + h + 2 * margin)) {
+			__pizarra_lock_chunks(piz);
+			__chunk_detach(piz->conn, chunk);
+			__pizarra_unlock_chunks(piz);
+			piz->evictions++;
+		} else if (NULL == chunk->px && cy1 > y - margin && cy0 < y + h + margin) {
+			__pizarra_bring_in(piz, chunk);
+		}
+	}
+
+	__pizarra_enforce_budget(piz);
+}
+
+#ifdef ZINC_USE_LAYERS
+/* composes the visible layers into px wherever they changed, */
+/* the renderer only ever gets to see the result */
+static void
+__pizarra_recompose(Pizarra *piz, Chunk *c)
+{
+	int t, i, x0, y0, w, h, row, layer, ox0, ox1, cy;
+	uint32_t line[ZINC_LAYER_TILE], *dst;
+	Overlay *ov;
+
+	if (!c->has_recompose)
+		return;
+
+	ov = &piz->overlay;
+
+	for (t = 0; t < __chunk_tiles(c); ++t) {
+		if (!c->recompose[t])
+			continue;
+
+		x0 = (t % __chunk_tiles_x(c)) * ZINC_LAYER_TILE;
+		y0 = (t / __chunk_tiles_x(c)) * ZINC_LAYER_TILE;
+		w = MIN(ZINC_LAYER_TILE, c->width - x0);
+		h = MIN(ZINC_LAYER_TILE, c->height - y0);
+
+		for (row = 0; row < h; ++row) {
+			for (i = 0; i < w; ++i)
+				line[i] = 0xff000000;
+
+			cy = c->index * c->height + y0 + row;
+			ox0 = MAX(x0, ov->area.x0);
+			ox1 = MIN(x0 + w, ov->area.x1);
+
+			for (layer = 0; layer < ZINC_LAYERS; ++layer) {
+				if (!piz->layer_visible[layer])
+					continue;
+
+				if (NULL != c->tiles[layer] && NULL != c->tiles[layer][t])
+					pixel_blend_over(line, &c->tiles[layer][t]->px[row*ZINC_LAYER_TILE], w);
+
+				// the stroke being drawn goes right over the
+				// layer it is drawn on
+				if (layer == piz->layer && ov->active && ox0 < ox1
+						&& cy >= ov->area.y0 && cy < ov->area.y1)
+					pixel_blend_over(&line[ox0-x0], __overlay_pixel(ov, ox0, cy), ox1 - ox0);
+			}
+
+			dst = &c->px[(y0+row)*c->width+x0];
+			for (i = 0; i < w; ++i)
+				dst[i] = line[i] & 0xffffff;
+		}
+
+		__box_add(&c->damage, x0, y0, w, h);
+		c->recompose[t] = false;
+		piz->recomposed++;
+	}
+
+	c->has_recompose = false;
+}
+#endif
+
+static void
+__pizarra_put_chunk_rect(Pizarra *piz, Chunk *chunk, xcb_drawable_t dst,
+		int sx, int sy, int w, int h, int dx, int dy)
+{
+	xcb_copy_area(piz->conn, chunk->pixmap, dst,
+			chunk->gc, sx, sy, dx, dy, w, h);
+}
+
+/* waits for the server to be done reading the last frame */
+static void
+__overview_wait(Pizarra *piz)
+{
+	Overview *ov;
+	void *reply;
+	xcb_generic_error_t *error;
+
+	ov = &piz->overview;
+
+	if (!ov->busy)
+		return;
+
+	reply = xcb_wait_for_reply(piz->conn, ov->sequence, &error);
+	free(reply);
+	free(error);
+	ov->busy = false;
+}
+
+static void
+__overview_free(Pizarra *piz)
+{
+	Overview *ov;
+
+	ov = &piz->overview;
+
+	if (0 == ov->width)
+		return;
+
+	__overview_wait(piz);
+	xcb_free_pixmap(piz->conn, ov->pixmap);
+
+	if (ov->shm) {
+		xcb_shm_detach(piz->conn, ov->seg);
+		shmdt(ov->px);
+		alloc_note(ALLOC_SHM, -(long)(ov->width * ov->height
+					* sizeof(uint32_t)));
+	} else {
+		xfree(ov->px);
+	}
+
+	ov->width = ov->height = 0;
+}
+
+static void
+__overview_resize(Pizarra *piz)
+{
+	Overview *ov;
+	ChunkMemory mem;
+
+	ov = &piz->overview;
+
+	if (ov->width == piz->view.width && ov->height == piz->view.height)
+		return;
+
+	__overview_free(piz);
+	__chunk_memory_alloc(&mem, piz->shm, piz->view.width
+			* piz->view.height * sizeof(uint32_t));
+
+	ov->width = piz->view.width;
+	ov->height = piz->view.height;
+	ov->px = mem.px;
+	ov->shm = piz->shm;
+	ov->pixmap = xcb_generate_id(piz->conn);
+
+	if (ov->shm) {
+		ov->seg = xcb_generate_id(piz->conn);
+		xcb_shm_attach(piz->conn, ov->seg, mem.shmid, 0);
+		shmctl(mem.shmid, IPC_RMID, NULL);
+		xcb_shm_create_pixmap(piz->conn, ov->pixmap, piz->win, ov->width,
+				ov->height, piz->depth, ov->seg, 0);
+	} else {
+		xcb_create_pixmap(piz->conn, piz->depth, ov->pixmap, piz->win,
+				ov->width, ov->height);
+	}
+}
+
+/* paints a rectangle of the viewport (in window coordinates) */
+/* zoomed out, straight from the pyramids of the chunks, so it */
+/* takes as long whatever the height of the canvas */
+static void
+__overview_compose(Pizarra *piz, xcb_drawable_t dst, int x, int y, int w, int h)
+{
+	int i, row, cy, scale, stride;
+	int lo, hi, mx, my, mw, mh;
+	int nrows, perreq;
+	uint32_t *line, *base;
+	Overview *ov;
+	Chunk *chunk;
+
+	// without server side scaling every step is a halving
+	ov = &piz->overview;
+	scale = 1 << piz->view.zoom;
+
+	__overview_wait(piz);
+	__overview_resize(piz);
+
+	// columns of the window that fall within the canvas width,
+	// everything else is background
+	lo = MAX(x, __ceil_div(-piz->view.pos.x, scale));
+	hi = MIN(x + w, __ceil_div(piz->root->width - piz->view.pos.x, scale));
+	mx = __floor_div(piz->view.pos.x, scale) + lo;
+
+	// SHM frames are copied from where they are composed, the
+	// rest is packed to be sent
+	stride = ov->shm ? ov->width : w;
+	base = ov->shm ? &ov->px[y*ov->width+x] : ov->px;
+	chunk = __chunk_first(piz->root);
+
+	for (row = y; row < y + h; ++row) {
+		line = &base[(row-y)*stride];
+		cy = piz->view.pos.y + row * scale;
+
+		while (NULL != chunk && cy >= (chunk->index + 1) * chunk->height)
+			chunk = chunk->next;
+
+		for (i = x; i < MIN(lo, x + w); ++i)
+			line[i-x] = ZINC_BACKGROUND_COLOR;
+
+		for (i = MAX(hi, x); i < x + w; ++i)
+			line[i-x] = ZINC_BACKGROUND_COLOR;
+
+		if (lo >= hi)
+			continue;
+
+		if (NULL == chunk || cy < chunk->index * chunk->height
+				|| NULL == chunk->px) {
+			memset(&line[lo-x], 0, (hi - lo) * sizeof(uint32_t));
+			continue;
+		}
+
+		__chunk_update_mips(chunk);
+		__chunk_mip_size(chunk, piz->view.zoom, &mw, &mh);
+		my = MIN((cy - chunk->index * chunk->height) / scale, mh - 1);
+
+		memcpy(&line[lo-x], &chunk->mips[piz->view.zoom-1][my*mw+mx],
+				(hi - lo) * sizeof(uint32_t));
+	}
+
+	if (!ov->shm) {
+		perreq = MAX((piz->max_request - X_PUT_IMAGE_HEADER) / (w * sizeof(uint32_t)), 1);
+		for (row = 0; row < h; row += nrows) {
+			nrows = MIN(perreq, h - row);
+			xcb_put_image(piz->conn, XCB_IMAGE_FORMAT_Z_PIXMAP, ov->pixmap,
+					piz->bg_gc, w, nrows, x, y + row, 0, piz->depth,
+					nrows * w * sizeof(uint32_t), (const uint8_t *)(&ov->px[row*w]));
+		}
+	}
+
+	xcb_copy_area(piz->conn, ov->pixmap, dst, piz->bg_gc, x, y, x, y, w, h);
+
+	if (ov->shm) {
+		ov->busy = true;
+		ov->sequence = xcb_get_input_focus(piz->conn).sequence;
+	}
+}
+
+#ifdef ZINC_USE_XRENDER
+static void
+__xrender_init(Pizarra *piz)
+{
+	XRender *xr;
+	xcb_screen_t *scr;
+	xcb_generic_error_t *error;
+	const xcb_query_extension_reply_t *ext;
+	xcb_render_query_version_reply_t *version;
+	xcb_render_query_pict_formats_reply_t *formats;
+	xcb_render_pictscreen_iterator_t si;
+	xcb_render_pictdepth_iterator_t di;
+	xcb_render_pictvisual_iterator_t vi;
+
+	xr = &piz->xrender;
+	xr->enabled = false;
+
+	ext = xcb_get_extension_data(piz->conn, &xcb_render_id);
+
+	if (NULL == ext || !ext->present)
+		return;
+
+	// pad repeat, to keep the chunk edges from fading out when
+	// filtered, came with 0.10
+	version = xcb_render_query_version_reply(piz->conn,
+			xcb_render_query_version(piz->conn, 0, 11), &error);
+
+	if (NULL != error) {
+		free(error);
+		free(version);
+		return;
+	}
+
+	if (NULL == version)
+		return;
+
+	if (version->major_version == 0 && version->minor_version < 10) {
+		free(version);
+		return;
+	}
+
+	free(version);
+
+	formats = xcb_render_query_pict_formats_reply(piz->conn,
+			xcb_render_query_pict_formats(piz->conn), &error);
+
+	if (NULL != error) {
+		free(error);
+		free(formats);
+		return;
+	}
+
+	if (NULL == formats)
+		return;
+
+	// the chunk pixmaps share the depth and visual of the window
+	scr = xcb_setup_roots_iterator(xcb_get_setup(piz->conn)).data;
+
+	for (si = xcb_render_query_pict_formats_screens_iterator(formats);
+			si.rem && !xr->enabled; xcb_render_pictscreen_next(&si)) {
+		for (di = xcb_render_pictscreen_depths_iterator(si.data);
+				di.rem && !xr->enabled; xcb_render_pictdepth_next(&di)) {
+			for (vi = xcb_render_pictdepth_visuals_iterator(di.data);
+					vi.rem; xcb_render_pictvisual_next(&vi)) {
+				if (vi.data->visual == scr->root_visual) {
+					xr->format = vi.data->format;
+					xr->enabled = true;
+					break;
+				}
+			}
+		}
+	}
+
+	free(formats);
+
+	if (!xr->enabled)
+		return;
+
+	xr->window = xcb_generate_id(piz->conn);
+	xcb_render_create_picture(piz->conn, xr->window, piz->win, xr->format, 0, NULL);
+	piz->zoom_steps = ZINC_XRENDER_ZOOM_STEPS;
+}
+
+static xcb_render_picture_t
+__xrender_chunk_picture(Pizarra *piz, Chunk *chunk)
+{
+	if (0 != chunk->picture)
+		return chunk->picture;
+
+	chunk->picture = xcb_generate_id(piz->conn);
+	xcb_render_create_picture(piz->conn, chunk->picture, chunk->pixmap,
+			piz->xrender.format, XCB_RENDER_CP_REPEAT,
+			(const uint32_t []) { XCB_RENDER_REPEAT_PAD });
+	xcb_render_set_picture_filter(piz->conn, chunk->picture,
+			sizeof(ZINC_XRENDER_FILTER) - 1, ZINC_XRENDER_FILTER, 0, NULL);
+
+	return chunk->picture;
+}
+
+static void
+__xrender_fill(Pizarra *piz, xcb_render_picture_t pic, uint32_t color,
+		int x, int y, int w, int h)
+{
+	if (w <= 0 || h <= 0)
+		return;
+
+	xcb_render_fill_rectangles(piz->conn, XCB_RENDER_PICT_OP_SRC, pic,
+			(xcb_render_color_t) {
+				((color >> 16) & 0xff) * 0x101,
+				((color >> 8) & 0xff) * 0x101,
+				(color & 0xff) * 0x101, 0xffff
+			}, 1, (const xcb_rectangle_t []) {{ x, y, w, h }});
+}
+
+/* paints a rectangle of the viewport (in window coordinates) */
+/* zoomed out, scaled on the server from the chunk pixmaps, so */
+/* nothing is resampled or sent again as the camera moves */
+static void
+__xrender_compose(Pizarra *piz, xcb_drawable_t dst, int x, int y, int w, int h)
+{
+	int lo, hi, y0, y1;
+	int64_t scale;
+	xcb_render_picture_t pic;
+	Chunk *chunk;
+
+	scale = piz->view.scale;
+
+	if (dst == piz->win) {
+		pic = piz->xrender.window;
+	} else {
+		pic = xcb_generate_id(piz->conn);
+		xcb_render_create_picture(piz->conn, pic, dst, piz->xrender.format, 0, NULL);
+	}
+
+	// columns of the window that fall within the canvas width,
+	// everything else is background, and blank where there is
+	// no chunk yet
+	lo = MAX(x, __ceil_div((int64_t)(-piz->view.pos.x) * 65536, scale));
+	hi = MIN(x + w, __ceil_div((int64_t)(piz->root->width - piz->view.pos.x) * 65536, scale));
+
+	__xrender_fill(piz, pic, ZINC_BACKGROUND_COLOR, x, y, lo - x, h);
+	__xrender_fill(piz, pic, ZINC_BACKGROUND_COLOR, MAX(hi, x), y, x + w - MAX(hi, x), h);
+	__xrender_fill(piz, pic, 0, lo, y, hi - lo, h);
+
+	for (chunk = __chunk_first(piz->root); chunk && lo < hi; chunk = chunk->next) {
+		y0 = MAX(y, __ceil_div((int64_t)(chunk->index * chunk->height
+					- piz->view.pos.y) * 65536, scale));
+		y1 = MIN(y + h, __ceil_div((int64_t)((chunk->index + 1) * chunk->height
+					- piz->view.pos.y) * 65536, scale));
+
+		if (y0 >= y1 || NULL == chunk->px)
+			continue;
+
+		// the transform takes (lo, y0) on the window to where it
+		// is on the chunk, which keeps the translation small
+		// enough for 16.16 whatever the camera position
+		xcb_render_set_picture_transform(piz->conn,
+				__xrender_chunk_picture(piz, chunk), (xcb_render_transform_t) {
+					scale, 0, (int64_t)(piz->view.pos.x) * 65536 + scale * lo,
+					0, scale, (int64_t)(piz->view.pos.y - chunk->index
+						* chunk->height) * 65536 + scale * y0,
+					0, 0, 1 << 16
+				});
+
+		xcb_render_composite(piz->conn, XCB_RENDER_PICT_OP_SRC, chunk->picture,
+				XCB_RENDER_PICTURE_NONE, pic, 0, 0, 0, 0, lo, y0, hi - lo, y1 - y0);
+	}
+
+	if (pic != piz->xrender.window)
+		xcb_render_free_picture(piz->conn, pic);
+}
+#endif
+
+static void
+__zoomed_compose(Pizarra *piz, xcb_drawable_t dst, int x, int y, int w, int h)
+{
+	int nchunks;
+	uint64_t elapsed;
+	Overview *ov;
+	Chunk *chunk;
+
+	ov = &piz->overview;
+	elapsed = now_us();
+
+#ifdef ZINC_USE_XRENDER
+	if (piz->xrender.enabled)
+		__xrender_compose(piz, dst, x, y, w, h);
+	else
+#endif
+		__overview_compose(piz, dst, x, y, w, h);
+
+	for (nchunks = 0, chunk = __chunk_first(piz->root); chunk; chunk = chunk->next)
+		++nchunks;
+
+	elapsed = now_us() - elapsed;
+	ov->frames++;
+	ov->time_total += elapsed;
+	ov->time_max = MAX(ov->time_max, elapsed);
+	ov->chunks_max = MAX(ov->chunks_max, nchunks);
+}
+
+/* paints a rectangle of the viewport (in window coordinates) */
+/* from the chunk pixmaps into dst */
+static void
+__pizarra_compose_rect(Pizarra *piz, xcb_drawable_t dst, int x, int y, int w, int h)
+{
+	int cx, cy, cw, ch;
+	int ix0, iy0, ix1, iy1;
+	Chunk *chunk;
+
+	// clip to the viewport
+	ix0 = MAX(x, 0);
+	iy0 = MAX(y, 0);
+	ix1 = MIN(x + w, piz->view.width);
+	iy1 = MIN(y + h, piz->view.height);
+
+	if (ix0 >= ix1 || iy0 >= iy1)
+		return;
+
+	x = ix0; y = iy0; w = ix1 - ix0; h = iy1 - iy0;
+
+	if (piz->view.zoom > 0) {
+		__zoomed_compose(piz, dst, x, y, w, h);
+		return;
+	}
+
+	// the canvas has a fixed width, fill whatever is outside of it
+	// with the background
+	if (x < -piz->view.pos.x)
+		xcb_poly_fill_rectangle(piz->conn, dst, piz->bg_gc, 1,
+				(const xcb_rectangle_t []) {{
+					x, y, MIN(w, -piz->view.pos.x - x), h }});
+
+	if (x + w > piz->root->width - piz->view.pos.x)
+		xcb_poly_fill_rectangle(piz->conn, dst, piz->bg_gc, 1,
+				(const xcb_rectangle_t []) {{
+					MAX(x, piz->root->width - piz->view.pos.x), y,
+					x + w - MAX(x, piz->root->width - piz->view.pos.x), h }});
+
+	for (chunk = __chunk_first(piz->root); chunk; chunk = chunk->next) {
+		__chunk_get_rect(chunk, &cx, &cy, &cw, &ch);
+
+		// intersection in canvas coordinates
+		ix0 = MAX(x + piz->view.pos.x, cx);
+		iy0 = MAX(y + piz->view.pos.y, cy);
+		ix1 = MIN(x + w + piz->view.pos.x, cx + cw);
+		iy1 = MIN(y + h + piz->view.pos.y, cy + ch);
+
+		if (ix0 >= ix1 || iy0 >= iy1 || NULL == chunk->px)
+			continue;
+
+		__pizarra_put_chunk_rect(piz, chunk, dst, ix0 - cx, iy0 - cy,
+				ix1 - ix0, iy1 - iy0, ix0 - piz->view.pos.x, iy0 - piz->view.pos.y);
+	}
+}
+
+static void
+__pizarra_render_rect(Pizarra *piz, int x, int y, int w, int h)
+{
+	__pizarra_compose_rect(piz, piz->win, x, y, w, h);
+}
+
+/* same as above, with the rectangle in canvas coordinates */
+static void
+__pizarra_render_canvas_rect(Pizarra *piz, int x, int y, int w, int h)
+{
+	int x0, y0;
+	int64_t scale;
+
+	scale = piz->view.scale;
+	x0 = __floor_div((int64_t)(x - piz->view.pos.x) * 65536, scale);
+	y0 = __floor_div((int64_t)(y - piz->view.pos.y) * 65536, scale);
+
+	__pizarra_render_rect(piz, x0, y0,
+			__ceil_div((int64_t)(x + w - piz->view.pos.x) * 65536, scale) - x0,
+			__ceil_div((int64_t)(y + h - piz->view.pos.y) * 65536, scale) - y0);
+}
+
+static void
+__pizarra_upload_measure(Pizarra *piz)
+{
+	Uploader *up;
+	void *reply;
+	xcb_generic_error_t *error;
+	uint64_t elapsed;
+
+	up = &piz->upload;
+
+	if (!up->probing || !xcb_poll_for_reply(piz->conn, up->probe_sequence,
+				&reply, &error))
+		return;
+
+	free(reply);
+	free(error);
+	up->probing = false;
+
+	// small batches mostly measure latency, not throughput
+	if (up->probe_bytes < ZINC_UPLOAD_MIN_BYTES)
+		return;
+
+	elapsed = MAX(now_us() - up->probe_start, 1);
+	up->rate = up->rate * 0.7 + (up->probe_bytes * 1e6 / elapsed) * 0.3;
+}
+
+static void
+__pizarra_upload_probe(Pizarra *piz, size_t bytes, uint64_t start)
+{
+	Uploader *up;
+
+	up = &piz->upload;
+	up->bytes_total += bytes;
+
+	if (up->probing || 0 == bytes)
+		return;
+
+	// the reply to a request sent after the images tells when
+	// the server got through them
+	up->probing = true;
+	up->probe_bytes = bytes;
+	up->probe_start = start;
+	up->probe_sequence = xcb_get_input_focus(piz->conn).sequence;
+}
+
+/* sends at most budget bytes of the damaged area of a non-SHM */
+/* chunk to its pixmap, top to bottom, in requests no larger than */
+/* the server accepts; the rows sent are returned in [y0, y1) */
+static size_t
+__pizarra_upload_chunk(Pizarra *piz, Chunk *chunk, size_t budget, int *y0, int *y1)
+{
+	int x, w, h, row, nrows, perreq;
+	size_t rowsz, sent;
+	uint32_t *rows;
+
+	x = chunk->stale.x0;
+	w = chunk->stale.x1 - chunk->stale.x0;
+	rowsz = w * sizeof(uint32_t);
+
+	h = MIN(chunk->stale.y1 - chunk->stale.y0, (int)(MAX(budget / rowsz, 1)));
+	perreq = MAX((piz->max_request - X_PUT_IMAGE_HEADER) / rowsz, 1);
+	rows = (w == chunk->width) ? NULL : xmalloc(MIN(h, perreq) * rowsz);
+
+	*y0 = chunk->stale.y0;
+	*y1 = chunk->stale.y0 + h;
+
+	for (sent = 0, row = *y0; row < *y1; row += nrows) {
+		nrows = MIN(perreq, *y1 - row);
+
+		// full width rows are already contiguous in memory,
+		// anything narrower has to be packed first
+		if (NULL != rows) {
+			for (int i = 0; i < nrows; ++i)
+				memcpy(&rows[i*w], &chunk->px[(row+i)*chunk->width+x], rowsz);
+		}
+
+		xcb_put_image(piz->conn, XCB_IMAGE_FORMAT_Z_PIXMAP, chunk->pixmap,
+				chunk->gc, w, nrows, x, row, 0, piz->depth, nrows * rowsz,
+				(const uint8_t *)(NULL != rows ? rows : &chunk->px[row*chunk->width]));
+
+		sent += nrows * rowsz;
+	}
+
+	free(rows);
+
+	chunk->stale.y0 = *y1;
+	if (chunk->stale.y0 >= chunk->stale.y1)
+		__box_clear(&chunk->stale);
+
+	return sent;
+}
+
+/* brings the X side of every visible chunk up to date, repainting */
+/* what changed on the window when repaint is set */
+static void
+__pizarra_flush_stale(Pizarra *piz, bool repaint)
+{
+	int x, y, w, h;
+	int cx, cy, cw, ch;
+	int x0, x1, y0, y1;
+	size_t budget, sent;
+	uint64_t start;
+	Chunk *chunk;
+
+	__pizarra_upload_measure(piz);
+	__pizarra_get_view_rect(piz, &x, &y, &w, &h);
+
+	budget = MAX(piz->upload.rate * ZINC_UPLOAD_FRAME_MS / 1000, ZINC_UPLOAD_MIN_BYTES);
+	start = now_us();
+	sent = 0;
+
+	for (chunk = __chunk_first(piz->root); chunk; chunk = chunk->next) {
+		__chunk_get_rect(chunk, &cx, &cy, &cw, &ch);
+
+		if (x >= cx + cw || y >= cy + ch || x + w <= cx || y + h <= cy
+				|| __box_empty(&chunk->stale) || NULL == chunk->px)
+			continue;
+
+		x0 = chunk->stale.x0;
+		x1 = chunk->stale.x1;
+
+		if (chunk->shm) {
+			y0 = chunk->stale.y0;
+			y1 = chunk->stale.y1;
+			__box_clear(&chunk->stale);
+		} else {
+			if (sent >= budget)
+				continue;
+			sent += __pizarra_upload_chunk(piz, chunk, budget - sent, &y0, &y1);
+		}
+
+		if (repaint)
+			__pizarra_render_canvas_rect(piz, cx + x0, cy + y0, x1 - x0, y1 - y0);
+	}
+
+	__pizarra_upload_probe(piz, sent, start);
+}
+
+/* shifts what is already on the window by the camera movement */
+/* and repaints only the strips that were uncovered */
+static void
+__pizarra_render_scroll(Pizarra *piz, int dx, int dy)
+{
+	int w, h;
+	xcb_void_cookie_t cookie;
+
+	w = piz->view.width;
+	h = piz->view.height;
+
+	cookie = xcb_copy_area(piz->conn, piz->win, piz->win, piz->scroll_gc,
+			MAX(dx, 0), MAX(dy, 0), MAX(-dx, 0), MAX(-dy, 0),
+			w - abs(dx), h - abs(dy));
+
+	piz->scrolls[piz->scroll_next].sequence = cookie.sequence;
+	piz->scrolls[piz->scroll_next].pos = piz->view.pos;
+	piz->scroll_next = (piz->scroll_next + 1) % ZINC_SCROLL_HISTORY;
+	piz->scroll_count = MIN(piz->scroll_count + 1, ZINC_SCROLL_HISTORY);
+
+	if (dx > 0) __pizarra_render_rect(piz, w - dx, 0, dx, h);
+	if (dx < 0) __pizarra_render_rect(piz, 0, 0, -dx, h);
+	if (dy > 0) __pizarra_render_rect(piz, 0, h - dy, w, dy);
+	if (dy < 0) __pizarra_render_rect(piz, 0, 0, w, -dy);
+}
+
+static void
+__renderer_frame(Pizarra *piz, const View *view, uint64_t when);
+
+static void
+__pizarra_h_graphics_exposure(Pizarra *piz, const xcb_graphics_exposure_event_t *ev)
+{
+	int i;
+
+	// the area could not be copied because it was obscured, the
+	// canvas that should be there is the one seen from the camera
+	// position right after the copy, later copies moved it along
+	for (i = 0; i < piz->scroll_count; ++i) {
+		if (piz->scrolls[i].sequence == ev->sequence) {
+			__pizarra_render_rect(piz,
+					ev->x + piz->scrolls[i].pos.x - piz->view.pos.x,
+					ev->y + piz->scrolls[i].pos.y - piz->view.pos.y,
+					ev->width, ev->height);
+			xcb_flush(piz->conn);
+			return;
+		}
+	}
+
+	// too old to know where it ended up
+	piz->has_shown = false;
+	if (ev->count == 0)
+		__renderer_frame(piz, &piz->view, 0);
+}
+
+#ifdef ZINC_USE_PRESENT
+static void
+__present_init(Pizarra *piz)
+{
+	Presenter *p;
+	xcb_generic_error_t *error;
+	const xcb_query_extension_reply_t *ext;
+	xcb_present_query_version_reply_t *reply;
+
+	p = &piz->present;
+	p->enabled = false;
+
+	ext = xcb_get_extension_data(piz->conn, &xcb_present_id);
+
+	if (NULL == ext || !ext->present)
+		return;
+
+	reply = xcb_present_query_version_reply(piz->conn,
+			xcb_present_query_version(piz->conn, 1, 0), &error);
+
+	if (NULL != error) {
+		free(error);
+		free(reply);
+		return;
+	}
+
+	if (NULL == reply)
+		return;
+
+	free(reply);
+
+	p->enabled = true;
+	p->opcode = ext->major_opcode;
+	p->eid = xcb_generate_id(piz->conn);
+
+	xcb_present_select_input(piz->conn, p->eid, piz->win,
+			XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY |
+			XCB_PRESENT_EVENT_MASK_IDLE_NOTIFY);
+}
+
+static void
+__present_resize(Pizarra *piz)
+{
+	int i;
+	Presenter *p;
+
+	p = &piz->present;
+
+	if (p->width == piz->view.width && p->height == piz->view.height)
+		return;
+
+	// the server keeps a pixmap that is still being
+	// presented alive until it is done with it
+	for (i = 0; i < ZINC_PRESENT_BUFFERS; ++i) {
+		if (0 != p->width)
+			xcb_free_pixmap(piz->conn, p->buffers[i].pixmap);
+		p->buffers[i].pixmap = xcb_generate_id(piz->conn);
+		p->buffers[i].idle = true;
+		xcb_create_pixmap(piz->conn, piz->depth, p->buffers[i].pixmap,
+				piz->win, piz->view.width, piz->view.height);
+	}
+
+	p->width = piz->view.width;
+	p->height = piz->view.height;
+}
+
+/* the msc of the first vblank more than the margin after now, 0 */
+/* (the next one) until the vblanks were measured */
+static uint64_t
+__present_target(const Presenter *p, uint64_t now)
+{
+	if (0 == p->msc || 0 == p->interval_us)
+		return 0;
+
+	if (now + p->margin_us < p->ust)
+		return p->msc + 1;
+
+	return p->msc + 1 + (now + p->margin_us - p->ust) / p->interval_us;
+}
+
+static void
+__present_frame(Pizarra *piz)
+{
+	int i;
+	Presenter *p;
+	PresentBuffer *buf;
+
+	p = &piz->present;
+
+	if (p->pending)
+		return;
+
+	for (buf = NULL, i = 0; i < ZINC_PRESENT_BUFFERS; ++i)
+		if (p->buffers[i].idle)
+			buf = &p->buffers[i];
+
+	// wait for an IdleNotify
+	if (NULL == buf)
+		return;
+
+	__pizarra_compose_rect(piz, buf->pixmap, 0, 0,
+			piz->view.width, piz->view.height);
+
+	// never more than one frame in flight, aimed at the first
+	// vblank it can still make, as far as the last ones went
+	p->target = __present_target(p, now_us());
+	xcb_present_pixmap(piz->conn, piz->win, buf->pixmap, ++p->serial,
+			0, 0, 0, 0, 0, 0, 0, XCB_PRESENT_OPTION_NONE,
+			p->target, 0, 0, 0, NULL);
+
+	buf->idle = false;
+	p->pending = true;
+	p->wanted = false;
+	p->pending_us = p->wanted_us;
+
+	xcb_flush(piz->conn);
+}
+
+static void
+__present_h_complete_notify(Pizarra *piz, const xcb_present_complete_notify_event_t *ev)
+{
+	Presenter *p;
+	uint64_t latency, interval;
+
+	p = &piz->present;
+
+	if (ev->kind != XCB_PRESENT_COMPLETE_KIND_PIXMAP || ev->serial != p->serial)
+		return;
+
+	// ust comes from the server CLOCK_MONOTONIC, the same
+	// clock the frame request was stamped with
+	if (ev->ust > p->pending_us) {
+		latency = ev->ust - p->pending_us;
+		p->latency_total += latency;
+		p->latency_max = MAX(p->latency_max, latency);
+		p->frames++;
+	}
+
+	// the interval is averaged over the last few frames, and a
+	// frame that came in late pushes the next ones earlier, by a
+	// quarter of a vblank, while frames on time draw it back
+	if (0 != p->msc && ev->msc > p->msc && ev->ust > p->ust) {
+		interval = (ev->ust - p->ust) / (ev->msc - p->msc);
+		p->interval_us = 0 == p->interval_us ? interval
+				: (p->interval_us * 7 + interval) / 8;
+	}
+
+	if (0 != p->target && ev->msc > p->target) {
+		p->margin_us = MIN(p->margin_us + p->interval_us / 4, p->interval_us);
+		p->missed++;
+	} else {
+		p->margin_us -= p->margin_us / 16;
+	}
+
+	p->msc = ev->msc;
+	p->ust = ev->ust;
+	p->pending = false;
+
+	if (p->wanted)
+		__present_frame(piz);
+}
+
+static void
+__present_h_idle_notify(Pizarra *piz, const xcb_present_idle_notify_event_t *ev)
+{
+	int i;
+	Presenter *p;
+
+	p = &piz->present;
+
+	for (i = 0; i < ZINC_PRESENT_BUFFERS; ++i)
+		if (p->buffers[i].pixmap == ev->pixmap)
+			p->buffers[i].idle = true;
+
+	if (p->wanted)
+		__present_frame(piz);
+}
+
+static void
+__present_process_event(Pizarra *piz, const xcb_ge_generic_event_t *ev)
+{
+	switch (ev->event_type) {
+	case XCB_PRESENT_COMPLETE_NOTIFY:
+		__present_h_complete_notify(piz, (const void *)(ev));
+		break;
+	case XCB_PRESENT_IDLE_NOTIFY:
+		__present_h_idle_notify(piz, (const void *)(ev));
+		break;
+	}
+}
+
+static void
+__present_request(Pizarra *piz, uint64_t when)
+{
+	Presenter *p;
+
+	p = &piz->present;
+
+	if (!p->wanted) {
+		p->wanted = true;
+		p->wanted_us = when;
+	}
+
+	__present_resize(piz);
+	__present_frame(piz);
+}
+
+static void
+__present_destroy(Pizarra *piz)
+{
+	int i;
+
+	if (0 == piz->present.width)
+		return;
+
+	for (i = 0; i < ZINC_PRESENT_BUFFERS; ++i)
+		xcb_free_pixmap(piz->conn, piz->present.buffers[i].pixmap);
+}
+#endif
+
+/* renders the canvas as seen from view, when is the time the */
+/* frame was asked for */
+static void
+__renderer_frame(Pizarra *piz, const View *view, uint64_t when)
+{
+	int dx, dy;
+
+	piz->frames++;
+
+	if (view != &piz->view)
+		piz->view = *view;
+
+	if (view->width != piz->shown.width || view->height != piz->shown.height
+			|| view->zoom != piz->shown.zoom)
+		piz->has_shown = false;
+
+#ifdef ZINC_USE_PRESENT
+	if (piz->present.enabled) {
+		__pizarra_flush_stale(piz, false);
+		__present_request(piz, 0 != when ? when : now_us());
+		return;
+	}
+#else
+	(void) when;
+#endif
+
+	dx = piz->view.pos.x - piz->shown.pos.x;
+	dy = piz->view.pos.y - piz->shown.pos.y;
+
+	// the window content is moved on the server, or painted
+	// again from the pixmaps, before the damage is brought in;
+	// zoomed out frames are cheap enough to be redone whole
+	if (piz->has_shown && 0 == dx && 0 == dy)
+		;
+	else if (piz->has_shown && 0 == piz->view.zoom
+			&& abs(dx) < piz->view.width && abs(dy) < piz->view.height)
+		__pizarra_render_scroll(piz, dx, dy);
+	else
+		__pizarra_render_rect(piz, 0, 0, piz->view.width, piz->view.height);
+
+	__pizarra_flush_stale(piz, true);
+
+	piz->has_shown = true;
+	piz->shown = piz->view;
+}
+
+static void
+__renderer_region(Pizarra *piz, int x, int y, int w, int h)
+{
+#ifdef ZINC_USE_PRESENT
+	// every presented frame is a complete one
+	if (piz->present.enabled) {
+		__renderer_frame(piz, &piz->view, 0);
+		return;
+	}
+#endif
+	__pizarra_render_rect(piz, x, y, w, h);
+}
+
+static void
+__renderer_clear(Pizarra *piz)
+{
+	Chunk *c;
+
+	// the pixmaps of non-SHM chunks are cleared on the server,
+	// there is no point in sending blank memory over
+	for (c = __chunk_first(piz->root); c; c = c->next) {
+		if (NULL == c->px)
+			continue;
+		if (!c->shm)
+			xcb_poly_fill_rectangle(piz->conn, c->pixmap, c->gc, 1,
+					(const xcb_rectangle_t []) {{ 0, 0, c->width, c->height }});
+		if (NULL != c->mips[0])
+			__box_add(&c->mip_dirty, 0, 0, c->width, c->height);
+		__box_clear(&c->stale);
+	}
+
+	piz->has_shown = false;
+}
+
+static void
+__renderer_event(Pizarra *piz, const xcb_generic_event_t *ge)
+{
+	switch (ge->response_type & ~0x80) {
+	case XCB_GRAPHICS_EXPOSURE:
+		__pizarra_h_graphics_exposure(piz, (const void *)(ge));
+		break;
+#ifdef ZINC_USE_PRESENT
+	case XCB_GE_GENERIC:
+		__present_process_event(piz, (const void *)(ge));
+		break;
+#endif
+	}
+}
+
+static bool
+__renderer_has_stale(Pizarra *piz)
+{
+	int x, y, w, h;
+	int cx, cy, cw, ch;
+	Chunk *chunk;
+
+	if (piz->shm)
+		return false;
+
+	__pizarra_get_view_rect(piz, &x, &y, &w, &h);
+
+	for (chunk = __chunk_first(piz->root); chunk; chunk = chunk->next) {
+		__chunk_get_rect(chunk, &cx, &cy, &cw, &ch);
+		if (x < cx + cw && y < cy + ch && x + w > cx && y + h > cy
+				&& !__box_empty(&chunk->stale) && NULL != chunk->px)
+			return true;
+	}
+
+	return false;
+}
+
+#ifdef ZINC_USE_RENDER_THREAD
+static bool
+__render_queue_push(RenderQueue *q, const RenderCommand *cmd)
+{
+	size_t head, tail;
+
+	head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+	if (head - tail == ZINC_RENDER_QUEUE_SIZE)
+		return false;
+
+	q->cmds[head % ZINC_RENDER_QUEUE_SIZE] = *cmd;
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+
+	return true;
+}
+
+static size_t
+__render_queue_space(RenderQueue *q)
+{
+	return ZINC_RENDER_QUEUE_SIZE
+		- (atomic_load_explicit(&q->head, memory_order_relaxed)
+		- atomic_load_explicit(&q->tail, memory_order_acquire));
+}
+
+static bool
+__render_queue_pop(RenderQueue *q, RenderCommand *cmd)
+{
+	size_t head, tail;
+
+	tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+	if (head == tail)
+		return false;
+
+	*cmd = q->cmds[tail % ZINC_RENDER_QUEUE_SIZE];
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+
+	return true;
+}
+
+static void
+__renderer_wait(Renderer *r, bool timed)
+{
+	struct timespec ts;
+
+	if (!timed) {
+		while (sem_wait(&r->wakeup) != 0)
+			;
+		return;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += ZINC_UPLOAD_FRAME_MS * 1000000L;
+	ts.tv_sec += ts.tv_nsec / 1000000000L;
+	ts.tv_nsec %= 1000000000L;
+
+	sem_timedwait(&r->wakeup, &ts);
+}
+
+static void *
+__renderer_thread(void *arg)
+{
+	Pizarra *piz;
+	Renderer *r;
+	RenderCommand cmd;
+	View view;
+	uint64_t when;
+	bool frame, pending, quit;
+
+	piz = arg;
+	r = &piz->renderer;
+	pending = quit = false;
+
+	while (!quit) {
+		// while uploads are left the renderer wakes up every
+		// frame to send some more, whether asked to or not
+		__renderer_wait(r, pending);
+
+		frame = pending;
+		view = piz->view;
+		when = 0;
+
+		// the chunk list only grows while the lock is not held
+		pthread_mutex_lock(&r->chunks_lock);
+
+		while (__render_queue_pop(&r->queue, &cmd)) {
+			switch (cmd.type) {
+			case RENDER_FRAME:
+				frame = true;
+				view = cmd.u.frame.view;
+				if (0 == when)
+					when = cmd.u.frame.when;
+				break;
+			case RENDER_DAMAGE:
+				__chunk_mark_stale(cmd.u.damage.chunk, &cmd.u.damage.box);
+				break;
+			case RENDER_REGION:
+				__renderer_region(piz, cmd.u.region.x, cmd.u.region.y,
+						cmd.u.region.w, cmd.u.region.h);
+				break;
+			case RENDER_CLEAR:
+				__renderer_clear(piz);
+				break;
+			case RENDER_EVENT:
+				__renderer_event(piz, (const void *)(cmd.u.event));
+				break;
+			case RENDER_QUIT:
+				quit = true;
+				break;
+			}
+		}
+
+		if (frame && !quit)
+			__renderer_frame(piz, &view, when);
+
+		pending = __renderer_has_stale(piz);
+		pthread_mutex_unlock(&r->chunks_lock);
+		xcb_flush(piz->conn);
+
+		// a full pipe already has the event loop coming
+		if (write(r->pipe[1], "", 1) < 0 && errno != EAGAIN)
+			die("can't wake the event loop up");
+	}
+
+	return NULL;
+}
+
+/* queues a command that has to get through, waiting for the */
+/* renderer to make room if needed */
+static void
+__renderer_submit(Pizarra *piz, const RenderCommand *cmd)
+{
+	while (!__render_queue_push(&piz->renderer.queue, cmd))
+		sched_yield();
+	sem_post(&piz->renderer.wakeup);
+}
+
+static void
+__renderer_init(Pizarra *piz)
+{
+	Renderer *r;
+
+	r = &piz->renderer;
+	atomic_init(&r->queue.head, 0);
+	atomic_init(&r->queue.tail, 0);
+	r->deferred = false;
+
+	sem_init(&r->wakeup, 0, 0);
+	pthread_mutex_init(&r->chunks_lock, NULL);
+
+	if (pipe(r->pipe) < 0)
+		die("can't create a pipe");
+
+	fcntl(r->pipe[0], F_SETFL, fcntl(r->pipe[0], F_GETFL) | O_NONBLOCK);
+	fcntl(r->pipe[1], F_SETFL, fcntl(r->pipe[1], F_GETFL) | O_NONBLOCK);
+
+	if (pthread_create(&r->thread, NULL, __renderer_thread, piz) != 0)
+		die("can't create render thread");
+}
+
+static void
+__renderer_destroy(Pizarra *piz)
+{
+	RenderCommand cmd;
+
+	cmd.type = RENDER_QUIT;
+	__renderer_submit(piz, &cmd);
+	pthread_join(piz->renderer.thread, NULL);
+
+	pthread_mutex_destroy(&piz->renderer.chunks_lock);
+	sem_destroy(&piz->renderer.wakeup);
+	close(piz->renderer.pipe[0]);
+	close(piz->renderer.pipe[1]);
+}
+#endif
+
+static inline int
+__replay_layer(int layer)
+{
+	return MAX(0, MIN(layer, ZINC_LAYERS - 1));
+}
+
+#ifdef ZINC_USE_LAYERS
+/* pixel x, y (relative to the chunk) of the layer, about to be */
+/* written, the tile it is in being only ever touched by the thread */
+/* drawing the replay tile around it */
+static uint32_t *
+__replay_layer_pixel(Chunk *c, int layer, int x, int y)
+{
+	int t;
+
+	t = (y / ZINC_LAYER_TILE) * __chunk_tiles_x(c) + x / ZINC_LAYER_TILE;
+	c->recompose[t] = true;
+
+	return &__layer_tile_own(&c->tiles[layer][t])[(y % ZINC_LAYER_TILE)
+			* ZINC_LAYER_TILE + x % ZINC_LAYER_TILE];
+}
+#endif
+
+/* blends premultiplied ARGB pixels over [x0, x1) of row y of the */
+/* chunk, in the layer when there are layers, src starting at x0 */
+static void
+__replay_blend(Chunk *c, int layer, int y, int x0, int x1, const uint32_t *src)
+{
+#ifdef ZINC_USE_LAYERS
+	int x, end;
+
+	for (x = x0; x < x1; x = end) {
+		end = MIN(x1, (x / ZINC_LAYER_TILE + 1) * ZINC_LAYER_TILE);
+		pixel_blend_over(__replay_layer_pixel(c, layer, x, y), &src[x - x0], end - x);
+	}
+#else
+	int i;
+	uint32_t *dst;
+
+	(void) layer;
+
+	dst = &c->px[y*c->width+x0];
+	pixel_blend_over(dst, src, x1 - x0);
+
+	for (i = 0; i < x1 - x0; ++i)
+		dst[i] &= 0xffffff;
+#endif
+}
+
+static void
+__replay_fill(Chunk *c, int layer, int y, int x0, int x1, uint32_t color)
+{
+	int i;
+#ifdef ZINC_USE_LAYERS
+	int x, end;
+	uint32_t *dst;
+
+	for (x = x0; x < x1; x = end) {
+		end = MIN(x1, (x / ZINC_LAYER_TILE + 1) * ZINC_LAYER_TILE);
+		dst = __replay_layer_pixel(c, layer, x, y);
+		for (i = 0; i < end - x; ++i)
+			dst[i] = 0xff000000 | color;
+	}
+#else
+	(void) layer;
+
+	for (i = x0; i < x1; ++i)
+		c->px[y*c->width+i] = color;
+#endif
+}
+
+/* puts premultiplied ARGB pixels in place of [x0, x1) of row y of */
+/* the chunk, in the layer when there are layers */
+static void
+__replay_copy(Chunk *c, int layer, int y, int x0, int x1, const uint32_t *src)
+{
+#ifdef ZINC_USE_LAYERS
+	int x, end;
+
+	for (x = x0; x < x1; x = end) {
+		end = MIN(x1, (x / ZINC_LAYER_TILE + 1) * ZINC_LAYER_TILE);
+		memcpy(__replay_layer_pixel(c, layer, x, y), &src[x - x0],
+				(end - x) * sizeof(uint32_t));
+	}
+#else
+	int i;
+
+	(void) layer;
+
+	for (i = 0; i < x1 - x0; ++i)
+		c->px[y*c->width+x0+i] = src[i] & 0xffffff;
+#endif
+}
+
+/* draws the operations of the tile, clipped to it, in order */
+static void
+__replay_tile(const Replayer *r, const ReplayTile *t)
+{
+	size_t k;
+	int ox, oy, x0, x1, y0, y1, w, row, layer, size;
+	uint32_t line[2 * BRUSH_MAX_SIZE];
+	const int *spans;
+	const PizarraOp *op;
+	BrushEngine engine;
+	BrushKernel kernel;
+	Chunk *c;
+
+	c = t->chunk;
+	size = 0;
+	engine = BRUSH_SOFT;
+	kernel = NULL;
+	spans = NULL;
+
+	for (k = t->first; k < t->first + t->count; ++k) {
+		op = &r->ops[r->order[k]];
+		layer = __replay_layer(op->layer);
+		ox = op->x;
+		oy = op->y - c->index * c->height;
+
+		if (PIZARRA_OP_DAB == op->type) {
+			// the dabs of a stroke come one after the other
+			if (NULL == kernel || op->size != size || op->engine != engine) {
+				size = op->size;
+				engine = op->engine;
+				kernel = brush_kernel(engine, size);
+				spans = brush_spans(size);
+			}
+
+			y0 = MAX(oy - size, t->area.y0);
+			y1 = MIN(oy + size, t->area.y1);
+
+			// the same pixels, in the same order, as drawing
+			// the dab in the window a row at a time
+			for (row = y0; row < y1; ++row) {
+				w = spans[row - oy + size];
+				x0 = MAX(ox - w, t->area.x0);
+				x1 = MIN(ox + w + 1, t->area.x1);
+				if (x0 >= x1)
+					continue;
+				kernel(line, size, row - oy, op->color);
+				__replay_blend(c, layer, row, x0, x1, &line[x0 - ox + w]);
+			}
+			continue;
+		}
+
+		x0 = MAX(ox, t->area.x0);
+		x1 = MIN(ox + op->size, t->area.x1);
+
+		if (oy < t->area.y0 || oy >= t->area.y1 || x0 >= x1)
+			continue;
+
+		if (PIZARRA_OP_SPAN == op->type)
+			__replay_fill(c, layer, oy, x0, x1, op->color);
+		else if (PIZARRA_OP_COPY == op->type)
+			__replay_copy(c, layer, oy, x0, x1, &op->src[x0 - ox]);
+		else
+			__replay_blend(c, layer, oy, x0, x1, &op->src[x0 - ox]);
+	}
+}
+
+/* draws tiles until there are none left, with the lock held */
+static void
+__replay_run(Replayer *r)
+{
+	int t;
+
+	while (r->next < r->ntiles) {
+		t = r->next++;
+		pthread_mutex_unlock(&r->lock);
+		__replay_tile(r, &r->tiles[t]);
+		pthread_mutex_lock(&r->lock);
+	}
+}
+
+static void *
+__replay_worker(void *arg)
+{
+	Replayer *r;
+	unsigned long seen;
+
+	r = arg;
+	seen = 0;
+
+	pthread_mutex_lock(&r->lock);
+
+	for (;;) {
+		while (!r->quit && r->generation == seen)
+			pthread_cond_wait(&r->start, &r->lock);
+
+		if (r->quit)
+			break;
+
+		seen = r->generation;
+		__replay_run(r);
+
+		if (0 == --r->running)
+			pthread_cond_signal(&r->finish);
+	}
+
+	pthread_mutex_unlock(&r->lock);
+
+	return NULL;
+}
+
+/* starts the workers, the first time a replay is worth them */
+static void
+__replay_init(Replayer *r)
+{
+	int i;
+	long n;
+
+	n = ZINC_REPLAY_THREADS;
+
+	if (n <= 0)
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	r->nthreads = MAX(1, MIN(n, ZINC_REPLAY_MAX_THREADS));
+	r->started = true;
+
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->start, NULL);
+	pthread_cond_init(&r->finish, NULL);
+
+	for (i = 0; i < r->nthreads - 1; ++i)
+		if (0 != pthread_create(&r->threads[i], NULL, __replay_worker, r))
+			die("pthread_create failed");
+}
+
+static void
+__replay_destroy(Replayer *r)
+{
+	int i;
+
+	if (!r->started)
+		return;
+
+	pthread_mutex_lock(&r->lock);
+	r->quit = true;
+	pthread_cond_broadcast(&r->start);
+	pthread_mutex_unlock(&r->lock);
+
+	for (i = 0; i < r->nthreads - 1; ++i)
+		pthread_join(r->threads[i], NULL);
+
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->start);
+	pthread_cond_destroy(&r->finish);
+}
+
+/* what the operation draws, clipped to the canvas and the clip */
+/* box, in canvas coordinates */
+static Box
+__replay_bounds(const Pizarra *piz, const PizarraOp *op)
+{
+	Box b;
+
+	if (PIZARRA_OP_DAB == op->type)
+		b = (Box) { op->x - op->size, op->y - op->size,
+				op->x + op->size, op->y + op->size };
+	else
+		b = (Box) { op->x, op->y, op->x + op->size, op->y + 1 };
+
+	b.x0 = MAX(b.x0, 0);
+	b.x1 = MIN(b.x1, piz->root->width);
+
+	if (piz->clipping) {
+		b.x0 = MAX(b.x0, piz->clip.x0);
+		b.y0 = MAX(b.y0, piz->clip.y0);
+		b.x1 = MIN(b.x1, piz->clip.x1);
+		b.y1 = MIN(b.y1, piz->clip.y1);
+	}
+
+	return b;
+}
+
+/* counts every operation in the tiles it reaches into, or, once */
+/* each tile knows where its operations start, puts them in order; */
+/* base is the first tile of every chunk, -1 for those left out */
+static void
+__replay_bin(const Pizarra *piz, const PizarraOp *ops, size_t nops,
+		const int *base, int first, int nchunks, ReplayTile *tiles, size_t *order)
+{
+	size_t k;
+	int ci, ty, tx, ry0, ry1, ntx, h, t;
+	Box b;
+
+	ntx = __ceil_div(piz->root->width, ZINC_REPLAY_TILE);
+	h = piz->root->height;
+
+	for (k = 0; k < nops; ++k) {
+		b = __replay_bounds(piz, &ops[k]);
+
+		if (__box_empty(&b))
+			continue;
+
+		for (ci = __floor_div(b.y0, h); ci <= __floor_div(b.y1 - 1, h); ++ci) {
+			if (ci < first || ci >= first + nchunks || base[ci - first] < 0)
+				continue;
+
+			ry0 = MAX(b.y0 - ci * h, 0);
+			ry1 = MIN(b.y1 - ci * h, h);
+
+			for (ty = ry0 / ZINC_REPLAY_TILE; ty <= (ry1 - 1) / ZINC_REPLAY_TILE; ++ty) {
+				for (tx = b.x0 / ZINC_REPLAY_TILE; tx <= (b.x1 - 1) / ZINC_REPLAY_TILE; ++tx) {
+					t = base[ci - first] + ty * ntx + tx;
+					if (NULL != order)
+						order[tiles[t].first + tiles[t].count] = k;
+					tiles[t].count++;
+				}
+			}
+		}
+	}
+}
+
+extern Pizarra *
+pizarra_new(xcb_connection_t *conn, xcb_window_t win)
+{
+	Pizarra *piz;
+	xcb_screen_t *scr;
+	int width, height;
+
+	assert(conn != NULL);
 
 	scr = xcb_setup_roots_iterator(xcb_get_setup(conn)).data;
 	assert(scr != NULL);
 
-	width = scr->width_in_pixels;
-	height = scr->height_in_pixels;
+	width = scr->width_in_pixels;
+	height = scr->height_in_pixels;
+
+	piz = xcalloc(1, sizeof(Pizarra));
+
+	piz->conn = conn;
+	piz->win = win;
+	piz->depth = scr->root_depth;
+	piz->shm = __x_check_mit_shm_extension(conn);
+	piz->max_request = xcb_get_maximum_request_length(conn) * 4;
+	piz->upload.rate = ZINC_UPLOAD_INITIAL_RATE;
+	piz->zoom_steps = 1;
+#ifdef ZINC_USE_LAYERS
+	for (int layer = 0; layer < ZINC_LAYERS; ++layer)
+		piz->layer_visible[layer] = true;
+#endif
+	piz->scroll_gc = xcb_generate_id(conn);
+	xcb_create_gc(conn, piz->scroll_gc, win, 0, NULL);
+	piz->bg_gc = xcb_generate_id(conn);
+	xcb_create_gc(conn, piz->bg_gc, win, XCB_GC_FOREGROUND | XCB_GC_GRAPHICS_EXPOSURES,
+			(const uint32_t []) { ZINC_BACKGROUND_COLOR, 0 });
+	piz->root = __chunk_new(conn, win, width, height, piz->shm, NULL);
+	piz->root->index = 0;
+
+	__chunk_prepend(piz->root, __chunk_new(conn, win, width, height, piz->shm, NULL));
+	__chunk_append(piz->root, __chunk_new(conn, win, width, height, piz->shm, NULL));
+
+#ifndef ZINC_NO_PREFETCH
+	__prefetch_init(&piz->prefetch, piz->shm,
+			width * height * sizeof(uint32_t));
+#endif
+
+#ifdef ZINC_USE_PRESENT
+	__present_init(piz);
+#endif
+
+#ifdef ZINC_USE_XRENDER
+	__xrender_init(piz);
+#endif
+
+#ifdef ZINC_USE_RENDER_THREAD
+	__renderer_init(piz);
+#endif
+
+	return piz;
+}
+
+extern void
+pizarra_camera_move_relative(Pizarra *piz, int offx, int offy)
+{
+	int32_t scale;
+	int64_t x, y;
+
+	scale = __zoom_scale(piz->zoom, piz->zoom_steps);
+	x = piz->pos.x + __floor_div((int64_t)(offx) * scale, 65536);
+	y = piz->pos.y + __floor_div((int64_t)(offy) * scale, 65536);
+
+	// the int position would wrap long before, and the canvas
+	// grows a chunk at a time to wherever it is
+	x = MAX(-ZINC_CAMERA_REACH, MIN(x, ZINC_CAMERA_REACH));
+	y = MAX(-ZINC_CAMERA_REACH, MIN(y, ZINC_CAMERA_REACH));
+	offy = y - piz->pos.y;
+
+	piz->pos.x = x;
+	piz->pos.y = y;
+	piz->velocity = piz->velocity * 0.75f + offy * 0.25f;
+
+	__pizarra_regenerate_chunks(piz);
+	__pizarra_keep_visible(piz);
+	__pizarra_update_residency(piz);
+}
+
+extern void
+pizarra_camera_move_to_center(Pizarra *piz)
+{
+	piz->pos.x = (piz->root->width - __floor_div((int64_t)(piz->viewport_width)
+			* __zoom_scale(piz->zoom, piz->zoom_steps), 65536)) / 2;
+}
+
+extern void
+pizarra_camera_zoom(Pizarra *piz, int levels, int x, int y)
+{
+	int zoom;
+	int64_t from, to;
+
+	zoom = MAX(0, MIN(piz->zoom + levels, ZINC_MIP_LEVELS * piz->zoom_steps));
+	from = __zoom_scale(piz->zoom, piz->zoom_steps);
+	to = __zoom_scale(zoom, piz->zoom_steps);
+
+	// keep the canvas under (x, y) where it is
+	piz->pos.x += __floor_div(x * from, 65536) - __floor_div(x * to, 65536);
+	piz->pos.y += __floor_div(y * from, 65536) - __floor_div(y * to, 65536);
+	piz->zoom = zoom;
+
+	__pizarra_regenerate_chunks(piz);
+	__pizarra_keep_visible(piz);
+	__pizarra_update_residency(piz);
+}
+
+extern int
+pizarra_camera_get_zoom(const Pizarra *piz)
+{
+	return piz->zoom;
+}
+
+extern void
+pizarra_set_viewport(Pizarra *piz, int vw, int vh)
+{
+	piz->viewport_width = vw;
+	piz->viewport_height = vh;
+
+	__pizarra_regenerate_chunks(piz);
+	__pizarra_keep_visible(piz);
+	__pizarra_update_residency(piz);
+}
+
+extern bool
+pizarra_try_process_event(Pizarra *piz, const xcb_generic_event_t *ge)
+{
+#ifdef ZINC_USE_RENDER_THREAD
+	RenderCommand cmd;
+	size_t size;
+#endif
+
+	switch (ge->response_type & ~0x80) {
+	case XCB_GRAPHICS_EXPOSURE:
+		if (((const xcb_graphics_exposure_event_t *)(ge))->drawable != piz->win)
+			return false;
+		break;
+	case XCB_NO_EXPOSURE:
+		return ((const xcb_no_exposure_event_t *)(ge))->drawable == piz->win;
+#ifdef ZINC_USE_PRESENT
+	case XCB_GE_GENERIC:
+		if (!piz->present.enabled || ((const xcb_ge_generic_event_t *)(ge))->extension
+				!= piz->present.opcode)
+			return false;
+		break;
+#endif
+	default:
+		return false;
+	}
+
+#ifdef ZINC_USE_RENDER_THREAD
+	// generic events carry more data after the full_sequence
+	// field that xcb appends to every event
+	size = sizeof(xcb_generic_event_t);
+	if ((ge->response_type & ~0x80) == XCB_GE_GENERIC)
+		size += ((const xcb_ge_generic_event_t *)(ge))->length * 4;
+
+	cmd.type = RENDER_EVENT;
+	memcpy(cmd.u.event, ge, MIN(size, sizeof(cmd.u.event)));
+	__renderer_submit(piz, &cmd);
+#else
+	__renderer_event(piz, ge);
+	xcb_flush(piz->conn);
+#endif
+
+	return true;
+}
+
+extern void
+pizarra_render_region(Pizarra *piz, int x, int y, int w, int h)
+{
+#ifdef ZINC_USE_RENDER_THREAD
+	RenderCommand cmd;
+
+	cmd.type = RENDER_REGION;
+	cmd.u.region.x = x;
+	cmd.u.region.y = y;
+	cmd.u.region.w = w;
+	cmd.u.region.h = h;
+	__renderer_submit(piz, &cmd);
+#else
+	__renderer_region(piz, x, y, w, h);
+	xcb_flush(piz->conn);
+#endif
+}
+
+extern void
+pizarra_render(Pizarra *piz)
+{
+	Chunk *chunk;
+	View view;
+#ifdef ZINC_USE_RENDER_THREAD
+	size_t ndamaged;
+	RenderCommand cmd;
+#endif
+
+	view.pos = piz->pos;
+	view.width = piz->viewport_width;
+	view.height = piz->viewport_height;
+	view.zoom = piz->zoom;
+	view.scale = __zoom_scale(piz->zoom, piz->zoom_steps);
+
+	// what was thawed to be drawn on out of view goes back
+	__pizarra_enforce_budget(piz);
+
+	if (piz->overlay.active) {
+		__overlay_compose(piz, &piz->overlay.dirty);
+		__box_clear(&piz->overlay.dirty);
+	}
+
+#ifdef ZINC_USE_LAYERS
+	for (chunk = __chunk_first(piz->root); chunk; chunk = chunk->next)
+		if (NULL != chunk->px)
+			__pizarra_recompose(piz, chunk);
+#endif
+
+#ifdef ZINC_USE_RENDER_THREAD
+	// hand the damage over to the renderer, in one go or not at
+	// all; while it is busy the damage keeps piling up in the
+	// chunks and the main loop tries again a frame later
+	for (ndamaged = 0, chunk = __chunk_first(piz->root); chunk; chunk = chunk->next)
+		if (!__box_empty(&chunk->damage))
+			++ndamaged;
+
+	if (__render_queue_space(&piz->renderer.queue) < ndamaged + 1) {
+		piz->renderer.deferred = true;
+		return;
+	}
+
+	// anything stamped into a chunk after the renderer read it
+	// is covered by a later damage command, so the pixels need
+	// no locking of their own
+	for (chunk = __chunk_first(piz->root); chunk; chunk = chunk->next) {
+		if (__box_empty(&chunk->damage))
+			continue;
+		cmd.type = RENDER_DAMAGE;
+		cmd.u.damage.chunk = chunk;
+		cmd.u.damage.box = chunk->damage;
+		__render_queue_push(&piz->renderer.queue, &cmd);
+		__box_clear(&chunk->damage);
+	}
+
+	cmd.type = RENDER_FRAME;
+	cmd.u.frame.view = view;
+	cmd.u.frame.when = now_us();
+	__renderer_submit(piz, &cmd);
+	piz->renderer.deferred = false;
+#else
+	for (chunk = __chunk_first(piz->root); chunk; chunk = chunk->next) {
+		if (__box_empty(&chunk->damage))
+			continue;
+		__chunk_mark_stale(chunk, &chunk->damage);
+		__box_clear(&chunk->damage);
+	}
+
+	__renderer_frame(piz, &view, now_us());
+	xcb_flush(piz->conn);
+#endif
+}
+
+extern bool
+pizarra_has_pending_uploads(Pizarra *piz)
+{
+#ifdef ZINC_USE_RENDER_THREAD
+	// the renderer keeps going on its own
+	return piz->renderer.deferred;
+#else
+	return __renderer_has_stale(piz);
+#endif
+}
+
+extern int
+pizarra_get_pollfd(const Pizarra *piz)
+{
+#ifdef ZINC_USE_RENDER_THREAD
+	return piz->renderer.pipe[0];
+#else
+	(void) piz;
+	return -1;
+#endif
+}
+
+extern void
+pizarra_drain_pollfd(Pizarra *piz)
+{
+#ifdef ZINC_USE_RENDER_THREAD
+	char byte;
+
+	while (read(piz->renderer.pipe[0], &byte, 1) > 0)
+		;
+#else
+	(void) piz;
+#endif
+}
+
+extern void
+pizarra_set_pixel(Pizarra *piz, int x, int y, uint32_t color)
+{
+	Chunk *chunk;
+
+	x += piz->pos.x;
+	y += piz->pos.y;
+
+	if (NULL == (chunk = __pizarra_get_chunk_at(piz, x, y)))
+		return;
+
+	if (piz->overlay.active && !piz->clipping) {
+		__overlay_blend(piz, x, y, 0xff000000 | color);
+		return;
+	}
+
+	y -= chunk->index * chunk->height;
+
+#ifdef ZINC_USE_LAYERS
+	*__chunk_layer_pixel(chunk, piz->layer, x, y) = 0xff000000 | color;
+#else
+	chunk->px[y*chunk->width+x] = color;
+	__box_add(&chunk->damage, x, y, 1, 1);
+#endif
+}
+
+/* blends n premultiplied ARGB pixels over canvas row y from x on, */
+/* growing the canvas up or down to it */
+extern void
+pizarra_blend_row(Pizarra *piz, int x, int y, const uint32_t *src, int n)
+{
+	int x0, x1;
+	Chunk *hint, *chunk;
+#ifndef ZINC_USE_LAYERS
+	int i;
+	uint32_t *dst;
+#endif
+
+	x0 = MAX(x, 0);
+	x1 = MIN(x + n, piz->root->width);
+
+	if (piz->clipping) {
+		if (y < piz->clip.y0 || y >= piz->clip.y1)
+			return;
+		x0 = MAX(x0, piz->clip.x0);
+		x1 = MIN(x1, piz->clip.x1);
+	} else {
+		__pizarra_grow_to(piz, y);
+	}
+
+	hint = NULL;
+
+	if (x0 >= x1 || NULL == (chunk = __pizarra_chunk_of_row(piz, &hint, y)))
+		return;
+
+	y -= chunk->index * chunk->height;
+
+#ifdef ZINC_USE_LAYERS
+	__chunk_layer_blend_span(chunk, piz->layer, y, x0, x1, &src[x0-x]);
+#else
+	dst = &chunk->px[y*chunk->width+x0];
+	pixel_blend_over(dst, &src[x0-x], x1 - x0);
+
+	for (i = 0; i < x1 - x0; ++i)
+		dst[i] &= 0xffffff;
+
+	__box_add(&chunk->damage, x0, y, x1 - x0, 1);
+#endif
+}
+
+/* blends n premultiplied ARGB pixels over row y of the camera from */
+/* x on, into the overlay while there is one */
+extern void
+pizarra_blend_span(Pizarra *piz, int x, int y, const uint32_t *src, int n)
+{
+	int x0, x1;
+
+	x += piz->pos.x;
+	y += piz->pos.y;
+	x0 = MAX(x, 0);
+	x1 = MIN(x + n, piz->root->width);
+
+	if (piz->clipping) {
+		x0 = MAX(x0, piz->clip.x0);
+		x1 = MIN(x1, piz->clip.x1);
+	}
+
+	// the canvas is not grown for it, as for a pixel
+	if (x0 >= x1 || NULL == __pizarra_get_chunk_at(piz, x0, y))
+		return;
+
+	if (piz->overlay.active && !piz->clipping) {
+		__overlay_blend_span(piz, x0, y, &src[x0-x], x1 - x0);
+		return;
+	}
+
+	pizarra_blend_row(piz, x0, y, &src[x0-x], x1 - x0);
+}
+
+extern void
+pizarra_blend_pixel(Pizarra *piz, int x, int y, uint32_t color, uint8_t alpha)
+{
+	uint32_t src, *dst;
+	Chunk *chunk;
+
+	x += piz->pos.x;
+	y += piz->pos.y;
+
+	if (NULL == (chunk = __pizarra_get_chunk_at(piz, x, y)))
+		return;
+
+	src = pixel_premultiply(color, alpha);
+
+	if (piz->overlay.active && !piz->clipping) {
+		__overlay_blend(piz, x, y, src);
+		return;
+	}
+
+	y -= chunk->index * chunk->height;
+
+#ifdef ZINC_USE_LAYERS
+	dst = __chunk_layer_pixel(chunk, piz->layer, x, y);
+	pixel_blend_over(dst, &src, 1);
+#else
+	dst = &chunk->px[y*chunk->width+x];
+	pixel_blend_over(dst, &src, 1);
+	*dst &= 0xffffff;
+	__box_add(&chunk->damage, x, y, 1, 1);
+#endif
+}
+
+extern int
+pizarra_get_pixel(Pizarra *piz, int x, int y, uint32_t *color)
+{
+	Chunk *chunk;
+
+	x += piz->pos.x;
+	y += piz->pos.y;
+
+	if (NULL != (chunk = __pizarra_get_chunk_at(piz, x, y))) {
+		y -= chunk->index * chunk->height;
+		*color = chunk->px[y*chunk->width+x];
+		return 1;
+	}
+
+	return 0;
+}
+
+/* row y of the canvas, which has to exist, moving the hint */
+/* to the chunk it is in */
+static uint32_t *
+__pizarra_row(Chunk **hint, int y)
+{
+	Chunk *c;
+
+	c = *hint;
+
+	while (y < c->index * c->height)
+		c = c->previous;
+
+	while (y >= (c->index + 1) * c->height)
+		c = c->next;
+
+	*hint = c;
+
+	return &c->px[(y - c->index * c->height) * c->width];
+}
+
+static inline void
+__fill_push(FillSeed *stack, int *top, bool *overflow, int y, int x0, int x1,
+		int dy, int ymin, int ymax)
+{
+	if (y + dy < ymin || y + dy > ymax)
+		return;
+
+	if (*top == ZINC_FILL_STACK) {
+		*overflow = true;
+		return;
+	}
+
+	stack[(*top)++] = (FillSeed) { y, x0, x1, dy };
+}
+
+extern int
+pizarra_flood_fill(Pizarra *piz, int x, int y, uint32_t color, PizarraSpan **spans)
+{
+	int i, l, top, nspans, capacity, rescan;
+	int cy, cw, ch;
+	bool overflow;
+	uint32_t old, *row;
+	uint64_t elapsed;
+	FillSeed seed, *stack;
+	Chunk *hint, *first, *last;
+#ifdef ZINC_USE_LAYERS
+	Chunk *c;
+#endif
+
+	*spans = NULL;
+
+	x += piz->pos.x;
+	y += piz->pos.y;
+
+	// the fill never goes past the chunks already there, nor
+	// into those evicted, but it does thaw those frozen
+	if (NULL == (hint = __pizarra_get_chunk_at(piz, x, y)))
+		return 0;
+
+	for (first = hint; first->previous && __pizarra_resident(piz, first->previous);
+			first = first->previous)
+		;
+
+	for (last = hint; last->next && __pizarra_resident(piz, last->next); last = last->next)
+		;
+
+#ifdef ZINC_USE_LAYERS
+	// the boundaries are those seen, whatever layer they are on
+	for (c = first; c != last->next; c = c->next)
+		__pizarra_recompose(piz, c);
+#endif
+
+	cw = piz->root->width;
+	cy = first->index * first->height;
+	ch = (last->index + 1) * last->height - cy;
+	old = __pizarra_row(&hint, y)[x];
+
+	if (old == color)
+		return 0;
+
+	elapsed = now_us();
+	stack = xmalloc(ZINC_FILL_STACK * sizeof(FillSeed));
+	top = nspans = capacity = 0;
+	overflow = false;
+	rescan = -1;
+
+	__fill_push(stack, &top, &overflow, y, x, x, 1, cy, cy + ch - 1);
+	__fill_push(stack, &top, &overflow, y + 1, x, x, -1, cy, cy + ch - 1);
+
+	for (;;) {
+		// each seed is a span of the row next to one just filled,
+		// every run of the old colour that touches it is filled and
+		// seeds the row past it, and the row it came from wherever
+		// it reaches beyond the seed
+		while (top > 0) {
+			seed = stack[--top];
+			y = seed.y + seed.dy;
+			row = __pizarra_row(&hint, y);
+
+			for (x = seed.x0; x <= seed.x1; ) {
+				while (x <= seed.x1 && row[x] != old)
+					++x;
+
+				if (x > seed.x1)
+					break;
+
+				for (l = x; l > 0 && row[l-1] == old; --l)
+					;
+
+				while (x < cw && row[x] == old)
+					++x;
+
+				for (i = l; i < x; ++i)
+					row[i] = color;
+
+#ifdef ZINC_USE_LAYERS
+				__chunk_layer_span(hint, piz->layer, y - hint->index * hint->height,
+						l, x, color);
+#endif
+
+				if (nspans == capacity) {
+					capacity = MAX(capacity * 2, 256);
+					*spans = xrealloc(*spans, capacity * sizeof(PizarraSpan));
+				}
+
+				(*spans)[nspans++] = (PizarraSpan) { y, l, x };
+				__box_add(&hint->damage, l, y - hint->index * hint->height, x - l, 1);
+
+				__fill_push(stack, &top, &overflow, y, l, x - 1, seed.dy,
+						cy, cy + ch - 1);
+
+				if (l < seed.x0)
+					__fill_push(stack, &top, &overflow, y, l, seed.x0 - 1, -seed.dy,
+							cy, cy + ch - 1);
+
+				if (x - 1 > seed.x1)
+					__fill_push(stack, &top, &overflow, y, seed.x1 + 1, x - 1, -seed.dy,
+							cy, cy + ch - 1);
+			}
+		}
+
+		// seeds were dropped, anything still left to fill is right
+		// above or below a span filled so far, so those are looked
+		// at again, as many at a time as the stack takes
+		if (rescan < 0) {
+			if (!overflow)
+				break;
+			overflow = false;
+			rescan = 0;
+		}
+
+		for (; rescan < nspans && top + 2 <= ZINC_FILL_STACK; ++rescan) {
+			__fill_push(stack, &top, &overflow, (*spans)[rescan].y, (*spans)[rescan].x0,
+					(*spans)[rescan].x1 - 1, 1, cy, cy + ch - 1);
+			__fill_push(stack, &top, &overflow, (*spans)[rescan].y, (*spans)[rescan].x0,
+					(*spans)[rescan].x1 - 1, -1, cy, cy + ch - 1);
+		}
+
+		if (rescan == nspans)
+			rescan = -1;
+	}
+
+	free(stack);
+
+	elapsed = now_us() - elapsed;
+	piz->fills++;
+	piz->fill_time_total += elapsed;
+	piz->fill_time_max = MAX(piz->fill_time_max, elapsed);
+
+	return nspans;
+}
+
+extern void
+pizarra_fill_span(Pizarra *piz, int y, int x0, int x1, uint32_t color)
+{
+	int i;
+	uint32_t *row;
+	Chunk *hint;
+
+	if (piz->clipping) {
+		x0 = MAX(x0, piz->clip.x0);
+		x1 = MIN(x1, piz->clip.x1);
+	}
+
+	x0 = MAX(x0, 0);
+	x1 = MIN(x1, piz->root->width);
+
+	if (x0 >= x1 || NULL == (hint = __pizarra_get_chunk_at(piz, x0, y)))
+		return;
+
+#ifdef ZINC_USE_LAYERS
+	(void) i;
+	(void) row;
+	__chunk_layer_span(hint, piz->layer, y - hint->index * hint->height, x0, x1, color);
+#else
+	row = __pizarra_row(&hint, y);
+
+	for (i = x0; i < x1; ++i)
+		row[i] = color;
+
+	__box_add(&hint->damage, x0, y - hint->index * hint->height, x1 - x0, 1);
+#endif
+}
+
+/* draws the operations over the chunks in memory the clip box */
+/* reaches into, see pizarra_replay */
+static void
+__replay_draw(Pizarra *piz, const PizarraOp *ops, size_t nops)
+{
+	int k, t, cy, first, nchunks, ntiles, ntx, nty, *base;
+	size_t at, *order;
+	Box *area;
+	Chunk *c;
+	Replayer *r;
+	ReplayTile *tiles;
+#ifdef ZINC_USE_LAYERS
+	int layer;
+	unsigned layers;
+#endif
+
+	r = &piz->replayer;
+	ntx = __ceil_div(piz->root->width, ZINC_REPLAY_TILE);
+	nty = __ceil_div(piz->root->height, ZINC_REPLAY_TILE);
+	first = __chunk_first(piz->root)->index;
+
+	for (nchunks = 0, c = __chunk_first(piz->root); c; c = c->next)
+		++nchunks;
+
+	base = xmalloc(nchunks * sizeof(int));
+
+	// the tiles of the chunks in memory the clip box reaches into
+	for (ntiles = k = 0, c = __chunk_first(piz->root); c; c = c->next, ++k) {
+		cy = c->index * c->height;
+		base[k] = -1;
+		if (NULL == c->px || (piz->clipping && (piz->clip.y1 <= cy
+						|| piz->clip.y0 >= cy + c->height)))
+			continue;
+		base[k] = ntiles;
+		ntiles += ntx * nty;
+	}
+
+	tiles = xcalloc(MAX(ntiles, 1), sizeof(ReplayTile));
+
+	for (k = 0, c = __chunk_first(piz->root); c; c = c->next, ++k) {
+		for (t = 0; base[k] >= 0 && t < ntx * nty; ++t) {
+			cy = c->index * c->height;
+			tiles[base[k] + t].chunk = c;
+			area = &tiles[base[k] + t].area;
+			area->x0 = (t % ntx) * ZINC_REPLAY_TILE;
+			area->y0 = (t / ntx) * ZINC_REPLAY_TILE;
+			area->x1 = MIN(area->x0 + ZINC_REPLAY_TILE, c->width);
+			area->y1 = MIN(area->y0 + ZINC_REPLAY_TILE, c->height);
+			if (piz->clipping) {
+				area->x0 = MAX(area->x0, piz->clip.x0);
+				area->y0 = MAX(area->y0, piz->clip.y0 - cy);
+				area->x1 = MIN(area->x1, piz->clip.x1);
+				area->y1 = MIN(area->y1, piz->clip.y1 - cy);
+			}
+		}
+	}
+
+	__replay_bin(piz, ops, nops, base, first, nchunks, tiles, NULL);
+
+	for (at = 0, t = 0; t < ntiles; ++t) {
+		tiles[t].first = at;
+		at += tiles[t].count;
+		tiles[t].count = 0;
+	}
+
+	order = xmalloc(MAX(at, 1) * sizeof(size_t));
+	__replay_bin(piz, ops, nops, base, first, nchunks, tiles, order);
+
+	// the spans and stamps are made here, the workers only look
+	// them up
+	for (at = 0; at < nops; ++at)
+		if (PIZARRA_OP_DAB == ops[at].type)
+			brush_prepare(ops[at].engine, ops[at].size);
+
+#ifdef ZINC_USE_LAYERS
+	// and so are the tile tables of the layers drawn on
+	for (layers = 0, at = 0; at < nops; ++at)
+		layers |= 1u << __replay_layer(ops[at].layer);
+
+	for (t = 0; t < ntiles; ++t) {
+		if (0 == tiles[t].count)
+			continue;
+		c = tiles[t].chunk;
+		for (layer = 0; layer < ZINC_LAYERS; ++layer)
+			if ((layers & (1u << layer)) && NULL == c->tiles[layer])
+				c->tiles[layer] = xcalloc_tagged(ALLOC_LAYERS, __chunk_tiles(c),
+						sizeof(LayerTile *));
+		if (NULL == c->recompose)
+			c->recompose = xcalloc_tagged(ALLOC_LAYERS, __chunk_tiles(c), sizeof(bool));
+		c->has_recompose = true;
+	}
+#endif
+
+	r->ops = ops;
+	r->order = order;
+	r->tiles = tiles;
+	r->ntiles = ntiles;
+	r->next = 0;
+
+	if (nops < ZINC_REPLAY_MIN_OPS) {
+		for (t = 0; t < ntiles; ++t)
+			__replay_tile(r, &tiles[t]);
+	} else {
+		if (!r->started)
+			__replay_init(r);
+		pthread_mutex_lock(&r->lock);
+		r->running = r->nthreads - 1;
+		r->generation++;
+		pthread_cond_broadcast(&r->start);
+		__replay_run(r);
+		while (r->running > 0)
+			pthread_cond_wait(&r->finish, &r->lock);
+		pthread_mutex_unlock(&r->lock);
+	}
+
+#ifndef ZINC_USE_LAYERS
+	for (t = 0; t < ntiles; ++t)
+		if (tiles[t].count > 0)
+			__box_add(&tiles[t].chunk->damage, tiles[t].area.x0, tiles[t].area.y0,
+					tiles[t].area.x1 - tiles[t].area.x0,
+					tiles[t].area.y1 - tiles[t].area.y0);
+#endif
+
+	free(order);
+	free(tiles);
+	free(base);
+}
 
-	piz = xcalloc(1, sizeof(Pizarra));
+/* draws the operations over the frozen chunks they reach into, */
+/* each thawed and drawn on by itself, so the budget is only ever */
+/* gone over by one chunk */
+static void
+__replay_frozen(Pizarra *piz, const PizarraOp *ops, size_t nops)
+{
+	int ci, h, first, nchunks, nfrozen;
+	size_t k;
+	bool *reached;
+	Box b;
+	Chunk *c;
 
-	piz->conn = conn;
-	piz->win = win;
-	piz->root = __chunk_new(conn, win, width, height);
-	piz->root->index = 0;
+	first = __chunk_first(piz->root)->index;
+	h = piz->root->height;
 
-	__chunk_prepend(conn, win, piz->root, width, height);
-	__chunk_append(conn, win, piz->root, width, height);
+	for (nchunks = nfrozen = 0, c = __chunk_first(piz->root); c; c = c->next, ++nchunks)
+		nfrozen += c->frozen;
 
-	return piz;
+	if (0 == nfrozen || piz->clipping)
+		return;
+
+	// those frozen by the time they are reached were drawn on
+	// already, and stay out of it
+	reached = xcalloc(nchunks, sizeof(bool));
+
+	for (k = 0; k < nops; ++k) {
+		b = __replay_bounds(piz, &ops[k]);
+
+		if (__box_empty(&b))
+			continue;
+
+		for (ci = MAX(__floor_div(b.y0, h), first); ci <= MIN(__floor_div(b.y1 - 1, h),
+					first + nchunks - 1); ++ci)
+			reached[ci - first] = true;
+	}
+
+	for (ci = 0, c = __chunk_first(piz->root); c; c = c->next, ++ci)
+		reached[ci] = reached[ci] && c->frozen;
+
+	for (ci = 0, c = __chunk_first(piz->root); c; c = c->next, ++ci) {
+		if (!reached[ci])
+			continue;
+		__pizarra_thaw(piz, c);
+		piz->clipping = true;
+		piz->clip = (Box) { 0, c->index * h, c->width, (c->index + 1) * h };
+		__replay_draw(piz, ops, nops);
+		piz->clipping = false;
+		__pizarra_enforce_budget(piz);
+	}
+
+	free(reached);
 }
 
+/* draws the operations as if one after the other, a pixel at a */
+/* time, with the canvas split into tiles that are drawn on as */
+/* many threads as there are processors; it all goes to the canvas, */
+/* never to the overlay, grown up or down to take it in unless the */
+/* loader is drawing */
 extern void
-pizarra_camera_move_relative(Pizarra *piz, int offx, int offy)
+pizarra_replay(Pizarra *piz, const PizarraOp *ops, size_t nops)
 {
-	piz->pos.x += offx;
-	piz->pos.y += offy;
+	int y0, y1;
+	size_t k;
+	uint64_t elapsed;
+	Box b;
+	Replayer *r;
 
-	__pizarra_regenerate_chunks(piz);
-	__pizarra_keep_visible(piz);
+	if (0 == nops)
+		return;
+
+	elapsed = now_us();
+	r = &piz->replayer;
+
+	if (!piz->clipping) {
+		for (y0 = INT_MAX, y1 = INT_MIN, k = 0; k < nops; ++k) {
+			b = __replay_bounds(piz, &ops[k]);
+			if (b.x0 < b.x1) {
+				y0 = MIN(y0, b.y0);
+				y1 = MAX(y1, b.y1);
+			}
+		}
+
+		// with a loader the chunks added stay out until it draws
+		// them, the operations among the rest
+		if (y0 < y1) {
+			__pizarra_grow_to(piz, y0);
+			__pizarra_grow_to(piz, y1 - 1);
+		}
+	}
+
+	__replay_draw(piz, ops, nops);
+	__replay_frozen(piz, ops, nops);
+
+	elapsed = now_us() - elapsed;
+	r->replays++;
+	r->ops_total += nops;
+	r->time_total += elapsed;
+	r->time_max = MAX(r->time_max, elapsed);
 }
 
+/* n pixels of canvas row y from x on, as premultiplied ARGB, of */
+/* the layer drawn on when there are layers, blank off the canvas */
 extern void
-pizarra_camera_move_to_center(Pizarra *piz)
+pizarra_read_row(Pizarra *piz, int x, int y, uint32_t *dst, int n)
 {
-	piz->pos.x = (piz->root->width - piz->viewport_width) / 2;
+	int x0, x1;
+	Chunk *hint, *c;
+#ifndef ZINC_USE_LAYERS
+	int i;
+#endif
+
+	hint = NULL;
+	x0 = MAX(x, 0);
+	x1 = MIN(x + n, piz->root->width);
+
+	memset(dst, 0, n * sizeof(uint32_t));
+
+	if (x0 >= x1 || NULL == (c = __pizarra_chunk_of_row(piz, &hint, y)))
+		return;
+
+	y -= c->index * c->height;
+
+#ifdef ZINC_USE_LAYERS
+	__chunk_layer_read(c, piz->layer, y, x0, &dst[x0 - x], x1 - x0);
+#else
+	for (i = x0; i < x1; ++i)
+		dst[i - x] = 0xff000000 | c->px[y*c->width+i];
+#endif
 }
 
+/* n pixels of canvas row y from x on, as XRGB and as shown, with */
+/* the layers composed, blank off the canvas */
 extern void
-pizarra_set_viewport(Pizarra *piz, int vw, int vh)
+pizarra_read_shown_row(Pizarra *piz, int x, int y, uint32_t *dst, int n)
 {
-	piz->viewport_width = vw;
-	piz->viewport_height = vh;
+	int x0, x1;
+	Chunk *hint, *c;
 
-	__pizarra_regenerate_chunks(piz);
-	__pizarra_keep_visible(piz);
+	hint = NULL;
+	x0 = MAX(x, 0);
+	x1 = MIN(x + n, piz->root->width);
+
+	memset(dst, 0, n * sizeof(uint32_t));
+
+	if (x0 >= x1 || NULL == (c = __pizarra_chunk_of_row(piz, &hint, y)))
+		return;
+
+#ifdef ZINC_USE_LAYERS
+	__pizarra_recompose(piz, c);
+#endif
+
+	memcpy(&dst[x0 - x], &c->px[(y - c->index * c->height) * c->width + x0],
+			(x1 - x0) * sizeof(uint32_t));
 }
 
-extern void
-pizarra_render(Pizarra *piz)
+/* thaws the frozen chunks holding canvas rows [y0, y1) */
+static void
+__pizarra_thaw_rows(Pizarra *piz, int y0, int y1)
 {
-	int x, y, w, h;
-	int cx, cy, cw, ch;
-	Chunk *chunk;
+	Chunk *c;
 
-	__pizarra_get_viewport_rect(piz, &x, &y, &w, &h);
+	for (c = __chunk_first(piz->root); c; c = c->next)
+		if (c->frozen && c->index * c->height < y1 && (c->index + 1) * c->height > y0)
+			__pizarra_thaw(piz, c);
+}
+
+#ifdef ZINC_USE_LAYERS
+/* blanks the rectangle of the layer, giving back the tiles it */
+/* covers whole */
+static void
+__pizarra_erase_tiles(Pizarra *piz, int layer, const Box *b)
+{
+	int t, row, cy;
+	uint32_t *px;
+	Box tb, a;
+	Chunk *c;
 
-	if (piz->pos.x < 0)
-		xcb_clear_area(piz->conn, 0, piz->win, 0, 0, -piz->pos.x, piz->viewport_height);
+	for (c = __chunk_first(piz->root); c; c = c->next) {
+		cy = c->index * c->height;
 
-	if (piz->root->width - piz->pos.x < piz->viewport_width)
-		xcb_clear_area(piz->conn, 0, piz->win, piz->root->width - piz->pos.x,
-				0, piz->viewport_width - (piz->root->width - piz->pos.x),
-				piz->viewport_height);
+		if (NULL == c->px || NULL == c->tiles[layer]
+				|| b->y1 <= cy || b->y0 >= cy + c->height)
+			continue;
 
-	for (chunk = __chunk_first(piz->root); chunk; chunk = chunk->next) {
-		__chunk_get_rect(chunk, &cx, &cy, &cw, &ch);
+		for (t = 0; t < __chunk_tiles(c); ++t) {
+			if (NULL == c->tiles[layer][t])
+				continue;
 
-		if (x < cx + cw && y < cy + ch
-				&& x + w > cx && y + h > cy) {
-			if (chunk->shm) {
-				xcb_copy_area(piz->conn, chunk->x.shm.pixmap, piz->win,
-						chunk->gc, 0, 0, cx - piz->pos.x, cy - piz->pos.y, cw, ch);
-			} else {
-				xcb_image_put(piz->conn, piz->win, chunk->gc,
-						chunk->x.image, cx - piz->pos.x, cy - piz->pos.y, 0);
+			tb = __chunk_layer_tile_box(c, t);
+			a.x0 = MAX(tb.x0, b->x0);
+			a.y0 = MAX(tb.y0, b->y0 - cy);
+			a.x1 = MIN(tb.x1, b->x1);
+			a.y1 = MIN(tb.y1, b->y1 - cy);
+
+			if (__box_empty(&a))
+				continue;
+
+			if (0 == memcmp(&a, &tb, sizeof(Box))) {
+				__layer_tile_unref(*__chunk_layer_slot(c, layer, t));
+				c->tiles[layer][t] = NULL;
+				continue;
 			}
+
+			px = __chunk_layer_tile(c, layer, t);
+			for (row = a.y0; row < a.y1; ++row)
+				memset(&px[(row % ZINC_LAYER_TILE) * ZINC_LAYER_TILE + a.x0
+						% ZINC_LAYER_TILE], 0, (a.x1 - a.x0) * sizeof(uint32_t));
 		}
 	}
-
-	xcb_flush(piz->conn);
 }
 
-extern void
-pizarra_set_pixel(Pizarra *piz, int x, int y, uint32_t color)
+/* moves the layer drawn on tile by tile: whatever lands on a tile */
+/* is taken before anything is written, as the rectangles may */
+/* overlap, and a tile that lands right on another is handed over */
+static void
+__pizarra_move_tiles(Pizarra *piz, const Box *src, int dx, int dy, bool copy)
 {
+	int t, n, cap, row, cy, sy, sty, layer;
 	uint32_t *px;
-	if (NULL != (px = __pizarra_get_pixel_ptr(piz, x, y)))
-		*px = color;
+	Box tb, a;
+	Chunk *c, *sc, *hint;
+	MovePiece *pieces, *p;
+
+	layer = piz->layer;
+	pieces = NULL;
+	n = cap = 0;
+	hint = NULL;
+
+	for (c = __chunk_first(piz->root); c; c = c->next) {
+		cy = c->index * c->height;
+
+		if (NULL == c->px || src->y1 + dy <= cy || src->y0 + dy >= cy + c->height)
+			continue;
+
+		for (t = 0; t < __chunk_tiles(c); ++t) {
+			tb = __chunk_layer_tile_box(c, t);
+			a.x0 = MAX(tb.x0, src->x0 + dx);
+			a.y0 = MAX(tb.y0, src->y0 + dy - cy);
+			a.x1 = MIN(tb.x1, src->x1 + dx);
+			a.y1 = MIN(tb.y1, src->y1 + dy - cy);
+
+			if (__box_empty(&a))
+				continue;
+
+			if (n == cap) {
+				cap = MAX(cap * 2, 64);
+				pieces = xrealloc(pieces, cap * sizeof(MovePiece));
+			}
+
+			p = &pieces[n++];
+			p->chunk = c;
+			p->t = t;
+			p->area = a;
+			p->tile = NULL;
+			p->px = NULL;
+
+			// where the top left corner comes from
+			sy = cy + a.y0 - dy;
+			sc = __pizarra_chunk_of_row(piz, &hint, sy);
+			sty = NULL != sc ? sy - sc->index * sc->height : 0;
+
+			p->whole = NULL != sc && 0 == memcmp(&a, &tb, sizeof(Box))
+					&& a.x1 - a.x0 == ZINC_LAYER_TILE && a.y1 - a.y0 == ZINC_LAYER_TILE
+					&& 0 == (a.x0 - dx) % ZINC_LAYER_TILE && 0 == sty % ZINC_LAYER_TILE
+					&& sty + ZINC_LAYER_TILE <= sc->height;
+
+			if (p->whole) {
+				if (NULL != sc->tiles[layer])
+					p->tile = __layer_tile_ref(sc->tiles[layer][(sty / ZINC_LAYER_TILE)
+							* __chunk_tiles_x(sc) + (a.x0 - dx) / ZINC_LAYER_TILE]);
+				piz->tiles_shared++;
+				continue;
+			}
+
+			p->px = xmalloc((a.x1 - a.x0) * (a.y1 - a.y0) * sizeof(uint32_t));
+			for (row = a.y0; row < a.y1; ++row)
+				pizarra_read_row(piz, a.x0 - dx, cy + row - dy,
+						&p->px[(row - a.y0) * (a.x1 - a.x0)], a.x1 - a.x0);
+		}
+	}
+
+	if (!copy)
+		__pizarra_erase_tiles(piz, layer, src);
+
+	for (p = pieces; p < pieces + n; ++p) {
+		if (p->whole) {
+			__layer_tile_unref(*__chunk_layer_slot(p->chunk, layer, p->t));
+			p->chunk->tiles[layer][p->t] = p->tile;
+			continue;
+		}
+
+		px = __chunk_layer_tile(p->chunk, layer, p->t);
+		for (row = p->area.y0; row < p->area.y1; ++row)
+			memcpy(&px[(row % ZINC_LAYER_TILE) * ZINC_LAYER_TILE + p->area.x0
+					% ZINC_LAYER_TILE], &p->px[(row - p->area.y0) * (p->area.x1
+					- p->area.x0)], (p->area.x1 - p->area.x0) * sizeof(uint32_t));
+		free(p->px);
+	}
+
+	free(pieces);
+}
+#else
+/* blanks [x0, x1) of canvas row y */
+static void
+__pizarra_erase_span(Pizarra *piz, Chunk **hint, int y, int x0, int x1)
+{
+	Chunk *c;
+
+	if (x0 >= x1 || NULL == (c = __pizarra_chunk_of_row(piz, hint, y)))
+		return;
+
+	y -= c->index * c->height;
+	memset(&c->px[y*c->width+x0], 0, (x1 - x0) * sizeof(uint32_t));
+	__box_add(&c->damage, x0, y, x1 - x0, 1);
 }
 
-extern int
-pizarra_get_pixel(Pizarra *piz, int x, int y, uint32_t *color)
+/* moves the canvas row by row, straight over the chunk memory */
+static void
+__pizarra_move_rows(Pizarra *piz, const Box *src, int dx, int dy, bool copy)
 {
-	uint32_t *px;
-	if (NULL != (px = __pizarra_get_pixel_ptr(piz, x, y))) {
-		*color = *px;
-		return 1;
+	int i, row, x0, x1;
+	uint32_t *dst;
+	Chunk *shint, *dhint, *sc, *dc;
+
+	shint = dhint = NULL;
+	x0 = MAX(src->x0 + dx, 0);
+	x1 = MIN(src->x1 + dx, piz->root->width);
+
+	// the rows are taken in the order that leaves those still to
+	// be moved alone when the rectangles overlap
+	for (i = 0; i < src->y1 - src->y0 && x0 < x1; ++i) {
+		row = dy > 0 ? src->y1 - 1 - i : src->y0 + i;
+
+		if (NULL == (dc = __pizarra_chunk_of_row(piz, &dhint, row + dy)))
+			continue;
+
+		dst = &dc->px[(row + dy - dc->index * dc->height) * dc->width + x0];
+
+		if (NULL == (sc = __pizarra_chunk_of_row(piz, &shint, row)))
+			memset(dst, 0, (x1 - x0) * sizeof(uint32_t));
+		else
+			memmove(dst, &sc->px[(row - sc->index * sc->height) * sc->width
+					+ x0 - dx], (x1 - x0) * sizeof(uint32_t));
+
+		__box_add(&dc->damage, x0, row + dy - dc->index * dc->height, x1 - x0, 1);
 	}
-	return 0;
+
+	if (copy)
+		return;
+
+	// what the rectangle no longer covers where it was goes blank
+	for (row = src->y0; row < src->y1; ++row) {
+		if (row < src->y0 + dy || row >= src->y1 + dy)
+			__pizarra_erase_span(piz, &shint, row, src->x0, src->x1);
+		else if (dx > 0)
+			__pizarra_erase_span(piz, &shint, row, src->x0, MIN(src->x0 + dx, src->x1));
+		else if (dx < 0)
+			__pizarra_erase_span(piz, &shint, row, MAX(src->x1 + dx, src->x0), src->x1);
+	}
+}
+#endif
+
+/* moves the canvas rectangle (of the layer drawn on, when there */
+/* are layers) by dx, dy, leaving it blank behind unless it is */
+/* copied; the overlay has to be inactive */
+extern void
+pizarra_move_rect(Pizarra *piz, int x, int y, int w, int h, int dx, int dy, bool copy)
+{
+	Box src;
+
+	src = (Box) { MAX(x, 0), y, MIN(x + w, piz->root->width), y + h };
+
+	if (__box_empty(&src) || (0 == dx && 0 == dy))
+		return;
+
+	__pizarra_thaw_rows(piz, src.y0, src.y1);
+	__pizarra_thaw_rows(piz, src.y0 + dy, src.y1 + dy);
+
+#ifdef ZINC_USE_LAYERS
+	__pizarra_move_tiles(piz, &src, dx, dy, copy);
+#else
+	__pizarra_move_rows(piz, &src, dx, dy, copy);
+#endif
+
+	piz->moves++;
+}
+
+/* blanks the canvas rectangle, of the layer drawn on when there */
+/* are layers */
+extern void
+pizarra_erase_rect(Pizarra *piz, int x, int y, int w, int h)
+{
+	Box b;
+#ifndef ZINC_USE_LAYERS
+	int row;
+	Chunk *hint;
+#endif
+
+	b = (Box) { MAX(x, 0), y, MIN(x + w, piz->root->width), y + h };
+
+	if (__box_empty(&b))
+		return;
+
+	__pizarra_thaw_rows(piz, b.y0, b.y1);
+
+#ifdef ZINC_USE_LAYERS
+	__pizarra_erase_tiles(piz, piz->layer, &b);
+#else
+	hint = NULL;
+	for (row = b.y0; row < b.y1; ++row)
+		__pizarra_erase_span(piz, &hint, row, b.x0, b.x1);
+#endif
+}
+
+/* brings the chunks holding canvas rows [y, y + h) into memory, */
+/* until the camera moves away from them */
+extern void
+pizarra_fetch(Pizarra *piz, int y, int h)
+{
+	Chunk *c;
+
+	__pizarra_thaw_rows(piz, y, y + h);
+
+	if (NULL == piz->loader)
+		return;
+
+	for (c = __chunk_first(piz->root); c; c = c->next)
+		if (NULL == c->px && c->index * c->height < y + h
+				&& (c->index + 1) * c->height > y)
+			__pizarra_bring_in(piz, c);
 }
 
 extern void
@@ -432,18 +4758,389 @@ extern void
 pizarra_clear(Pizarra *piz)
 {
 	Chunk *c;
-	for (c = __chunk_first(piz->root); c; c = c->next)
+#ifdef ZINC_USE_RENDER_THREAD
+	RenderCommand cmd;
+#endif
+
+	for (c = __chunk_first(piz->root); c; c = c->next) {
+		// a frozen chunk with nothing packed is blank
+		__chunk_cold_free(c);
+		if (NULL == c->px)
+			continue;
 		memset(c->px, 0, sizeof(uint32_t) * c->width * c->height);
+		__box_clear(&c->damage);
+#ifdef ZINC_USE_LAYERS
+		__chunk_layers_free(c);
+#endif
+	}
+
+#ifdef ZINC_USE_RENDER_THREAD
+	cmd.type = RENDER_CLEAR;
+	__renderer_submit(piz, &cmd);
+#else
+	__renderer_clear(piz);
+#endif
+}
+
+#ifdef ZINC_USE_LAYERS
+extern void
+pizarra_set_layer(Pizarra *piz, int layer)
+{
+	piz->layer = MAX(0, MIN(layer, ZINC_LAYERS - 1));
+}
+
+extern int
+pizarra_get_layer(const Pizarra *piz)
+{
+	return piz->layer;
+}
+
+/* shows or hides the layer, composing again only the tiles it */
+/* has anything on */
+extern void
+pizarra_toggle_layer(Pizarra *piz, int layer)
+{
+	Chunk *c;
+
+	if (layer < 0 || layer >= ZINC_LAYERS)
+		return;
+
+	piz->layer_visible[layer] = !piz->layer_visible[layer];
+
+	for (c = __chunk_first(piz->root); c; c = c->next)
+		if (NULL != c->px)
+			__chunk_layer_touch(c, layer);
+}
+
+extern bool
+pizarra_layer_is_visible(const Pizarra *piz, int layer)
+{
+	return layer >= 0 && layer < ZINC_LAYERS && piz->layer_visible[layer];
+}
+#endif
+
+/* from now on, and until it is merged or dropped, what is drawn */
+/* goes to an overlay over the canvas */
+extern void
+pizarra_overlay_begin(Pizarra *piz)
+{
+	if (piz->overlay.active)
+		pizarra_overlay_cancel(piz);
+
+	piz->overlay.active = true;
+}
+
+/* blends the overlay into the canvas, in a single pass */
+extern void
+pizarra_overlay_commit(Pizarra *piz)
+{
+	Overlay *ov;
+#ifdef ZINC_USE_LAYERS
+	int row;
+	Chunk *hint, *c;
+#endif
+
+	ov = &piz->overlay;
+
+	if (!ov->active)
+		return;
+
+#ifdef ZINC_USE_LAYERS
+	hint = NULL;
+
+	for (row = ov->drawn.y0; row < ov->drawn.y1; ++row) {
+		if (NULL != (c = __pizarra_chunk_of_row(piz, &hint, row)))
+			__chunk_layer_blend_span(c, piz->layer, row - c->index * c->height,
+					ov->drawn.x0, ov->drawn.x1, __overlay_pixel(ov, ov->drawn.x0, row));
+	}
+#else
+	// the canvas already shows it composed
+	__overlay_compose(piz, &ov->dirty);
+#endif
+
+	ov->merged++;
+	__overlay_end(piz);
+}
+
+/* leaves the overlay empty, or only its clip rectangle, and the */
+/* canvas as it was before it */
+extern void
+pizarra_overlay_clear(Pizarra *piz)
+{
+	int row;
+	Box b;
+	Overlay *ov;
+	Chunk *hint, *c;
+
+	ov = &piz->overlay;
+	hint = NULL;
+	b = ov->drawn;
+
+	if (ov->clipped) {
+		b.x0 = MAX(b.x0, ov->clip.x0);
+		b.y0 = MAX(b.y0, ov->clip.y0);
+		b.x1 = MIN(b.x1, ov->clip.x1);
+		b.y1 = MIN(b.y1, ov->clip.y1);
+	}
+
+	for (row = b.y0; b.x0 < b.x1 && row < b.y1; ++row) {
+		memset(__overlay_pixel(ov, b.x0, row), 0, (b.x1 - b.x0) * sizeof(uint32_t));
+		if (NULL == (c = __pizarra_chunk_of_row(piz, &hint, row)))
+			continue;
+#ifdef ZINC_USE_LAYERS
+		__chunk_layer_mark(c, &(const Box) { b.x0, row - c->index * c->height,
+				b.x1, row - c->index * c->height + 1 });
+#else
+		memcpy(&c->px[(row - c->index * c->height) * c->width + b.x0],
+				__overlay_under(ov, b.x0, row), (b.x1 - b.x0) * sizeof(uint32_t));
+		__box_add(&c->damage, b.x0, row - c->index * c->height, b.x1 - b.x0, 1);
+#endif
+	}
+
+	// the rest of what was drawn stays, and can still be taken
+	// back to the mark
+	if (ov->clipped)
+		return;
+
+	__box_clear(&ov->drawn);
+	__box_clear(&ov->dirty);
+	ov->ntraces = 0;
+	ov->marked = false;
+}
+
+/* what is drawn on the overlay from now on, and what is cleared of */
+/* it, stays within the canvas rectangle, or anywhere again once it */
+/* is empty */
+extern void
+pizarra_overlay_clip(Pizarra *piz, int x, int y, int w, int h)
+{
+	Overlay *ov;
+
+	ov = &piz->overlay;
+	ov->clipped = w > 0 && h > 0;
+	ov->clip = (Box) { x, y, x + w, y + h };
+}
+
+/* what is drawn on the overlay from now on can be taken back with */
+/* pizarra_overlay_rewind, e.g. what is only a guess */
+extern void
+pizarra_overlay_mark(Pizarra *piz)
+{
+	Overlay *ov;
+
+	ov = &piz->overlay;
+
+	if (!ov->active)
+		return;
+
+	ov->marked = true;
+	ov->ntraces = 0;
+}
+
+/* leaves the overlay as it was at the mark, the mark is gone */
+extern void
+pizarra_overlay_rewind(Pizarra *piz)
+{
+	size_t i;
+	Overlay *ov;
+	OverlayTrace *t;
+
+	ov = &piz->overlay;
+
+	if (!ov->marked)
+		return;
+
+	// newest first, a pixel drawn over twice ends as it was
+	// before the first time
+	for (i = ov->ntraces; i > 0; --i) {
+		t = &ov->traces[i-1];
+		*__overlay_pixel(ov, t->x, t->y) = t->px;
+		__box_add(&ov->dirty, t->x, t->y, 1, 1);
+	}
+
+	// drawn is left as it is, the canvas under what was taken
+	// back may still show it until it is composed again
+	ov->ntraces = 0;
+	ov->marked = false;
+	ov->rewinds++;
+}
+
+extern void
+pizarra_overlay_cancel(Pizarra *piz)
+{
+	if (!piz->overlay.active)
+		return;
+
+	pizarra_overlay_clear(piz);
+	piz->overlay.dropped++;
+	__overlay_end(piz);
+}
+
+/* keeps the pixels of the chunks in memory, but for those in */
+/* view, within the given bytes, 0 for no limit */
+extern void
+pizarra_set_memory_budget(Pizarra *piz, size_t bytes)
+{
+	piz->budget = bytes;
+
+	__pizarra_update_residency(piz);
+}
+
+/* from now on the chunks away from the camera are evicted, and */
+/* drawn by the loader when they are needed again */
+extern void
+pizarra_set_loader(Pizarra *piz, PizarraLoader loader, void *data)
+{
+	piz->loader = loader;
+	piz->loader_data = data;
+
+	__pizarra_update_residency(piz);
+}
+
+/* clears the canvas and has the loader draw what is in memory */
+extern void
+pizarra_reload(Pizarra *piz)
+{
+	Chunk *c;
+
+	pizarra_clear(piz);
+
+	if (NULL == piz->loader)
+		return;
+
+	for (c = __chunk_first(piz->root); c; c = c->next)
+		if (NULL != c->px)
+			__pizarra_load_chunk(piz, c);
+}
+
+extern void
+pizarra_print_stats(const Pizarra *piz, FILE *fp)
+{
+	int n, resident, plane;
+	size_t packed;
+#ifdef ZINC_USE_LAYERS
+	int layer, t;
+#endif
+	const Chunk *chunk;
+
+	for (n = resident = 0, chunk = __chunk_first(piz->root); chunk; chunk = chunk->next, ++n)
+		if (NULL != chunk->px)
+			++resident;
+
+	fprintf(fp, "canvas: %d of %d chunks of %dx%d in memory (%zu KiB, %s)\n",
+			resident, n, piz->root->width, piz->root->height,
+			resident * piz->root->width * piz->root->height * sizeof(uint32_t) / 1024,
+			piz->shm ? "MIT-SHM" : "no MIT-SHM");
+
+	if (NULL != piz->loader)
+		fprintf(fp, "residency: %lu evictions, %lu chunk loads\n",
+				piz->evictions, piz->reloads);
+
+	if (piz->budget > 0) {
+		for (n = 0, packed = 0, chunk = __chunk_first(piz->root); chunk; chunk = chunk->next)
+			for (plane = 0, n += chunk->frozen; plane < ZINC_PLANES; ++plane)
+				packed += chunk->cold_size[plane];
+
+		fprintf(fp, "budget: %zu KiB, %lu of %lu chunks coming into view "
+				"still in memory (%.1f%%)\n", piz->budget / 1024, piz->hits,
+				piz->visits, piz->visits > 0 ? 100.0 * piz->hits / piz->visits : 100.0);
+
+		fprintf(fp, "cold store: %d chunks frozen in %zu KiB, %lu freezes, "
+				"%lu thaws, avg %.2f ms, max %.2f ms\n", n, packed / 1024,
+				piz->freezes, piz->thaws, piz->thaws > 0 ? piz->thaw_time_total
+				/ 1000.0 / piz->thaws : 0.0, piz->thaw_time_max / 1000.0);
+	}
+
+	if (piz->moves > 0)
+		fprintf(fp, "selection: %lu moves, %lu layer tiles shared rather than copied\n",
+				piz->moves, piz->tiles_shared);
+
+	if (piz->overlay.merged + piz->overlay.dropped > 0)
+		fprintf(fp, "overlay: %lu strokes merged, %lu dropped, %lu rewinds\n",
+				piz->overlay.merged, piz->overlay.dropped, piz->overlay.rewinds);
+
+#ifdef ZINC_USE_LAYERS
+	for (n = 0, chunk = __chunk_first(piz->root); chunk; chunk = chunk->next)
+		for (layer = 0; layer < ZINC_LAYERS; ++layer)
+			for (t = 0; chunk->tiles[layer] && t < __chunk_tiles(chunk); ++t)
+				n += NULL != chunk->tiles[layer][t];
+
+	fprintf(fp, "layers: %d tiles of %dx%d (%zu KiB), %lu composed\n", n,
+			ZINC_LAYER_TILE, ZINC_LAYER_TILE,
+			n * ZINC_LAYER_TILE * ZINC_LAYER_TILE * sizeof(uint32_t) / 1024,
+			piz->recomposed);
+#endif
+	fprintf(fp, "render: %lu frames\n", piz->frames);
+
+	if (piz->replayer.replays > 0)
+		fprintf(fp, "replay: %lu replays of %zu operations on %d threads, "
+				"avg %.2f ms, max %.2f ms\n", piz->replayer.replays,
+				piz->replayer.ops_total, piz->replayer.started
+				? piz->replayer.nthreads : 1,
+				piz->replayer.time_total / 1000.0 / piz->replayer.replays,
+				piz->replayer.time_max / 1000.0);
+
+	if (piz->fills > 0)
+		fprintf(fp, "fill: %lu fills, avg %.2f ms, max %.2f ms\n", piz->fills,
+				piz->fill_time_total / 1000.0 / piz->fills,
+				piz->fill_time_max / 1000.0);
+
+	if (!piz->shm)
+		fprintf(fp, "upload: %llu KiB sent, link measured at %.1f KiB/s\n",
+				(unsigned long long)(piz->upload.bytes_total / 1024),
+				piz->upload.rate / 1024);
+
+	if (piz->overview.frames > 0)
+		fprintf(fp, "overview: %lu frames (%s), canvas of up to %d chunks, "
+				"avg %.2f ms, max %.2f ms\n", piz->overview.frames,
+#ifdef ZINC_USE_XRENDER
+				piz->xrender.enabled ? "XRender" :
+#endif
+				"mipmaps",
+				piz->overview.chunks_max,
+				piz->overview.time_total / 1000.0 / piz->overview.frames,
+				piz->overview.time_max / 1000.0);
+
+#ifdef ZINC_USE_PRESENT
+	if (!piz->present.enabled) {
+		fprintf(fp, "present: not available\n");
+	} else if (piz->present.frames > 0) {
+		fprintf(fp, "present: %lu frames, input-to-present latency "
+				"avg %.2f ms, max %.2f ms, %lu vblanks missed, "
+				"refresh %.2f ms\n", piz->present.frames,
+				piz->present.latency_total / 1000.0 / piz->present.frames,
+				piz->present.latency_max / 1000.0, piz->present.missed,
+				piz->present.interval_us / 1000.0);
+	}
+#endif
 }
 
 extern void
 pizarra_destroy(Pizarra *piz)
 {
 	Chunk *chunk, *next;
+#ifdef ZINC_USE_RENDER_THREAD
+	__renderer_destroy(piz);
+#endif
+#ifndef ZINC_NO_PREFETCH
+	__prefetch_destroy(&piz->prefetch);
+#endif
 	for (chunk = __chunk_first(piz->root); chunk; ) {
 		next = chunk->next;
 		__chunk_destroy(piz->conn, chunk);
 		chunk = next;
 	}
+	__overview_free(piz);
+	__overlay_end(piz);
+	__replay_destroy(&piz->replayer);
+#ifdef ZINC_USE_XRENDER
+	if (piz->xrender.enabled)
+		xcb_render_free_picture(piz->conn, piz->xrender.window);
+#endif
+	xcb_free_gc(piz->conn, piz->scroll_gc);
+	xcb_free_gc(piz->conn, piz->bg_gc);
+#ifdef ZINC_USE_PRESENT
+	__present_destroy(piz);
+#endif
 	free(piz);
 }
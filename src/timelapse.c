@@ -0,0 +1,230 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "timelapse.h"
+
+/* frames filled and written in turn, one can be drawn while the */
+/* other is written */
+#define TIMELAPSE_FRAMES 2
+
+struct Timelapse {
+	FILE *fp;
+	int width;
+	int height;
+
+	/* frame pushed % TIMELAPSE_FRAMES is filled next, and frame */
+	/* written % TIMELAPSE_FRAMES is written next, once pushed */
+	uint32_t *frames[TIMELAPSE_FRAMES];
+	unsigned long pushed;
+	unsigned long written;
+	bool quit;
+
+	/* planes of the frame being written */
+	uint8_t *yuv;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* time the drawing side waited for a frame to fill, and the */
+	/* writer for one to write, and the time converting and */
+	/* writing took, in microseconds */
+	uint64_t fill_wait;
+	uint64_t write_wait;
+	uint64_t write_time;
+};
+
+/* full range BT.601, as JPEG has it, chroma of every 2x2 block */
+static void
+__timelapse_convert(const Timelapse *tl, const uint32_t *px, uint8_t *yuv)
+{
+	int x, y, w, h, r, g, b;
+	uint32_t p[4];
+	uint8_t *cb, *cr;
+
+	w = tl->width;
+	h = tl->height;
+	cb = &yuv[w * h];
+	cr = &cb[w / 2 * (h / 2)];
+
+	for (y = 0; y < h; ++y) {
+		for (x = 0; x < w; ++x) {
+			r = px[y*w+x] >> 16 & 0xff;
+			g = px[y*w+x] >> 8 & 0xff;
+			b = px[y*w+x] & 0xff;
+			yuv[y*w+x] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+		}
+	}
+
+	for (y = 0; y < h; y += 2) {
+		for (x = 0; x < w; x += 2) {
+			p[0] = px[y*w+x];
+			p[1] = px[y*w+x+1];
+			p[2] = px[(y+1)*w+x];
+			p[3] = px[(y+1)*w+x+1];
+			r = ((p[0] >> 16 & 0xff) + (p[1] >> 16 & 0xff) + (p[2] >> 16 & 0xff)
+					+ (p[3] >> 16 & 0xff) + 2) >> 2;
+			g = ((p[0] >> 8 & 0xff) + (p[1] >> 8 & 0xff) + (p[2] >> 8 & 0xff)
+					+ (p[3] >> 8 & 0xff) + 2) >> 2;
+			b = ((p[0] & 0xff) + (p[1] & 0xff) + (p[2] & 0xff) + (p[3] & 0xff) + 2) >> 2;
+			// offset so the sums never go negative
+			*cb++ = (32896 - 43 * r - 85 * g + 128 * b) >> 8;
+			*cr++ = (32896 + 128 * r - 107 * g - 21 * b) >> 8;
+		}
+	}
+}
+
+static void *
+__timelapse_writer(void *arg)
+{
+	uint64_t start;
+	size_t size;
+	Timelapse *tl;
+
+	tl = arg;
+	size = (size_t)(tl->width) * tl->height * 3 / 2;
+	pthread_mutex_lock(&tl->lock);
+
+	for (;;) {
+		if (tl->written == tl->pushed) {
+			if (tl->quit)
+				break;
+			start = now_us();
+			pthread_cond_wait(&tl->cond, &tl->lock);
+			tl->write_wait += now_us() - start;
+			continue;
+		}
+
+		// the frame is left alone by the drawing side until it
+		// is written
+		pthread_mutex_unlock(&tl->lock);
+		start = now_us();
+		__timelapse_convert(tl, tl->frames[tl->written % TIMELAPSE_FRAMES], tl->yuv);
+		fputs("FRAME\n", tl->fp);
+		fwrite(tl->yuv, 1, size, tl->fp);
+		pthread_mutex_lock(&tl->lock);
+
+		tl->write_time += now_us() - start;
+		tl->written++;
+		pthread_cond_broadcast(&tl->cond);
+	}
+
+	pthread_mutex_unlock(&tl->lock);
+	return NULL;
+}
+
+extern Timelapse *
+timelapse_new(FILE *fp, int w, int h, int fps)
+{
+	int i;
+	Timelapse *tl;
+
+	tl = xcalloc_tagged(ALLOC_TIMELAPSE, 1, sizeof(Timelapse));
+	tl->fp = fp;
+	tl->width = w;
+	tl->height = h;
+	tl->yuv = xmalloc_tagged(ALLOC_TIMELAPSE, (size_t)w * h * 3 / 2);
+
+	for (i = 0; i < TIMELAPSE_FRAMES; ++i)
+		tl->frames[i] = xmalloc_tagged(ALLOC_TIMELAPSE, (size_t)w * h * sizeof(uint32_t));
+
+	fprintf(fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", w, h, fps);
+
+	pthread_mutex_init(&tl->lock, NULL);
+	pthread_cond_init(&tl->cond, NULL);
+
+	if (pthread_create(&tl->thread, NULL, __timelapse_writer, tl) != 0)
+		die("pthread_create failed");
+
+	return tl;
+}
+
+extern uint32_t *
+timelapse_frame(Timelapse *tl)
+{
+	uint64_t start;
+
+	pthread_mutex_lock(&tl->lock);
+	start = now_us();
+	while (tl->pushed - tl->written >= TIMELAPSE_FRAMES)
+		pthread_cond_wait(&tl->cond, &tl->lock);
+	tl->fill_wait += now_us() - start;
+	pthread_mutex_unlock(&tl->lock);
+
+	return tl->frames[tl->pushed % TIMELAPSE_FRAMES];
+}
+
+extern void
+timelapse_push(Timelapse *tl)
+{
+	pthread_mutex_lock(&tl->lock);
+	tl->pushed++;
+	pthread_cond_broadcast(&tl->cond);
+	pthread_mutex_unlock(&tl->lock);
+}
+
+extern void
+timelapse_flush(Timelapse *tl)
+{
+	pthread_mutex_lock(&tl->lock);
+	while (tl->written != tl->pushed)
+		pthread_cond_wait(&tl->cond, &tl->lock);
+	pthread_mutex_unlock(&tl->lock);
+
+	fflush(tl->fp);
+}
+
+extern void
+timelapse_print_stats(const Timelapse *tl, FILE *fp)
+{
+	fprintf(fp, "timelapse: %lu frames of %dx%d, writing avg %.2f ms, "
+			"%.2f ms waited for the writer, %.2f ms for the drawing\n",
+			tl->written, tl->width, tl->height, tl->written > 0
+			? tl->write_time / 1000.0 / tl->written : 0.0,
+			tl->fill_wait / 1000.0, tl->write_wait / 1000.0);
+}
+
+extern void
+timelapse_destroy(Timelapse *tl)
+{
+	int i;
+
+	pthread_mutex_lock(&tl->lock);
+	tl->quit = true;
+	pthread_cond_broadcast(&tl->cond);
+	pthread_mutex_unlock(&tl->lock);
+
+	pthread_join(tl->thread, NULL);
+	pthread_mutex_destroy(&tl->lock);
+	pthread_cond_destroy(&tl->cond);
+	fflush(tl->fp);
+
+	for (i = 0; i < TIMELAPSE_FRAMES; ++i)
+		xfree(tl->frames[i]);
+
+	xfree(tl->yuv);
+	xfree(tl);
+}
@@ -19,6 +19,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+#ifdef ZINC_USE_ALLOC_STATS
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#endif
 
 #include "utils.h"
 
@@ -52,3 +59,213 @@ xcalloc(size_t nmemb, size_t size)
 		die("OOM");
 	return ptr;
 }
+
+extern void *
+xrealloc(void *ptr, size_t size)
+{
+	if (NULL == (ptr = realloc(ptr, size)))
+		die("OOM");
+	return ptr;
+}
+
+extern uint64_t
+now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+#ifdef ZINC_USE_ALLOC_STATS
+/* put before every tagged block, as aligned as malloc leaves it */
+typedef union {
+	struct {
+		size_t size;
+		AllocTag tag;
+	} h;
+	max_align_t align;
+} AllocHeader;
+
+/* what a thread allocated and gave back, written by that thread */
+/* alone, so no counter is ever fought over; memory freed on another */
+/* thread than the one it came from makes live go negative there, */
+/* only the sum over the threads means anything, and the sum of the */
+/* peaks is a bound on the peak of that sum rather than the peak */
+typedef struct AllocCounters AllocCounters;
+
+struct AllocCounters {
+	atomic_long live[ALLOC_TAGS];
+	atomic_long peak[ALLOC_TAGS];
+	atomic_ulong allocs[ALLOC_TAGS];
+	atomic_ulong frees[ALLOC_TAGS];
+	AllocCounters *next;
+};
+
+static const char *alloc_tag_names[ALLOC_TAGS] = {
+	[ALLOC_HISTORY] = "history",
+	[ALLOC_CHUNKS] = "chunks",
+	[ALLOC_SHM] = "shared memory",
+	[ALLOC_LAYERS] = "layers",
+	[ALLOC_COLD] = "cold store",
+	[ALLOC_OVERLAY] = "overlay",
+	[ALLOC_IMAGE] = "images",
+	[ALLOC_VECTOR] = "vector index",
+	[ALLOC_PICKER] = "picker",
+	[ALLOC_CONTROL] = "control",
+	[ALLOC_TIMELAPSE] = "timelapse",
+	[ALLOC_CLIPBOARD] = "clipboard"
+};
+
+/* counters of every thread that ever allocated, kept after it is */
+/* gone, and those of the calling one */
+static _Atomic(AllocCounters *) alloc_threads;
+static _Thread_local AllocCounters *alloc_counters;
+
+static AllocCounters *
+__alloc_counters(void)
+{
+	AllocCounters *c;
+
+	if (NULL != (c = alloc_counters))
+		return c;
+
+	if (NULL == (c = calloc(1, sizeof(AllocCounters))))
+		die("OOM");
+
+	c->next = atomic_load(&alloc_threads);
+	while (!atomic_compare_exchange_weak(&alloc_threads, &c->next, c))
+		;
+
+	return alloc_counters = c;
+}
+
+static long
+__alloc_sum(AllocTag tag, bool peak)
+{
+	long sum;
+	AllocCounters *c;
+
+	sum = 0;
+	for (c = atomic_load(&alloc_threads); c; c = c->next)
+		sum += atomic_load_explicit(peak ? &c->peak[tag] : &c->live[tag],
+				memory_order_relaxed);
+
+	return sum;
+}
+
+/* plain loads and stores on the thread's own counters, the other */
+/* threads are only looked at when the stats are printed */
+static void
+__alloc_count(AllocTag tag, long bytes, int allocs, int frees)
+{
+	long live;
+	AllocCounters *c;
+
+	c = __alloc_counters();
+
+	live = bytes + atomic_load_explicit(&c->live[tag], memory_order_relaxed);
+	atomic_store_explicit(&c->live[tag], live, memory_order_relaxed);
+	if (live > atomic_load_explicit(&c->peak[tag], memory_order_relaxed))
+		atomic_store_explicit(&c->peak[tag], live, memory_order_relaxed);
+	atomic_store_explicit(&c->allocs[tag], allocs +
+			atomic_load_explicit(&c->allocs[tag], memory_order_relaxed),
+			memory_order_relaxed);
+	atomic_store_explicit(&c->frees[tag], frees +
+			atomic_load_explicit(&c->frees[tag], memory_order_relaxed),
+			memory_order_relaxed);
+}
+
+static void *
+__alloc_tag(AllocHeader *hdr, AllocTag tag, size_t size)
+{
+	assert(tag < ALLOC_TAGS);
+
+	if (NULL == hdr)
+		die("OOM");
+
+	hdr->h.size = size;
+	hdr->h.tag = tag;
+	__alloc_count(tag, size, 1, 0);
+
+	return hdr + 1;
+}
+
+extern void *
+xmalloc_tagged(AllocTag tag, size_t size)
+{
+	return __alloc_tag(malloc(sizeof(AllocHeader) + size), tag, size);
+}
+
+extern void *
+xcalloc_tagged(AllocTag tag, size_t nmemb, size_t size)
+{
+	if (0 != size && nmemb > (SIZE_MAX - sizeof(AllocHeader)) / size)
+		die("OOM");
+	return __alloc_tag(calloc(1, sizeof(AllocHeader) + nmemb * size), tag,
+			nmemb * size);
+}
+
+extern void *
+xrealloc_tagged(AllocTag tag, void *ptr, size_t size)
+{
+	size_t old;
+	AllocHeader *hdr;
+
+	if (NULL == ptr)
+		return xmalloc_tagged(tag, size);
+
+	hdr = (AllocHeader *)(ptr) - 1;
+	assert(hdr->h.tag == tag);
+	old = hdr->h.size;
+
+	if (NULL == (hdr = realloc(hdr, sizeof(AllocHeader) + size)))
+		die("OOM");
+
+	hdr->h.size = size;
+	__alloc_count(tag, (long)(size) - (long)(old), 0, 0);
+
+	return hdr + 1;
+}
+
+extern void
+xfree(void *ptr)
+{
+	AllocHeader *hdr;
+
+	if (NULL == ptr)
+		return;
+
+	hdr = (AllocHeader *)(ptr) - 1;
+	__alloc_count(hdr->h.tag, -(long)(hdr->h.size), 0, 1);
+	free(hdr);
+}
+
+extern void
+alloc_note(AllocTag tag, long bytes)
+{
+	__alloc_count(tag, bytes, bytes > 0, bytes < 0);
+}
+
+/* what is still live on exit was leaked, or is held until the end */
+extern void
+alloc_print_stats(FILE *fp)
+{
+	int tag;
+	AllocCounters *c;
+	unsigned long allocs, frees;
+
+	for (tag = 0; tag < ALLOC_TAGS; ++tag) {
+		allocs = frees = 0;
+		for (c = atomic_load(&alloc_threads); c; c = c->next) {
+			allocs += atomic_load_explicit(&c->allocs[tag], memory_order_relaxed);
+			frees += atomic_load_explicit(&c->frees[tag], memory_order_relaxed);
+		}
+		if (0 == allocs)
+			continue;
+		fprintf(fp, "memory: %s, %ld KiB live, %ld KiB peak at most, "
+				"%lu allocations, %lu not given back\n", alloc_tag_names[tag],
+				__alloc_sum(tag, false) / 1024, __alloc_sum(tag, true) / 1024,
+				allocs, allocs - frees);
+	}
+}
+#endif
@@ -0,0 +1,290 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "history.h"
+#include "vector.h"
+
+/* side of the square cells of the grid, in canvas pixels */
+#define VECTOR_CELL_SIZE 256
+
+typedef struct {
+	HistoryUserAction *hua;
+
+	/* bounding box, [x0, x1) x [y0, y1) */
+	int x0, y0;
+	int x1, y1;
+
+	/* last query that returned it, so it comes out only once */
+	/* however many cells it is in */
+	unsigned long stamp;
+} VectorEntry;
+
+typedef struct VectorCell {
+	int cx, cy;
+	int n, cap;
+	VectorEntry **entries;
+	struct VectorCell *next;
+} VectorCell;
+
+struct VectorIndex {
+	/* sparse grid, as a hash table of the non empty cells */
+	VectorCell **buckets;
+	size_t nbuckets;
+	size_t ncells;
+
+	size_t count;
+	unsigned long stamp;
+
+	/* results of the last query */
+	HistoryUserAction **found;
+	int nfound, capfound;
+};
+
+static inline int
+__floor_div(int a, int b)
+{
+	return a / b - (a % b != 0 && a < 0);
+}
+
+static inline size_t
+__vector_hash(const VectorIndex *vi, int cx, int cy)
+{
+	return ((uint32_t)(cx) * 73856093u ^ (uint32_t)(cy) * 19349663u)
+		& (vi->nbuckets - 1);
+}
+
+static VectorCell *
+__vector_cell(VectorIndex *vi, int cx, int cy, bool create)
+{
+	size_t i, h;
+	VectorCell *cell, *next, **buckets;
+
+	for (cell = vi->buckets[__vector_hash(vi, cx, cy)]; cell; cell = cell->next)
+		if (cell->cx == cx && cell->cy == cy)
+			return cell;
+
+	if (!create)
+		return NULL;
+
+	// keep about a cell per bucket
+	if (vi->ncells == vi->nbuckets) {
+		buckets = vi->buckets;
+		vi->nbuckets *= 2;
+		vi->buckets = xcalloc_tagged(ALLOC_VECTOR, vi->nbuckets,
+				sizeof(VectorCell *));
+		for (i = 0; i < vi->nbuckets / 2; ++i) {
+			for (cell = buckets[i]; cell; cell = next) {
+				next = cell->next;
+				h = __vector_hash(vi, cell->cx, cell->cy);
+				cell->next = vi->buckets[h];
+				vi->buckets[h] = cell;
+			}
+		}
+		xfree(buckets);
+	}
+
+	cell = xcalloc_tagged(ALLOC_VECTOR, 1, sizeof(VectorCell));
+	cell->cx = cx;
+	cell->cy = cy;
+	h = __vector_hash(vi, cx, cy);
+	cell->next = vi->buckets[h];
+	vi->buckets[h] = cell;
+	vi->ncells++;
+
+	return cell;
+}
+
+extern VectorIndex *
+vector_index_new(void)
+{
+	VectorIndex *vi;
+	vi = xcalloc_tagged(ALLOC_VECTOR, 1, sizeof(VectorIndex));
+	vi->nbuckets = 256;
+	vi->buckets = xcalloc_tagged(ALLOC_VECTOR, vi->nbuckets, sizeof(VectorCell *));
+	return vi;
+}
+
+extern void
+vector_index_insert(VectorIndex *vi, HistoryUserAction *hua)
+{
+	int cx, cy;
+	VectorCell *cell;
+	VectorEntry *entry;
+
+	entry = xcalloc_tagged(ALLOC_VECTOR, 1, sizeof(VectorEntry));
+	entry->hua = hua;
+	history_user_action_get_bounds(hua, &entry->x0, &entry->y0, &entry->x1, &entry->y1);
+
+	if (entry->x0 >= entry->x1) {
+		xfree(entry);
+		return;
+	}
+
+	for (cy = __floor_div(entry->y0, VECTOR_CELL_SIZE);
+			cy <= __floor_div(entry->y1 - 1, VECTOR_CELL_SIZE); ++cy) {
+		for (cx = __floor_div(entry->x0, VECTOR_CELL_SIZE);
+				cx <= __floor_div(entry->x1 - 1, VECTOR_CELL_SIZE); ++cx) {
+			cell = __vector_cell(vi, cx, cy, true);
+			if (cell->n == cell->cap) {
+				cell->cap = MAX(cell->cap * 2, 4);
+				cell->entries = xrealloc_tagged(ALLOC_VECTOR, cell->entries,
+						cell->cap * sizeof(VectorEntry *));
+			}
+			cell->entries[cell->n++] = entry;
+		}
+	}
+
+	vi->count++;
+}
+
+extern void
+vector_index_remove(VectorIndex *vi, HistoryUserAction *hua)
+{
+	int i, cx, cy, x0, y0, x1, y1;
+	VectorCell *cell;
+	VectorEntry *entry;
+
+	history_user_action_get_bounds(hua, &x0, &y0, &x1, &y1);
+
+	if (x0 >= x1)
+		return;
+
+	entry = NULL;
+
+	for (cy = __floor_div(y0, VECTOR_CELL_SIZE);
+			cy <= __floor_div(y1 - 1, VECTOR_CELL_SIZE); ++cy) {
+		for (cx = __floor_div(x0, VECTOR_CELL_SIZE);
+				cx <= __floor_div(x1 - 1, VECTOR_CELL_SIZE); ++cx) {
+			if (NULL == (cell = __vector_cell(vi, cx, cy, false)))
+				continue;
+			for (i = 0; i < cell->n; ++i) {
+				if (cell->entries[i]->hua == hua) {
+					entry = cell->entries[i];
+					cell->entries[i] = cell->entries[--cell->n];
+					break;
+				}
+			}
+		}
+	}
+
+	if (NULL != entry) {
+		xfree(entry);
+		vi->count--;
+	}
+}
+
+static int
+__vector_compare_id(const void *a, const void *b)
+{
+	const HistoryUserAction *ha, *hb;
+
+	ha = *(HistoryUserAction *const *)(a);
+	hb = *(HistoryUserAction *const *)(b);
+
+	return (ha->id > hb->id) - (ha->id < hb->id);
+}
+
+/* actions whose bounding box meets the rectangle, in the order */
+/* they were done; the array is reused by the next query */
+extern int
+vector_index_query(VectorIndex *vi, int x, int y, int w, int h,
+		HistoryUserAction ***huas)
+{
+	int i, cx, cy;
+	VectorCell *cell;
+	VectorEntry *entry;
+
+	vi->stamp++;
+	vi->nfound = 0;
+
+	for (cy = __floor_div(y, VECTOR_CELL_SIZE);
+			cy <= __floor_div(y + h - 1, VECTOR_CELL_SIZE); ++cy) {
+		for (cx = __floor_div(x, VECTOR_CELL_SIZE);
+				cx <= __floor_div(x + w - 1, VECTOR_CELL_SIZE); ++cx) {
+			if (NULL == (cell = __vector_cell(vi, cx, cy, false)))
+				continue;
+			for (i = 0; i < cell->n; ++i) {
+				entry = cell->entries[i];
+				if (entry->stamp == vi->stamp || entry->x0 >= x + w
+						|| entry->x1 <= x || entry->y0 >= y + h
+						|| entry->y1 <= y)
+					continue;
+				entry->stamp = vi->stamp;
+				if (vi->nfound == vi->capfound) {
+					vi->capfound = MAX(vi->capfound * 2, 64);
+					vi->found = xrealloc_tagged(ALLOC_VECTOR, vi->found, vi->capfound
+							* sizeof(HistoryUserAction *));
+				}
+				vi->found[vi->nfound++] = entry->hua;
+			}
+		}
+	}
+
+	qsort(vi->found, vi->nfound, sizeof(HistoryUserAction *), __vector_compare_id);
+	*huas = vi->found;
+
+	return vi->nfound;
+}
+
+extern size_t
+vector_index_count(const VectorIndex *vi)
+{
+	return vi->count;
+}
+
+extern void
+vector_index_destroy(VectorIndex *vi)
+{
+	int i;
+	size_t b, n;
+	VectorCell *cell, *next;
+	VectorEntry **entries;
+
+	// entries live in every cell they overlap, collect each once
+	// before freeing any of them
+	n = 0;
+	entries = xcalloc(vi->count + 1, sizeof(VectorEntry *));
+	vi->stamp++;
+
+	for (b = 0; b < vi->nbuckets; ++b) {
+		for (cell = vi->buckets[b]; cell; cell = next) {
+			next = cell->next;
+			for (i = 0; i < cell->n; ++i) {
+				if (cell->entries[i]->stamp != vi->stamp) {
+					cell->entries[i]->stamp = vi->stamp;
+					entries[n++] = cell->entries[i];
+				}
+			}
+			xfree(cell->entries);
+			xfree(cell);
+		}
+	}
+
+	while (n > 0)
+		xfree(entries[--n]);
+
+	free(entries);
+	xfree(vi->buckets);
+	xfree(vi->found);
+	xfree(vi);
+}
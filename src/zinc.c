@@ -21,18 +21,36 @@
 #include <math.h>
 #include <xcb/xcb.h>
 #include <xcb/xproto.h>
+#include <xcb/xcbext.h>
 #include <xcb/xcb_keysyms.h>
 #include <xcb/xcb_cursor.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
+#include <poll.h>
 #include <xkbcommon/xkbcommon-keysyms.h>
+#ifdef ZINC_USE_XINPUT
+#include <xcb/xinput.h>
+#endif
 
 #include "utils.h"
 #include "pizarra.h"
 #include "picker.h"
 #include "history.h"
+#include "image.h"
+#include "brush.h"
+#include "control.h"
+#include "timelapse.h"
+#include "clipboard.h"
+#include "expose.h"
+
+#ifdef ZINC_USE_VECTOR
+#ifdef ZINC_NO_HISTORY
+#error "ZINC_USE_VECTOR keeps the strokes in the history, it can't go without it"
+#endif
+#include "vector.h"
+#endif
 
 typedef struct {
 	bool active;
@@ -40,24 +58,126 @@ typedef struct {
 	int y;
 } DragInfo;
 
+typedef enum {
+	TOOL_BRUSH,
+	TOOL_BUCKET,
+	TOOL_LINE,
+	TOOL_RECT,
+	TOOL_SELECT
+} Tool;
+
 typedef struct {
 	bool active;
+	Tool tool;
 	uint32_t color;
 	int brush_size;
+	BrushEngine engine;
+	int start_x;
+	int start_y;
 	int last_x;
 	int last_y;
 	bool has_prev;
+
+	/* where the brush stroke is at, to a fraction of a pixel, and */
+	/* the server time of the sample it came from */
+	float stroke_x;
+	float stroke_y;
+	xcb_timestamp_t stroke_time;
 } DrawInfo;
 
+/* canvas rectangle selected, and the canvas positions the pointer */
+/* was pressed at and is at, all in canvas coordinates */
+typedef struct {
+	bool active;
+	int x, y, w, h;
+	int anchor_x, anchor_y;
+	int to_x, to_y;
+
+	/* being dragged somewhere else (copied, rather than moved, */
+	/* with shift held), rather than drawn */
+	bool dragging;
+	bool copy;
+
+	/* the outline is in the overlay */
+	bool shown;
+} Selection;
+
+#ifdef ZINC_USE_PREDICTION
+#define ZINC_PREDICT_MS 16
+#define ZINC_PREDICT_SAMPLES 3
+
+/* the last samples of the brush stroke, oldest first, and the tail */
+/* guessed ahead of them, drawn for show until the next ones come */
+typedef struct {
+	int n;
+	float x[ZINC_PREDICT_SAMPLES];
+	float y[ZINC_PREDICT_SAMPLES];
+	xcb_timestamp_t time[ZINC_PREDICT_SAMPLES];
+	bool shown;
+
+	/* where the pointer was guessed to be at that time, checked */
+	/* against where it was once the samples get there */
+	bool pending;
+	float guess_x, guess_y;
+	xcb_timestamp_t guess_time;
+
+	unsigned long tails, checked;
+	double lead_total, error_total, error_max;
+} Prediction;
+#endif
+
+#define ZINC_QUALITY_LEVELS 4
+#define ZINC_QUALITY_IDLE_MS 120
+
+/* how the brush stroke is drawn as the pointer moves: in full, then */
+/* hard edged, then only every second or fourth dab of it, stepping */
+/* down while batches of samples take longer than a frame to draw */
+/* and show and back up once they take a fraction of it; a stroke */
+/* drawn coarse is drawn again in full once the pointer stops */
+typedef struct {
+	int level;
+	int skip;
+	uint64_t cost, avg;
+
+	/* the dabs of the stroke so far, in canvas coordinates, and */
+	/* whether any of them was drawn coarse since the last refine, */
+	/* the first of those being dabs[from] */
+	bool recording;
+	bool coarse;
+	PizarraOp *dabs;
+	size_t ndabs, capdabs, from;
+
+	unsigned long batches, coarse_batches, refinements, redrawn;
+	uint64_t cost_total, cost_max;
+} Quality;
+
 #define ZINC_WM_NAME "zinc"
 #define ZINC_WM_CLASS "zinc\0zinc\0"
 #define ZINC_STROKE_SPACING_FACTOR 0.55f
+#define ZINC_FRAME_MS 16
+#define ZINC_TIMELAPSE_FPS 30
+#define ZINC_MOTION_GAP 24.0f
+#define ZINC_GAP_MS 8
+#define ZINC_GAP_HELD 64
+
+#define ZINC_EVENT_MASK (XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_KEY_PRESS | \
+		XCB_EVENT_MASK_BUTTON_PRESS | XCB_EVENT_MASK_BUTTON_RELEASE | \
+		XCB_EVENT_MASK_POINTER_MOTION | XCB_EVENT_MASK_STRUCTURE_NOTIFY)
 
 #ifndef ZINC_NO_HISTORY
 static History *hist;
 static HistoryUserAction *hist_last_action;
 #endif
 
+/* operations the actions (and the strokes sent to the control */
+/* socket) are replayed with, kept from one replay to the next */
+static PizarraOp *ops;
+static size_t nops, capops;
+
+#ifdef ZINC_USE_VECTOR
+static VectorIndex *vindex;
+#endif
+
 static Pizarra *pizarra;
 static Picker *picker;
 static xcb_connection_t *conn;
@@ -69,7 +189,64 @@ static xcb_cursor_t cursor_hand;
 static xcb_cursor_t cursor_crosshair;
 static DrawInfo drawinfo;
 static DragInfo draginfo;
+static Selection selection;
+static int view_width, view_height;
 static bool should_close;
+static bool print_stats;
+static const char *import_path;
+static const char *control_path;
+static size_t memory_budget;
+static int timelapse_dabs;
+static ControlServer *control;
+#ifndef ZINC_NO_HISTORY
+static Clipboard *clipboard;
+#endif
+
+/* the brush stroke drew something the window has yet to show, it is */
+/* rendered once the events at hand are all handled */
+static bool stroke_damaged;
+
+#ifdef ZINC_USE_PREDICTION
+static Prediction prediction;
+#endif
+
+static Quality quality;
+
+/* the kernel the dabs are drawn with, looked up again only when the */
+/* engine or size changes, and how long the dabs of every engine took */
+static struct {
+	BrushEngine engine;
+	int size;
+	BrushKernel kernel;
+	const int *spans;
+	unsigned long dabs[BRUSH_ENGINES];
+	uint64_t time[BRUSH_ENGINES];
+} brush;
+
+/* pointer samples handled, those taken back from the motion history */
+/* of the server, and the renders the strokes were shown in */
+static unsigned long motion_samples, motion_recovered, stroke_renders;
+
+/* the motion history asked for over a gap in the stroke, which is */
+/* not waited on: the samples coming after it are held until either */
+/* it comes or ZINC_GAP_MS pass and the gap is left a chord */
+static struct {
+	bool pending;
+	unsigned int sequence;
+	uint64_t deadline;
+	int n;
+	struct {
+		float x, y;
+		xcb_timestamp_t time;
+	} held[ZINC_GAP_HELD];
+} gap;
+
+#ifdef ZINC_USE_XINPUT
+/* XInput major opcode, 0 while the motion comes as core events */
+static uint8_t xi_opcode;
+#endif
+
+static Expose exposed;
 
 static xcb_atom_t
 get_x11_atom(const char *name)
@@ -92,6 +269,50 @@ get_x11_atom(const char *name)
 	return atom;
 }
 
+#ifdef ZINC_USE_XINPUT
+/* the pointer motion comes as XInput 2 events, with the fraction of */
+/* the pixel it is at, when the server has them, as core ones if not */
+static void
+xiinit(void)
+{
+	uint32_t mask;
+	const xcb_query_extension_reply_t *ext;
+	xcb_input_xi_query_version_reply_t *reply;
+	struct {
+		xcb_input_event_mask_t head;
+		uint32_t bits;
+	} xmask;
+
+	ext = xcb_get_extension_data(conn, &xcb_input_id);
+
+	if (NULL == ext || !ext->present)
+		return;
+
+	reply = xcb_input_xi_query_version_reply(conn,
+			xcb_input_xi_query_version(conn, 2, 0), NULL);
+
+	if (NULL == reply || reply->major_version < 2) {
+		free(reply);
+		return;
+	}
+
+	free(reply);
+
+	// raw motion is left alone, it comes before any acceleration
+	// and in device units, not where the pointer is on the window
+	xmask.head.deviceid = XCB_INPUT_DEVICE_ALL_MASTER;
+	xmask.head.mask_len = 1;
+	xmask.bits = XCB_INPUT_XI_EVENT_MASK_MOTION;
+	xcb_input_xi_select_events(conn, win, 1, &xmask.head);
+
+	// otherwise every sample would come twice
+	mask = ZINC_EVENT_MASK & ~XCB_EVENT_MASK_POINTER_MOTION;
+	xcb_change_window_attributes(conn, win, XCB_CW_EVENT_MASK, &mask);
+
+	xi_opcode = ext->major_opcode;
+}
+#endif
+
 static void
 xwininit(void)
 {
@@ -130,13 +351,8 @@ xwininit(void)
 		800, 600, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
 		scr->root_visual, XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK,
 		(const xcb_create_window_value_list_t []) {{
-			.background_pixel = 0x1e1e1e,
-			.event_mask = XCB_EVENT_MASK_EXPOSURE |
-			              XCB_EVENT_MASK_KEY_PRESS |
-			              XCB_EVENT_MASK_BUTTON_PRESS |
-			              XCB_EVENT_MASK_BUTTON_RELEASE |
-			              XCB_EVENT_MASK_POINTER_MOTION |
-			              XCB_EVENT_MASK_STRUCTURE_NOTIFY
+			.background_pixel = ZINC_BACKGROUND_COLOR,
+			.event_mask = ZINC_EVENT_MASK
 		}}
 	);
 
@@ -167,6 +383,11 @@ xwininit(void)
 		_NET_WM_STATE, XCB_ATOM_ATOM, 32, 1, &_NET_WM_STATE_FULLSCREEN);
 
 	xcb_change_window_attributes(conn, win, XCB_CW_CURSOR, &cursor_crosshair);
+
+#ifdef ZINC_USE_XINPUT
+	xiinit();
+#endif
+
 	xcb_map_window(conn, win);
 	xcb_flush(conn);
 }
@@ -182,71 +403,94 @@ xwindestroy(void)
 	xcb_disconnect(conn);
 }
 
-#ifndef ZINC_USE_ROUGH_BRUSH
-static inline uint8_t
-blerp(uint8_t from, uint8_t to, double v)
+/* stamps a dab centered at x, y of the window with the engine, a */
+/* row at a time */
+static void
+dab(int x, int y, uint32_t color, int size, BrushEngine engine)
 {
-	return from + ((to - from) * v);
-}
+	int dy, w;
+	uint64_t start;
+	uint32_t line[2 * BRUSH_MAX_SIZE];
+
+	if (NULL == brush.kernel || size != brush.size || engine != brush.engine) {
+		brush.engine = engine;
+		brush.size = size;
+		brush.kernel = brush_kernel(engine, size);
+		brush_prepare(engine, size);
+		brush.spans = brush_spans(size);
+	}
 
-static uint32_t
-color_lerp(uint32_t from, uint32_t to, double v)
-{
-	uint8_t r, g, b;
+	start = now_us();
 
-	v = v > 1 ? 1 : v < 0 ? 0 : v;
-	r = blerp((from >> 16) & 0xff, (to >> 16) & 0xff, v);
-	g = blerp((from >> 8) & 0xff, (to >> 8) & 0xff, v);
-	b = blerp(from & 0xff, to & 0xff, v);
+	// in the layer drawn on when there are layers
+	for (dy = -size; dy < size; ++dy) {
+		if ((w = brush.spans[dy + size]) < 0)
+			continue;
+		brush.kernel(line, size, dy, color);
+		pizarra_blend_span(pizarra, x - w, y + dy, line, 2 * w + 1);
+	}
 
-	return (r << 16) | (g << 8) | b;
+	brush.time[engine] += now_us() - start;
+	brush.dabs[engine]++;
 }
-#endif
 
 static void
 addpoint(int x, int y, uint32_t color, int size, bool add_to_history)
 {
-	int dx, dy;
-	uint32_t prevcol;
-
-#ifndef ZINC_NO_HISTORY
 	int canvasx, canvasy;
 
+	if (quality.recording && add_to_history) {
+		if (quality.ndabs == quality.capdabs) {
+			quality.capdabs = MAX(quality.capdabs * 2, 256);
+			quality.dabs = xrealloc(quality.dabs, quality.capdabs * sizeof(PizarraOp));
+		}
+		pizarra_camera_to_canvas_pos(pizarra, x, y, &canvasx, &canvasy);
+		quality.dabs[quality.ndabs++] = (PizarraOp) { .type = PIZARRA_OP_DAB,
+			.x = canvasx, .y = canvasy, .size = size, .color = color,
+			.engine = drawinfo.engine };
+	}
+
+#ifndef ZINC_NO_HISTORY
 	if (add_to_history) {
-		if (NULL == hist_last_action)
+		if (NULL == hist_last_action) {
 			hist_last_action = history_user_action_new();
+			hist_last_action->engine = drawinfo.engine;
+#ifdef ZINC_USE_LAYERS
+			hist_last_action->layer = pizarra_get_layer(pizarra);
+#endif
+		}
 		pizarra_camera_to_canvas_pos(pizarra, x, y, &canvasx, &canvasy);
 		history_user_action_push_atomic(hist_last_action,
 				history_atomic_action_new(canvasx, canvasy,
 					color, size));
 	}
-#else
-	(void) add_to_history;
 #endif
 
-	for (dy = -size; dy < size; ++dy) {
-		for (dx = -size; dx < size; ++dx) {
-			if (dy * dy + dx * dx >= size * size ||
-					!pizarra_get_pixel(pizarra, x + dx, y + dy, &prevcol))
-				continue;
-#ifdef ZINC_USE_ROUGH_BRUSH
-			pizarra_set_pixel(pizarra, x + dx, y + dy, color);
-#else
-			pizarra_set_pixel(pizarra, x + dx, y + dy,
-					color_lerp(color, prevcol,
-						sqrt(dy * dy + dx * dx) / size));
-#endif
+	// the history has every dab, only some are drawn and those
+	// hard edged while the stroke can't keep up
+	if (quality.recording && add_to_history && quality.level > 0) {
+		if (!quality.coarse)
+			quality.from = quality.ndabs - 1;
+		quality.coarse = true;
+		if (quality.skip > 0) {
+			--quality.skip;
+			return;
 		}
+		quality.skip = (1 << (quality.level - 1)) - 1;
+		dab(x, y, color, size, BRUSH_HARD);
+		return;
 	}
+
+	dab(x, y, color, size, drawinfo.engine);
 }
 
 static void
-addsegment(int x0, int y0, int x1, int y1, uint32_t color,
+addsegment(float x0, float y0, float x1, float y1, uint32_t color,
 		int size, bool add_to_history)
 {
-	int dx = x1 - x0;
-	int dy = y1 - y0;
-	float dist = sqrtf((float)(dx*dx + dy*dy));
+	float dx = x1 - x0;
+	float dy = y1 - y0;
+	float dist = sqrtf(dx*dx + dy*dy);
 	if (dist <= 0.0f) {
 		return;
 	}
@@ -266,238 +510,1627 @@ addsegment(int x0, int y0, int x1, int y1, uint32_t color,
 }
 
 #ifndef ZINC_NO_HISTORY
+/* what was copied to the clipboard is encoded again if the action */
+/* touched it */
 static void
-regenfromhist(void)
+damage(const HistoryUserAction *hua)
 {
-	int x, y;
-	HistoryUserAction *hua;
-	HistoryAtomicAction *haa;
+	int x0, y0, x1, y1;
 
-	for (hua = hist->root; hua != hist->current->next; hua = hua->next) {
-		for (haa = hua->aa; haa; haa = haa->next) {
-			pizarra_canvas_to_camera_pos(pizarra, haa->x, haa->y, &x, &y);
-			addpoint(x, y, haa->color, haa->size, false);
-		}
-	}
+	history_user_action_get_bounds(hua, &x0, &y0, &x1, &y1);
+	clipboard_damage(clipboard, x0, y0, x1, y1);
 }
 
 static void
-undo(void)
+commit(HistoryUserAction *hua)
 {
-	if (history_undo(hist)) {
-		pizarra_clear(pizarra);
-		regenfromhist();
-		pizarra_render(pizarra);
-	}
-}
+#ifdef ZINC_USE_VECTOR
+	HistoryUserAction *undone;
 
-static void
-redo(void)
-{
-	if (history_redo(hist)) {
-		pizarra_clear(pizarra);
-		regenfromhist();
-		pizarra_render(pizarra);
-	}
-}
+	// the redo history is about to go
+	for (undone = hist->current->next; undone; undone = undone->next)
+		vector_index_remove(vindex, undone);
 #endif
 
-static void
-center(void)
-{
-	pizarra_camera_move_to_center(pizarra);
-	pizarra_render(pizarra);
+	history_do(hist, hua);
+
+#ifdef ZINC_USE_VECTOR
+	vector_index_insert(vindex, hua);
+#endif
+
+	damage(hua);
 }
+#endif
 
+/* a line or rectangle from x0, y0 to x1, y1, with the brush */
 static void
-h_client_message(xcb_client_message_event_t *ev)
+addshape(Tool tool, int x0, int y0, int x1, int y1, uint32_t color,
+		int size, bool add_to_history)
 {
-	xcb_atom_t WM_DELETE_WINDOW;
-
-	WM_DELETE_WINDOW = get_x11_atom("WM_DELETE_WINDOW");
-
-	/* check if the wm sent a delete window message */
-	/* https://www.x.org/docs/ICCCM/icccm.pdf */
-	if (ev->data.data32[0] == WM_DELETE_WINDOW)
-		should_close = true;
+	addpoint(x0, y0, color, size, add_to_history);
+
+	if (tool == TOOL_LINE) {
+		addsegment(x0, y0, x1, y1, color, size, add_to_history);
+	} else {
+		addsegment(x0, y0, x1, y0, color, size, add_to_history);
+		addsegment(x1, y0, x1, y1, color, size, add_to_history);
+		addsegment(x1, y1, x0, y1, color, size, add_to_history);
+		addsegment(x0, y1, x0, y0, color, size, add_to_history);
+	}
 }
 
+/* steps the quality of the stroke down or up by what the batch of */
+/* samples just shown took to draw and show */
 static void
-h_expose(xcb_expose_event_t *ev)
+adapt(void)
 {
-	(void) ev;
-	pizarra_render(pizarra);
+	uint64_t budget;
+
+	budget = ZINC_FRAME_MS * 1000;
+	quality.avg = (3 * quality.avg + quality.cost) / 4;
+	quality.cost_total += quality.cost;
+	quality.cost_max = MAX(quality.cost_max, quality.cost);
+	quality.batches++;
+	quality.coarse_batches += quality.level > 0;
+	quality.cost = 0;
+
+	// the average is started halfway again at every step, it has
+	// to be over the budget or well under it for a few batches
+	if (quality.avg > budget && quality.level < ZINC_QUALITY_LEVELS - 1) {
+		quality.level++;
+		quality.avg = budget / 2;
+	} else if (quality.avg < budget / 4 && quality.level > 0) {
+		quality.level--;
+		quality.avg = budget / 2;
+	}
 }
 
+/* draws the stroke again, in full, where it was drawn coarse since */
+/* the last time: the area of those dabs is cleared, and every dab */
+/* reaching into it drawn again within it */
 static void
-h_key_press(xcb_key_press_event_t *ev)
+refine(void)
 {
-	xcb_keysym_t key;
+	int x, y, x0, y0, x1, y1;
+	const PizarraOp *d;
 
-	key = xcb_key_symbols_get_keysym(ksyms, ev->detail, 0);
+	if (!quality.coarse)
+		return;
 
-	if (picker_is_visible(picker))
-		picker_hide(picker);
+	x0 = y0 = INT32_MAX;
+	x1 = y1 = INT32_MIN;
 
-	if (ev->state & XCB_MOD_MASK_CONTROL) {
-		switch (key) {
-		case XKB_KEY_c: if (!drawinfo.active) center(); return;
-#ifndef ZINC_NO_HISTORY
-		case XKB_KEY_z: if (!drawinfo.active) undo(); return;
-		case XKB_KEY_y: if (!drawinfo.active) redo(); return;
-#endif
-		}
+	for (d = &quality.dabs[quality.from]; d < &quality.dabs[quality.ndabs]; ++d) {
+		x0 = MIN(x0, d->x - d->size);
+		y0 = MIN(y0, d->y - d->size);
+		x1 = MAX(x1, d->x + d->size + 1);
+		y1 = MAX(y1, d->y + d->size + 1);
 	}
 
-	switch (key) {
-	case XKB_KEY_r: drawinfo.color = 0xb81c00; break; /* Red */
-	case XKB_KEY_g: drawinfo.color = 0x50c878; break; /* Green */
-	case XKB_KEY_b: drawinfo.color = 0x1239e6; break; /* Blue */
-	case XKB_KEY_w: drawinfo.color = 0xffffff; break; /* White */
-	case XKB_KEY_q: drawinfo.color = 0x000000; break; /* Black */
-	case XKB_KEY_o: drawinfo.color = 0xcc551f; break; /* Orange */
-	case XKB_KEY_y: drawinfo.color = 0xffff00; break; /* Yellow */
-	case XKB_KEY_f: drawinfo.color = 0xca2c92; break; /* Fuchsia */
-	case XKB_KEY_t: drawinfo.color = 0x008080; break; /* Teal */
-	case XKB_KEY_c: drawinfo.color = 0xfffdd0; break; /* Cream */
+	pizarra_overlay_clip(pizarra, x0, y0, x1 - x0, y1 - y0);
+	pizarra_overlay_clear(pizarra);
+
+	for (d = quality.dabs; d < &quality.dabs[quality.ndabs]; ++d) {
+		if (d->x + d->size + 1 <= x0 || d->x - d->size >= x1
+				|| d->y + d->size + 1 <= y0 || d->y - d->size >= y1)
+			continue;
+		pizarra_canvas_to_camera_pos(pizarra, d->x, d->y, &x, &y);
+		dab(x, y, d->color, d->size, d->engine);
+		quality.redrawn++;
 	}
+
+	pizarra_overlay_clip(pizarra, 0, 0, 0, 0);
+
+	quality.coarse = false;
+	quality.skip = 0;
+	quality.refinements++;
 }
 
+#ifdef ZINC_USE_PREDICTION
+/* takes the guessed tail off the stroke, the real samples go where */
+/* it was */
 static void
-h_button_press(xcb_button_press_event_t *ev)
+untail(void)
 {
-	switch (ev->detail) {
-	case XCB_BUTTON_INDEX_1:
-		if (draginfo.active)
-			break;
-		picker_hide(picker);
-		drawinfo.active = true;
-		drawinfo.last_x = ev->event_x;
-		drawinfo.last_y = ev->event_y;
-		drawinfo.has_prev = true;
-		addpoint(ev->event_x, ev->event_y, drawinfo.color, drawinfo.brush_size, true);
-		pizarra_render(pizarra);
-		break;
-	case XCB_BUTTON_INDEX_2:
-		if (drawinfo.active)
-			break;
-		draginfo.active = true;
-		draginfo.x = ev->event_x;
-		draginfo.y = ev->event_y;
-		xcb_change_window_attributes(conn, win, XCB_CW_CURSOR, &cursor_hand);
-		xcb_flush(conn);
-		break;
-	case XCB_BUTTON_INDEX_3:
-		picker_set(picker, drawinfo.color);;
-		picker_show(picker, ev->event_x, ev->event_y);
-		break;
-	case XCB_BUTTON_INDEX_4:
-		pizarra_camera_move_relative(pizarra, 0, -30);
-		pizarra_render(pizarra);
-		break;
-	case XCB_BUTTON_INDEX_5:
-		pizarra_camera_move_relative(pizarra, 0, 30);
-		pizarra_render(pizarra);
-		break;
-	}
+	if (!prediction.shown)
+		return;
+
+	pizarra_overlay_rewind(pizarra);
+	prediction.shown = false;
 }
 
+/* a real sample of the brush stroke, the first one of it if first */
 static void
-h_motion_notify(xcb_motion_notify_event_t *ev)
+predictsample(float x, float y, xcb_timestamp_t time, bool first)
 {
-	int dx, dy;
-
-	if (draginfo.active) {
-		dx = draginfo.x - ev->event_x;
-		dy = draginfo.y - ev->event_y;
-
-		draginfo.x = ev->event_x;
-		draginfo.y = ev->event_y;
-
-		pizarra_camera_move_relative(pizarra, dx, dy);
-		pizarra_render(pizarra);
+	int last;
+	float f, ex, ey, err;
+
+	if (first)
+		prediction.n = 0, prediction.pending = false;
+
+	last = prediction.n - 1;
+
+	// the last guess, against the pointer between the samples
+	// around the time it was for
+	if (prediction.pending && last >= 0 && time >= prediction.guess_time) {
+		f = (float)(prediction.guess_time - prediction.time[last])
+			/ (float)(time - prediction.time[last]);
+		ex = prediction.x[last] + (x - prediction.x[last]) * f;
+		ey = prediction.y[last] + (y - prediction.y[last]) * f;
+		err = hypotf(ex - prediction.guess_x, ey - prediction.guess_y);
+		prediction.error_total += err;
+		prediction.error_max = MAX(prediction.error_max, err);
+		prediction.checked++;
+		prediction.pending = false;
 	}
 
-	if (drawinfo.active) {
-		if (drawinfo.has_prev) {
-			addsegment(drawinfo.last_x, drawinfo.last_y, ev->event_x, ev->event_y,
-					drawinfo.color, drawinfo.brush_size, true);
-		} else {
-			addpoint(ev->event_x, ev->event_y, drawinfo.color, drawinfo.brush_size, true);
-			drawinfo.has_prev = true;
+	// samples from the same millisecond are one and the same
+	if (last < 0 || time != prediction.time[last]) {
+		if (prediction.n == ZINC_PREDICT_SAMPLES) {
+			memmove(prediction.x, prediction.x + 1, --prediction.n * sizeof(float));
+			memmove(prediction.y, prediction.y + 1, prediction.n * sizeof(float));
+			memmove(prediction.time, prediction.time + 1,
+					prediction.n * sizeof(xcb_timestamp_t));
 		}
-		drawinfo.last_x = ev->event_x;
-		drawinfo.last_y = ev->event_y;
-		pizarra_render(pizarra);
+		last = prediction.n++;
 	}
+
+	prediction.x[last] = x;
+	prediction.y[last] = y;
+	prediction.time[last] = time;
 }
 
-static void
-h_button_release(xcb_button_release_event_t *ev)
+/* where the pointer will be ZINC_PREDICT_MS from its last sample, */
+/* with the speed and acceleration of the last three, never further */
+/* than twice what the speed alone takes it, nor back */
+static bool
+predict(float *x, float *y)
 {
-	switch (ev->detail) {
-	case XCB_BUTTON_INDEX_1:
-		drawinfo.active = false;
-		drawinfo.has_prev = false;
-#ifndef ZINC_NO_HISTORY
-		if (NULL == hist_last_action)
-			break;
-		history_do(hist, hist_last_action);
-		hist_last_action = NULL;
-#endif
-		break;
-	case XCB_BUTTON_INDEX_2:
-		draginfo.active = false;
-		xcb_change_window_attributes(conn, win, XCB_CW_CURSOR, &cursor_crosshair);
-		xcb_flush(conn);
-		break;
+	float dt0, dt1, vx0, vy0, vx1, vy1, ax, ay, h, dx, dy, len, max;
+
+	if (prediction.n < 3)
+		return false;
+
+	dt0 = prediction.time[1] - prediction.time[0];
+	dt1 = prediction.time[2] - prediction.time[1];
+
+	// a pause is no speed to go by
+	if (dt0 > 4 * ZINC_PREDICT_MS || dt1 > 4 * ZINC_PREDICT_MS)
+		return false;
+
+	vx0 = (prediction.x[1] - prediction.x[0]) / dt0;
+	vy0 = (prediction.y[1] - prediction.y[0]) / dt0;
+	vx1 = (prediction.x[2] - prediction.x[1]) / dt1;
+	vy1 = (prediction.y[2] - prediction.y[1]) / dt1;
+	ax = (vx1 - vx0) / ((dt0 + dt1) / 2);
+	ay = (vy1 - vy0) / ((dt0 + dt1) / 2);
+
+	h = ZINC_PREDICT_MS;
+	dx = vx1 * h + ax * h * h / 2;
+	dy = vy1 * h + ay * h * h / 2;
+
+	if (dx * vx1 + dy * vy1 <= 0)
+		return false;
+
+	len = hypotf(dx, dy);
+	max = 2 * hypotf(vx1, vy1) * h;
+
+	if (len > max) {
+		dx *= max / len;
+		dy *= max / len;
 	}
+
+	*x = prediction.x[2] + dx;
+	*y = prediction.y[2] + dy;
+
+	return true;
 }
 
+/* draws the stroke on to where the pointer is guessed to be next, */
+/* never into the history, taken back as the next samples come */
 static void
-h_configure_notify(xcb_configure_notify_event_t *ev)
+tail(void)
 {
-	pizarra_set_viewport(pizarra, ev->width, ev->height);
+	float x, y;
+
+	if (!drawinfo.active || drawinfo.tool != TOOL_BRUSH || !predict(&x, &y))
+		return;
+
+	pizarra_overlay_mark(pizarra);
+	addsegment(drawinfo.stroke_x, drawinfo.stroke_y, x, y, drawinfo.color,
+			drawinfo.brush_size, false);
+
+	prediction.shown = true;
+	prediction.pending = true;
+	prediction.guess_x = x;
+	prediction.guess_y = y;
+	prediction.guess_time = prediction.time[2] + ZINC_PREDICT_MS;
+	prediction.lead_total += hypotf(x - drawinfo.stroke_x, y - drawinfo.stroke_y);
+	prediction.tails++;
 }
+#endif
 
 static void
-h_mapping_notify(xcb_mapping_notify_event_t *ev)
+dash(int x, int y)
 {
-	if (ev->count > 0)
-		xcb_refresh_keyboard_mapping(ksyms, ev);
+	int cx, cy;
+
+	// black and white stripes that stay put as the camera moves
+	pizarra_camera_to_canvas_pos(pizarra, x, y, &cx, &cy);
+	pizarra_set_pixel(pizarra, x, y, (cx + cy) & 4 ? 0xffffff : 0x000000);
 }
 
+/* outlines the selection over the canvas, where it would land if */
+/* dropped, as far as it is in view so a selection of any size */
+/* takes the same to show */
 static void
-h_picker_color_change(Picker *picker, uint32_t color)
+showselection(void)
 {
-	(void) picker;
-	drawinfo.color = color;
+	int i, x0, y0, x1, y1, dx, dy;
+
+	if (!selection.shown) {
+		pizarra_overlay_begin(pizarra);
+		selection.shown = true;
+	} else {
+		pizarra_overlay_clear(pizarra);
+	}
+
+	if (pizarra_camera_get_zoom(pizarra) > 0)
+		return;
+
+	dx = selection.dragging ? selection.to_x - selection.anchor_x : 0;
+	dy = selection.dragging ? selection.to_y - selection.anchor_y : 0;
+
+	pizarra_canvas_to_camera_pos(pizarra, selection.x + dx, selection.y + dy, &x0, &y0);
+	x1 = x0 + selection.w - 1;
+	y1 = y0 + selection.h - 1;
+
+	for (i = MAX(x0, 0); i <= MIN(x1, view_width - 1); ++i) {
+		if (y0 >= 0 && y0 < view_height)
+			dash(i, y0);
+		if (y1 >= 0 && y1 < view_height)
+			dash(i, y1);
+	}
+
+	for (i = MAX(y0, 0); i <= MIN(y1, view_height - 1); ++i) {
+		if (x0 >= 0 && x0 < view_width)
+			dash(x0, i);
+		if (x1 >= 0 && x1 < view_width)
+			dash(x1, i);
+	}
 }
 
 static void
-usage(void)
+deselect(void)
 {
-	puts("usage: zinc [-hv]");
-	exit(0);
+	if (selection.shown)
+		pizarra_overlay_cancel(pizarra);
+
+	selection.active = false;
+	selection.dragging = false;
+	selection.shown = false;
 }
 
+/* moves, copies or erases the rectangle of the layer */
 static void
-version(void)
+moverect(HistorySelectionMode mode, int layer, int x, int y, int w, int h,
+		int dx, int dy)
 {
-	puts("zinc version "VERSION);
-	exit(0);
+#ifdef ZINC_USE_LAYERS
+	int current;
+
+	current = pizarra_get_layer(pizarra);
+	pizarra_set_layer(pizarra, layer);
+#else
+	(void) layer;
+#endif
+
+	if (mode == HISTORY_SELECTION_ERASE)
+		pizarra_erase_rect(pizarra, x, y, w, h);
+	else
+		pizarra_move_rect(pizarra, x, y, w, h, dx, dy,
+				mode == HISTORY_SELECTION_COPY);
+
+#ifdef ZINC_USE_LAYERS
+	pizarra_set_layer(pizarra, current);
+#endif
 }
 
-int
-main(int argc, char **argv)
+#ifdef ZINC_USE_VECTOR
+/* what is in the canvas rectangle, of the layer drawn on */
+static Image *
+snapshot(int x, int y, int w, int h)
 {
-	xcb_generic_event_t *ev;
+	int row;
+	Image *img;
+	uint32_t *line;
+
+	img = image_new(w, h);
+	line = xmalloc(w * sizeof(uint32_t));
+
+	for (row = 0; row < h; ++row) {
+		pizarra_read_row(pizarra, x, y + row, line, w);
+		image_set_row(img, row, line);
+	}
+
+	free(line);
+
+	return img;
+}
+#endif
+
+/* moves, copies or erases the selection for good */
+static void
+applyselection(HistorySelectionMode mode, int dx, int dy)
+{
+	int layer;
+#ifndef ZINC_NO_HISTORY
+	HistoryUserAction *hua;
+#endif
+
+#ifdef ZINC_USE_LAYERS
+	layer = pizarra_get_layer(pizarra);
+#else
+	layer = 0;
+#endif
+
+	// the canvas under the outline is put back first, and all
+	// of what is selected brought into memory
+	if (selection.shown)
+		pizarra_overlay_cancel(pizarra);
+	selection.shown = false;
+	pizarra_fetch(pizarra, selection.y, selection.h);
+
+#ifndef ZINC_NO_HISTORY
+	hua = history_user_action_selection_new(mode, selection.x, selection.y,
+			selection.w, selection.h, dx, dy);
+	hua->layer = layer;
+#ifdef ZINC_USE_VECTOR
+	// the chunks are drawn again on their own, what was moved has
+	// to be known without the canvas it came from
+	if (mode != HISTORY_SELECTION_ERASE)
+		hua->selection.image = snapshot(selection.x, selection.y,
+				selection.w, selection.h);
+#endif
+#endif
+
+	moverect(mode, layer, selection.x, selection.y, selection.w,
+			selection.h, dx, dy);
+
+#ifndef ZINC_NO_HISTORY
+	commit(hua);
+#endif
+
+	selection.x += dx;
+	selection.y += dy;
+}
+
+static void
+fill(int x, int y)
+{
+	int nspans;
+	PizarraSpan *spans;
+#ifndef ZINC_NO_HISTORY
+	int i;
+	HistoryUserAction *hua;
+#endif
+
+	nspans = pizarra_flood_fill(pizarra, x, y, drawinfo.color, &spans);
+
+	if (0 == nspans)
+		return;
+
+#ifndef ZINC_NO_HISTORY
+	hua = history_user_action_fill_new(drawinfo.color, nspans);
+#ifdef ZINC_USE_LAYERS
+	hua->layer = pizarra_get_layer(pizarra);
+#endif
+
+	for (i = 0; i < nspans; ++i) {
+		hua->fill.spans[i].y = spans[i].y;
+		hua->fill.spans[i].x0 = spans[i].x0;
+		hua->fill.spans[i].x1 = spans[i].x1;
+	}
+
+	commit(hua);
+#endif
+
+	free(spans);
+	pizarra_render(pizarra);
+}
+
+/* puts the image on the canvas, with its top left corner at the */
+/* top left corner of the window */
+static void
+import(const char *path)
+{
+	int x, y, w, h, row;
+	uint32_t *line;
+	const char *error;
+	ImageReader *ir;
+#ifndef ZINC_NO_HISTORY
+	Image *img;
+	HistoryUserAction *hua;
+#endif
+
+	if (NULL == (ir = image_reader_open(path, &error)))
+		die("can't import %s: %s", path, error);
+
+	w = image_reader_width(ir);
+	h = image_reader_height(ir);
+	line = xmalloc(w * sizeof(uint32_t));
+	pizarra_camera_to_canvas_pos(pizarra, 0, 0, &x, &y);
+
+#ifndef ZINC_NO_HISTORY
+	img = image_new(w, h);
+#endif
+
+	// every row goes from the file onto the canvas, and into the
+	// tiles the history keeps, without the whole image in memory
+	for (row = 0; row < h && image_reader_read_row(ir, line); ++row) {
+		pizarra_blend_row(pizarra, x, y + row, line, w);
+#ifndef ZINC_NO_HISTORY
+		image_set_row(img, row, line);
+#endif
+	}
+
+	if (row < h)
+		fprintf(stderr, "zinc: %s is truncated, imported %d of %d rows\n",
+				path, row, h);
+
+	image_reader_close(ir);
+	free(line);
+
+#ifndef ZINC_NO_HISTORY
+	hua = history_user_action_image_new(x, y, img);
+#ifdef ZINC_USE_LAYERS
+	hua->layer = pizarra_get_layer(pizarra);
+#endif
+	commit(hua);
+#endif
+}
+
+static PizarraOp *
+addop(PizarraOpType type, int layer, int x, int y, int size)
+{
+	if (nops == capops) {
+		capops = MAX(capops * 2, 1024);
+		ops = xrealloc(ops, capops * sizeof(PizarraOp));
+	}
+
+	ops[nops] = (PizarraOp) { .type = type, .layer = layer, .x = x,
+		.y = y, .size = size };
+
+	return &ops[nops++];
+}
+
+#ifndef ZINC_NO_HISTORY
+#ifdef ZINC_USE_VECTOR
+/* the selection action drawn without the canvas it came from: */
+/* its rectangle blanked, then what was in it put where it went */
+static void
+addselectionops(const HistoryUserAction *hua)
+{
+	static const uint32_t blank[IMAGE_TILE];
+	int row, tx, x, y, w, h;
+	const Image *img;
+	const uint32_t *tile;
+
+	x = hua->selection.x;
+	y = hua->selection.y;
+	w = hua->selection.w;
+	h = hua->selection.h;
+
+	if (hua->selection.mode != HISTORY_SELECTION_COPY)
+		for (row = 0; row < h; ++row)
+			for (tx = 0; tx * IMAGE_TILE < w; ++tx)
+				addop(PIZARRA_OP_COPY, hua->layer, x + tx * IMAGE_TILE, y + row,
+						MIN(IMAGE_TILE, w - tx * IMAGE_TILE))->src = blank;
+
+	if (hua->selection.mode == HISTORY_SELECTION_ERASE)
+		return;
+
+	img = hua->selection.image;
+
+	for (row = 0; row < h; ++row) {
+		for (tx = 0; tx < img->tiles_x; ++tx) {
+			tile = img->tiles[(row / IMAGE_TILE) * img->tiles_x + tx];
+			addop(PIZARRA_OP_COPY, hua->layer, x + hua->selection.dx + tx * IMAGE_TILE,
+					y + hua->selection.dy + row, MIN(IMAGE_TILE, w - tx * IMAGE_TILE))->src
+					= NULL != tile ? &tile[(row % IMAGE_TILE) * IMAGE_TILE] : blank;
+		}
+	}
+}
+#endif
+
+/* adds the operations that draw the action to the ones to replay */
+static void
+addops(const HistoryUserAction *hua)
+{
+	int i, row, tx;
+	const HistoryAtomicAction *haa;
+	const Image *img;
+	PizarraOp *op;
+
+	switch (hua->type) {
+	case HISTORY_ACTION_STROKE:
+		for (haa = hua->aa; haa; haa = haa->next) {
+			op = addop(PIZARRA_OP_DAB, hua->layer, haa->x, haa->y, haa->size);
+			op->color = haa->color;
+			op->engine = hua->engine;
+		}
+		break;
+	case HISTORY_ACTION_FILL:
+		for (i = 0; i < hua->fill.nspans; ++i)
+			addop(PIZARRA_OP_SPAN, hua->layer, hua->fill.spans[i].x0,
+					hua->fill.spans[i].y, hua->fill.spans[i].x1
+					- hua->fill.spans[i].x0)->color = hua->fill.color;
+		break;
+	case HISTORY_ACTION_IMAGE:
+		img = hua->image.image;
+		for (row = 0; row < img->height; ++row)
+			for (tx = 0; tx < img->tiles_x; ++tx)
+				if (NULL != img->tiles[(row / IMAGE_TILE) * img->tiles_x + tx])
+					addop(PIZARRA_OP_ROW, hua->layer, hua->image.x + tx * IMAGE_TILE,
+							hua->image.y + row, MIN(IMAGE_TILE, img->width
+							- tx * IMAGE_TILE))->src = &img->tiles[(row / IMAGE_TILE)
+							* img->tiles_x + tx][(row % IMAGE_TILE) * IMAGE_TILE];
+		break;
+	case HISTORY_ACTION_SELECTION:
+#ifdef ZINC_USE_VECTOR
+		addselectionops(hua);
+#else
+		// it moves what the actions before it drew, which have to
+		// be on the canvas by then
+		pizarra_replay(pizarra, ops, nops);
+		nops = 0;
+		moverect(hua->selection.mode, hua->layer, hua->selection.x,
+				hua->selection.y, hua->selection.w, hua->selection.h,
+				hua->selection.dx, hua->selection.dy);
+#endif
+		break;
+	}
+}
+
+#ifdef ZINC_USE_VECTOR
+/* draws the actions that reach into the rectangle, up to where */
+/* the history stands, the stroke still being drawn is kept in */
+/* the overlay until it is done */
+static void
+load(Pizarra *piz, int x, int y, int w, int h, void *data)
+{
+	int i, n;
+	HistoryUserAction **huas;
+
+	(void) data;
+
+	n = vector_index_query(vindex, x, y, w, h, &huas);
+
+	for (nops = 0, i = 0; i < n && huas[i]->id <= hist->current->id; ++i)
+		addops(huas[i]);
+
+	pizarra_replay(piz, ops, nops);
+}
+#endif
+
+static void
+regenfromhist(void)
+{
+#ifdef ZINC_USE_VECTOR
+	// only the chunks in memory are drawn, the rest are when
+	// they are loaded again
+	pizarra_reload(pizarra);
+#else
+	HistoryUserAction *hua;
+
+	pizarra_clear(pizarra);
+
+	for (nops = 0, hua = hist->root; hua != hist->current->next; hua = hua->next)
+		addops(hua);
+
+	pizarra_replay(pizarra, ops, nops);
+#endif
+}
+
+static void
+undo(void)
+{
+	deselect();
+	damage(hist->current);
+
+	if (history_undo(hist)) {
+		regenfromhist();
+		pizarra_render(pizarra);
+	}
+}
+
+static void
+redo(void)
+{
+	deselect();
+
+	if (history_redo(hist)) {
+		damage(hist->current);
+		regenfromhist();
+		pizarra_render(pizarra);
+	}
+}
+
+/* the bounds of all that was drawn and not undone, false if there */
+/* is nothing */
+static bool
+inked(int *x0, int *y0, int *x1, int *y1)
+{
+	int ax0, ay0, ax1, ay1;
+	HistoryUserAction *hua;
+
+	*x0 = *y0 = INT32_MAX;
+	*x1 = *y1 = INT32_MIN;
+
+	for (hua = hist->root; hua != hist->current->next; hua = hua->next) {
+		history_user_action_get_bounds(hua, &ax0, &ay0, &ax1, &ay1);
+		if (ax0 >= ax1 || ay0 >= ay1)
+			continue;
+		*x0 = MIN(*x0, ax0);
+		*y0 = MIN(*y0, ay0);
+		*x1 = MAX(*x1, ax1);
+		*y1 = MAX(*y1, ay1);
+	}
+
+	return *x0 < *x1 && *y0 < *y1;
+}
+
+/* what was inked of the canvas, x, y, w, h, into the next frame */
+static void
+shoot(Timelapse *tl, int x, int y, int w, int h)
+{
+	int row;
+	uint32_t *frame;
+
+	frame = timelapse_frame(tl);
+
+	for (row = 0; row < h; ++row)
+		pizarra_read_shown_row(pizarra, x, y + row, &frame[row*w], w);
+
+	timelapse_push(tl);
+}
+
+/* writes the session to stdout as it was drawn, a frame for every */
+/* timelapse_dabs operations: the canvas is cleared once and the */
+/* history replayed onto it bit by bit, ending as it was */
+static void
+timelapse(void)
+{
+	int x0, y0, x1, y1, w, h;
+	size_t from;
+	HistoryUserAction *hua;
+	Timelapse *tl;
+
+	if (!inked(&x0, &y0, &x1, &y1)) {
+		fprintf(stderr, "zinc: nothing was drawn, no timelapse written\n");
+		return;
+	}
+
+	// the chroma is halved both ways, the frame takes in a
+	// blank column or row more when the drawing is odd
+	w = x1 - x0 + ((x1 - x0) & 1);
+	h = y1 - y0 + ((y1 - y0) & 1);
+
+	if (w > TIMELAPSE_MAX_SIDE || h > TIMELAPSE_MAX_SIDE) {
+		fprintf(stderr, "zinc: the drawing is %dx%d, more than a timelapse "
+				"frame can take, no timelapse written\n", w, h);
+		return;
+	}
+
+	deselect();
+	pizarra_overlay_cancel(pizarra);
+#ifdef ZINC_USE_VECTOR
+	// a chunk evicted halfway would miss the frames after it
+	pizarra_set_memory_budget(pizarra, 0);
+#endif
+	pizarra_fetch(pizarra, y0, h);
+	pizarra_clear(pizarra);
+
+	tl = timelapse_new(stdout, w, h, ZINC_TIMELAPSE_FPS);
+
+	for (nops = 0, hua = hist->root; hua != hist->current->next; hua = hua->next) {
+		addops(hua);
+		for (from = 0; nops - from >= (size_t)(timelapse_dabs); from += timelapse_dabs) {
+			pizarra_replay(pizarra, &ops[from], timelapse_dabs);
+			shoot(tl, x0, y0, w, h);
+		}
+		memmove(ops, &ops[from], (nops - from) * sizeof(PizarraOp));
+		nops -= from;
+	}
+
+	if (nops > 0) {
+		pizarra_replay(pizarra, ops, nops);
+		shoot(tl, x0, y0, w, h);
+		nops = 0;
+	}
+
+	timelapse_flush(tl);
+
+	if (print_stats)
+		timelapse_print_stats(tl, stderr);
+
+	timelapse_destroy(tl);
+}
+
+/* the canvas as it is, for the clipboard to encode, without the */
+/* outline of the selection */
+static void
+readregion(int x, int y, int w, int h, uint32_t *px, void *data)
+{
+	int row;
+
+	(void) data;
+
+	if (selection.shown)
+		pizarra_overlay_clear(pizarra);
+
+	pizarra_fetch(pizarra, y, h);
+
+	for (row = 0; row < h; ++row)
+		pizarra_read_shown_row(pizarra, x, y + row, &px[row*w], w);
+
+	if (selection.shown)
+		showselection();
+}
+
+/* offers the selection, or everything inked if there is none, on */
+/* the clipboard */
+static void
+copy(xcb_timestamp_t time)
+{
+	int x0, y0, x1, y1;
+
+	if (selection.active && !selection.dragging) {
+		x0 = selection.x;
+		y0 = selection.y;
+		x1 = x0 + selection.w;
+		y1 = y0 + selection.h;
+	} else if (!inked(&x0, &y0, &x1, &y1)) {
+		return;
+	}
+
+	if (x0 < x1 && y0 < y1 && !clipboard_set(clipboard, x0, y0, x1 - x0, y1 - y0, time))
+		fprintf(stderr, "zinc: %dx%d pixels are more than can be copied\n",
+				x1 - x0, y1 - y0);
+}
+#endif
+
+/* drops the stroke being drawn, which never reached the canvas, */
+/* or the selection */
+static void
+cancel(void)
+{
+#ifdef ZINC_USE_PREDICTION
+	untail();
+#endif
+	deselect();
+	if (gap.pending) {
+		xcb_discard_reply(conn, gap.sequence);
+		gap.pending = false;
+		gap.n = 0;
+	}
+	pizarra_overlay_cancel(pizarra);
+	drawinfo.active = false;
+	drawinfo.has_prev = false;
+	quality.recording = quality.coarse = false;
+	quality.ndabs = 0;
+
+#ifndef ZINC_NO_HISTORY
+	if (NULL != hist_last_action) {
+		history_user_action_destroy(hist_last_action);
+		hist_last_action = NULL;
+	}
+#endif
+
+	pizarra_render(pizarra);
+}
+
+static void
+center(void)
+{
+	pizarra_camera_move_to_center(pizarra);
+	if (selection.active)
+		showselection();
+	pizarra_render(pizarra);
+}
+
+static void
+zoom(int levels, int x, int y)
+{
+	pizarra_camera_zoom(pizarra, levels, x, y);
+	if (selection.active)
+		showselection();
+	pizarra_render(pizarra);
+}
+
+/* draws the operations gathered from the control socket so far */
+static void
+flushops(void)
+{
+	pizarra_replay(pizarra, ops, nops);
+	nops = 0;
+}
+
+/* a stroke sent to the control socket, in canvas coordinates: its */
+/* dabs are spaced as those of the mouse and drawn with the same */
+/* stamps, but gathered to be drawn along with the rest of the batch */
+static void
+addcontrolstroke(const ControlCommand *cmd)
+{
+	int i, j, steps, layer, x, y;
+	float dx, dy, spacing;
+	const ControlPoint *p;
+	PizarraOp *op;
+#ifndef ZINC_NO_HISTORY
+	HistoryUserAction *hua;
+#endif
+
+#ifdef ZINC_USE_LAYERS
+	layer = pizarra_get_layer(pizarra);
+#else
+	layer = 0;
+#endif
+
+#ifndef ZINC_NO_HISTORY
+	hua = history_user_action_new();
+	hua->layer = layer;
+	hua->engine = cmd->engine;
+#endif
+
+	spacing = MAX(cmd->size * ZINC_STROKE_SPACING_FACTOR, 1.0f);
+
+	for (i = 0; i < cmd->npoints; ++i) {
+		p = &cmd->points[i];
+		dx = i > 0 ? (float)(p->x) - p[-1].x : 0;
+		dy = i > 0 ? (float)(p->y) - p[-1].y : 0;
+		steps = i > 0 ? (int)ceilf(sqrtf(dx*dx + dy*dy) / spacing) : 1;
+
+		for (j = 1; j <= steps; ++j) {
+			x = i > 0 ? (int)lroundf(p[-1].x + dx / steps * j) : p->x;
+			y = i > 0 ? (int)lroundf(p[-1].y + dy / steps * j) : p->y;
+			op = addop(PIZARRA_OP_DAB, layer, x, y, cmd->size);
+			op->color = cmd->color;
+			op->engine = cmd->engine;
+#ifndef ZINC_NO_HISTORY
+			history_user_action_push_atomic(hua,
+					history_atomic_action_new(x, y, cmd->color, cmd->size));
+#endif
+		}
+	}
+
+#ifndef ZINC_NO_HISTORY
+	commit(hua);
+#endif
+}
+
+static void
+h_control_command(const ControlCommand *cmd, void *data)
+{
+	(void) data;
+
+	switch (cmd->op) {
+	case CONTROL_STROKE:
+		// the replay would go under the outline, in the overlay
+		deselect();
+		addcontrolstroke(cmd);
+		break;
+	case CONTROL_CAMERA:
+		flushops();
+		pizarra_camera_move_relative(pizarra, cmd->a, cmd->b);
+		if (selection.active)
+			showselection();
+		break;
+#ifndef ZINC_NO_HISTORY
+	case CONTROL_UNDO:
+		flushops();
+		undo();
+		break;
+	case CONTROL_REDO:
+		flushops();
+		redo();
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+static void
+h_client_message(xcb_client_message_event_t *ev)
+{
+	xcb_atom_t WM_DELETE_WINDOW;
+
+	WM_DELETE_WINDOW = get_x11_atom("WM_DELETE_WINDOW");
+
+	/* check if the wm sent a delete window message */
+	/* https://www.x.org/docs/ICCCM/icccm.pdf */
+	if (ev->data.data32[0] == WM_DELETE_WINDOW)
+		should_close = true;
+}
+
+static void
+h_expose(xcb_expose_event_t *ev)
+{
+	int i;
+
+	// the exposed rectangles are repainted once the server says
+	// no more are coming
+	if (!expose_add(&exposed, ev))
+		return;
+
+	for (i = 0; i < exposed.nrects; ++i)
+		pizarra_render_region(pizarra, exposed.rects[i].x, exposed.rects[i].y,
+				exposed.rects[i].width, exposed.rects[i].height);
+}
+
+static void
+h_key_press(xcb_key_press_event_t *ev)
+{
+	xcb_keysym_t key;
+
+	key = xcb_key_symbols_get_keysym(ksyms, ev->detail, 0);
+
+	if (picker_is_visible(picker))
+		picker_hide(picker);
+
+	if (ev->state & XCB_MOD_MASK_CONTROL) {
+		switch (key) {
+#ifndef ZINC_NO_HISTORY
+		case XKB_KEY_c:
+			if (drawinfo.active)
+				return;
+			if (ev->state & XCB_MOD_MASK_SHIFT)
+				copy(ev->time);
+			else
+				center();
+			return;
+#else
+		case XKB_KEY_c: if (!drawinfo.active) center(); return;
+#endif
+#ifndef ZINC_NO_HISTORY
+		case XKB_KEY_z: if (!drawinfo.active) undo(); return;
+		case XKB_KEY_y: if (!drawinfo.active) redo(); return;
+#endif
+#ifdef ZINC_USE_LAYERS
+		case XKB_KEY_1: case XKB_KEY_2: case XKB_KEY_3: case XKB_KEY_4:
+		case XKB_KEY_5: case XKB_KEY_6: case XKB_KEY_7: case XKB_KEY_8:
+		case XKB_KEY_9:
+			pizarra_toggle_layer(pizarra, key - XKB_KEY_1);
+			pizarra_render(pizarra);
+#ifndef ZINC_NO_HISTORY
+			clipboard_damage(clipboard, INT32_MIN, INT32_MIN, INT32_MAX, INT32_MAX);
+#endif
+			return;
+#endif
+		}
+	}
+
+	switch (key) {
+	case XKB_KEY_r: drawinfo.color = 0xb81c00; break; /* Red */
+	case XKB_KEY_g: drawinfo.color = 0x50c878; break; /* Green */
+	case XKB_KEY_b: drawinfo.color = 0x1239e6; break; /* Blue */
+	case XKB_KEY_w: drawinfo.color = 0xffffff; break; /* White */
+	case XKB_KEY_q: drawinfo.color = 0x000000; break; /* Black */
+	case XKB_KEY_o: drawinfo.color = 0xcc551f; break; /* Orange */
+	case XKB_KEY_y: drawinfo.color = 0xffff00; break; /* Yellow */
+	case XKB_KEY_f: drawinfo.color = 0xca2c92; break; /* Fuchsia */
+	case XKB_KEY_t: drawinfo.color = 0x008080; break; /* Teal */
+	case XKB_KEY_c: drawinfo.color = 0xfffdd0; break; /* Cream */
+	case XKB_KEY_1: drawinfo.tool = TOOL_BRUSH; break;
+	case XKB_KEY_2: drawinfo.tool = TOOL_BUCKET; break;
+	case XKB_KEY_3: drawinfo.tool = TOOL_LINE; break;
+	case XKB_KEY_4: drawinfo.tool = TOOL_RECT; break;
+	case XKB_KEY_5: drawinfo.tool = TOOL_SELECT; break;
+	case XKB_KEY_e:
+		if (!drawinfo.active)
+			drawinfo.engine = (drawinfo.engine + 1) % BRUSH_ENGINES;
+		break;
+	case XKB_KEY_Escape:
+		if (drawinfo.active) {
+			cancel();
+		} else if (selection.active) {
+			deselect();
+			pizarra_render(pizarra);
+		}
+		break;
+	case XKB_KEY_Delete:
+	case XKB_KEY_BackSpace:
+		if (!drawinfo.active && selection.active) {
+			applyselection(HISTORY_SELECTION_ERASE, 0, 0);
+			deselect();
+			pizarra_render(pizarra);
+		}
+		break;
+#ifdef ZINC_USE_LAYERS
+	case XKB_KEY_Tab:
+		if (!drawinfo.active)
+			pizarra_set_layer(pizarra, (pizarra_get_layer(pizarra) + 1) % ZINC_LAYERS);
+		break;
+#endif
+	case XKB_KEY_minus: if (!drawinfo.active) zoom(1, ev->event_x, ev->event_y); break;
+	case XKB_KEY_plus:
+	case XKB_KEY_equal: if (!drawinfo.active) zoom(-1, ev->event_x, ev->event_y); break;
+	}
+}
+
+static void
+h_button_press(xcb_button_press_event_t *ev)
+{
+	switch (ev->detail) {
+	case XCB_BUTTON_INDEX_1:
+		if (draginfo.active)
+			break;
+		picker_hide(picker);
+		// the overview is only for finding the way around,
+		// a click goes back to drawing at that spot
+		if (pizarra_camera_get_zoom(pizarra) > 0) {
+			zoom(-pizarra_camera_get_zoom(pizarra), ev->event_x, ev->event_y);
+			break;
+		}
+		if (drawinfo.tool == TOOL_SELECT) {
+			pizarra_camera_to_canvas_pos(pizarra, ev->event_x, ev->event_y,
+					&selection.anchor_x, &selection.anchor_y);
+			selection.to_x = selection.anchor_x;
+			selection.to_y = selection.anchor_y;
+			// pressed inside the selection it is dragged along,
+			// anywhere else a new one is drawn
+			selection.dragging = selection.active
+				&& selection.anchor_x >= selection.x
+				&& selection.anchor_x < selection.x + selection.w
+				&& selection.anchor_y >= selection.y
+				&& selection.anchor_y < selection.y + selection.h;
+			selection.copy = ev->state & XCB_MOD_MASK_SHIFT;
+			if (!selection.dragging) {
+				selection.x = selection.anchor_x;
+				selection.y = selection.anchor_y;
+				selection.w = selection.h = 1;
+			}
+			selection.active = true;
+			drawinfo.active = true;
+			showselection();
+			pizarra_render(pizarra);
+			break;
+		}
+		deselect();
+		if (drawinfo.tool == TOOL_BUCKET) {
+			fill(ev->event_x, ev->event_y);
+			break;
+		}
+		// the stroke is kept apart until the button is released,
+		// shapes are drawn there again as the pointer moves
+		pizarra_overlay_begin(pizarra);
+		drawinfo.active = true;
+		drawinfo.start_x = drawinfo.last_x = ev->event_x;
+		drawinfo.start_y = drawinfo.last_y = ev->event_y;
+		drawinfo.stroke_x = ev->event_x;
+		drawinfo.stroke_y = ev->event_y;
+		drawinfo.stroke_time = ev->time;
+		drawinfo.has_prev = true;
+		quality.recording = drawinfo.tool == TOOL_BRUSH;
+		quality.coarse = false;
+		quality.skip = 0;
+		quality.ndabs = 0;
+#ifdef ZINC_USE_PREDICTION
+		predictsample(ev->event_x, ev->event_y, ev->time, true);
+#endif
+		addpoint(ev->event_x, ev->event_y, drawinfo.color, drawinfo.brush_size,
+				drawinfo.tool == TOOL_BRUSH);
+		pizarra_render(pizarra);
+		break;
+	case XCB_BUTTON_INDEX_2:
+		if (drawinfo.active)
+			break;
+		draginfo.active = true;
+		draginfo.x = ev->event_x;
+		draginfo.y = ev->event_y;
+		xcb_change_window_attributes(conn, win, XCB_CW_CURSOR, &cursor_hand);
+		xcb_flush(conn);
+		break;
+	case XCB_BUTTON_INDEX_3:
+		picker_set(picker, drawinfo.color);;
+		picker_show(picker, ev->event_x, ev->event_y);
+		break;
+	case XCB_BUTTON_INDEX_4:
+		pizarra_camera_move_relative(pizarra, 0, -30);
+		if (selection.active)
+			showselection();
+		pizarra_render(pizarra);
+		break;
+	case XCB_BUTTON_INDEX_5:
+		pizarra_camera_move_relative(pizarra, 0, 30);
+		if (selection.active)
+			showselection();
+		pizarra_render(pizarra);
+		break;
+	}
+}
+
+/* the brush stroke, on to the pointer at x, y at the given time */
+static void
+strokesample(float x, float y, xcb_timestamp_t time)
+{
+	uint64_t start;
+
+	start = now_us();
+	if (drawinfo.has_prev) {
+		addsegment(drawinfo.stroke_x, drawinfo.stroke_y, x, y,
+				drawinfo.color, drawinfo.brush_size, true);
+	} else {
+		addpoint(floorf(x), floorf(y), drawinfo.color, drawinfo.brush_size, true);
+		drawinfo.has_prev = true;
+	}
+	drawinfo.last_x = floorf(x);
+	drawinfo.last_y = floorf(y);
+	drawinfo.stroke_x = x;
+	drawinfo.stroke_y = y;
+	drawinfo.stroke_time = time;
+	stroke_damaged = true;
+	quality.cost += now_us() - start;
+#ifdef ZINC_USE_PREDICTION
+	predictsample(x, y, time, false);
+#endif
+}
+
+/* asks the server for the positions it kept between the last sample */
+/* of the stroke and this one, which are too far apart to be joined */
+/* by a straight chord, the samples that come meanwhile are held */
+static bool
+askstroke(xcb_timestamp_t time)
+{
+	// some servers keep no history at all
+	if (0 == xcb_get_setup(conn)->motion_buffer_size
+			|| time - drawinfo.stroke_time < 2)
+		return false;
+
+	gap.sequence = xcb_get_motion_events(conn, win,
+			drawinfo.stroke_time + 1, time - 1).sequence;
+	gap.deadline = now_us() + ZINC_GAP_MS * 1000;
+	gap.pending = true;
+	gap.n = 0;
+	xcb_flush(conn);
+
+	return true;
+}
+
+/* the positions the server kept, if it answered, then the samples */
+/* held while waiting for them */
+static void
+recoverstroke(xcb_get_motion_events_reply_t *reply)
+{
+	int i, n;
+	xcb_timecoord_t *tc;
+
+#ifdef ZINC_USE_PREDICTION
+	untail();
+#endif
+
+	if (NULL != reply) {
+		tc = xcb_get_motion_events_events(reply);
+		n = xcb_get_motion_events_events_length(reply);
+		for (i = 0; i < n; ++i)
+			strokesample(tc[i].x, tc[i].y, tc[i].time);
+		motion_recovered += n;
+	}
+
+	gap.pending = false;
+
+	for (i = 0; i < gap.n; ++i)
+		strokesample(gap.held[i].x, gap.held[i].y, gap.held[i].time);
+
+	gap.n = 0;
+}
+
+/* the motion history, once it came or it is waited on no longer, */
+/* that is after ZINC_GAP_MS or right away if now is set */
+static void
+pollstroke(bool now)
+{
+	void *reply;
+	xcb_generic_error_t *err;
+
+	reply = NULL;
+	err = NULL;
+
+	if (xcb_poll_for_reply(conn, gap.sequence, &reply, &err)) {
+		// an error is the history being lost, the gap is drawn
+		// as a chord like it would be without one
+		free(err);
+		recoverstroke(reply);
+		free(reply);
+	} else if (now || now_us() >= gap.deadline) {
+		xcb_discard_reply(conn, gap.sequence);
+		recoverstroke(NULL);
+	}
+}
+
+/* a sample that came while the motion history is waited on */
+static void
+holdsample(float x, float y, xcb_timestamp_t time)
+{
+	if (gap.n == ZINC_GAP_HELD) {
+		pollstroke(true);
+		strokesample(x, y, time);
+		return;
+	}
+
+	gap.held[gap.n].x = x;
+	gap.held[gap.n].y = y;
+	gap.held[gap.n++].time = time;
+}
+
+/* the pointer at x, y on the window, in pixels and a fraction of one */
+/* with XInput, at the given server time */
+static void
+motion(float x, float y, xcb_timestamp_t time)
+{
+	int ix, iy, dx, dy;
+
+	ix = floorf(x);
+	iy = floorf(y);
+
+	++motion_samples;
+
+	if (draginfo.active) {
+		dx = draginfo.x - ix;
+		dy = draginfo.y - iy;
+
+		draginfo.x = ix;
+		draginfo.y = iy;
+
+		pizarra_camera_move_relative(pizarra, dx, dy);
+		if (selection.active)
+			showselection();
+		pizarra_render(pizarra);
+	}
+
+	if (drawinfo.active && drawinfo.tool == TOOL_SELECT) {
+		pizarra_camera_to_canvas_pos(pizarra, ix, iy,
+				&selection.to_x, &selection.to_y);
+		if (!selection.dragging) {
+			selection.x = MIN(selection.anchor_x, selection.to_x);
+			selection.y = MIN(selection.anchor_y, selection.to_y);
+			selection.w = abs(selection.to_x - selection.anchor_x) + 1;
+			selection.h = abs(selection.to_y - selection.anchor_y) + 1;
+		}
+		showselection();
+		pizarra_render(pizarra);
+	} else if (drawinfo.active && drawinfo.tool != TOOL_BRUSH) {
+		pizarra_overlay_clear(pizarra);
+		addshape(drawinfo.tool, drawinfo.start_x, drawinfo.start_y, ix, iy,
+				drawinfo.color, drawinfo.brush_size, false);
+		drawinfo.last_x = ix;
+		drawinfo.last_y = iy;
+		pizarra_render(pizarra);
+	} else if (drawinfo.active && gap.pending) {
+		holdsample(x, y, time);
+	} else if (drawinfo.active) {
+#ifdef ZINC_USE_PREDICTION
+		untail();
+#endif
+		if (drawinfo.has_prev && hypotf(x - drawinfo.stroke_x,
+					y - drawinfo.stroke_y) > ZINC_MOTION_GAP && askstroke(time))
+			holdsample(x, y, time);
+		else
+			strokesample(x, y, time);
+	}
+}
+
+static void
+h_motion_notify(xcb_motion_notify_event_t *ev)
+{
+	motion(ev->event_x, ev->event_y, ev->time);
+}
+
+#ifdef ZINC_USE_XINPUT
+static void
+h_generic(xcb_ge_generic_event_t *ev)
+{
+	xcb_input_motion_event_t *mev;
+
+	if (0 == xi_opcode || ev->extension != xi_opcode
+			|| ev->event_type != XCB_INPUT_MOTION)
+		return;
+
+	mev = (void *)(ev);
+
+	if (mev->event != win)
+		return;
+
+	motion(mev->event_x / 65536.0f, mev->event_y / 65536.0f, mev->time);
+}
+#endif
+
+static void
+h_button_release(xcb_button_release_event_t *ev)
+{
+	switch (ev->detail) {
+	case XCB_BUTTON_INDEX_1:
+		if (!drawinfo.active)
+			break;
+		if (drawinfo.tool == TOOL_SELECT) {
+			drawinfo.active = false;
+			if (selection.dragging && (selection.to_x != selection.anchor_x
+						|| selection.to_y != selection.anchor_y))
+				applyselection(selection.copy ? HISTORY_SELECTION_COPY
+						: HISTORY_SELECTION_MOVE, selection.to_x - selection.anchor_x,
+						selection.to_y - selection.anchor_y);
+			selection.dragging = false;
+			// a click without dragging selects nothing
+			if (selection.w > 1 && selection.h > 1)
+				showselection();
+			else
+				deselect();
+			pizarra_render(pizarra);
+			break;
+		}
+		// the stroke ends where the pointer was let go, what the
+		// server kept of the gap is used only if it came by now
+		if (gap.pending)
+			pollstroke(true);
+#ifdef ZINC_USE_PREDICTION
+		// only what the pointer went through is kept
+		untail();
+#endif
+		// the shape as it was last seen is the one kept
+		if (drawinfo.tool != TOOL_BRUSH) {
+			pizarra_overlay_clear(pizarra);
+			addshape(drawinfo.tool, drawinfo.start_x, drawinfo.start_y,
+					drawinfo.last_x, drawinfo.last_y, drawinfo.color,
+					drawinfo.brush_size, true);
+		}
+		refine();
+		quality.recording = false;
+		pizarra_overlay_commit(pizarra);
+		pizarra_render(pizarra);
+		drawinfo.active = false;
+		drawinfo.has_prev = false;
+#ifndef ZINC_NO_HISTORY
+		if (NULL == hist_last_action)
+			break;
+		commit(hist_last_action);
+		hist_last_action = NULL;
+#endif
+		break;
+	case XCB_BUTTON_INDEX_2:
+		draginfo.active = false;
+		xcb_change_window_attributes(conn, win, XCB_CW_CURSOR, &cursor_crosshair);
+		xcb_flush(conn);
+		break;
+	}
+}
+
+static void
+h_configure_notify(xcb_configure_notify_event_t *ev)
+{
+	view_width = ev->width;
+	view_height = ev->height;
+	pizarra_set_viewport(pizarra, ev->width, ev->height);
+}
+
+static void
+h_mapping_notify(xcb_mapping_notify_event_t *ev)
+{
+	if (ev->count > 0)
+		xcb_refresh_keyboard_mapping(ksyms, ev);
+}
+
+static void
+h_picker_color_change(Picker *picker, uint32_t color)
+{
+	(void) picker;
+	drawinfo.color = color;
+}
+
+static void
+h_event(xcb_generic_event_t *ev)
+{
+	// check if it is an event targeted to our color picker
+	if (picker_try_process_event(picker, ev))
+		return;
+
+	// or to the canvas itself (scroll copies)
+	if (pizarra_try_process_event(pizarra, ev))
+		return;
+
+#ifndef ZINC_NO_HISTORY
+	// or to whoever is pasting what was copied
+	if (clipboard_try_process_event(clipboard, ev))
+		return;
+#endif
+
+	switch (ev->response_type & ~0x80) {
+	case XCB_CLIENT_MESSAGE:     h_client_message((void *)(ev)); break;
+	case XCB_EXPOSE:             h_expose((void *)(ev)); break;
+	case XCB_KEY_PRESS:          h_key_press((void *)(ev)); break;
+	case XCB_BUTTON_PRESS:       h_button_press((void *)(ev)); break;
+	case XCB_MOTION_NOTIFY:      h_motion_notify((void *)(ev)); break;
+	case XCB_BUTTON_RELEASE:     h_button_release((void *)(ev)); break;
+	case XCB_CONFIGURE_NOTIFY:   h_configure_notify((void *)(ev)); break;
+	case XCB_MAPPING_NOTIFY:     h_mapping_notify((void *)(ev)); break;
+#ifdef ZINC_USE_XINPUT
+	case XCB_GE_GENERIC:         h_generic((void *)(ev)); break;
+#endif
+	}
+}
+
+static void
+run(void)
+{
+	int i, n, nctl, nrend, timeout;
+	uint64_t start;
+	bool commands, idle;
+	struct pollfd pfds[4 + CONTROL_MAX_CLIENTS];
+	xcb_generic_event_t *ev;
+
+	pfds[0].fd = xcb_get_file_descriptor(conn);
+	pfds[0].events = POLLIN;
+
+	while (!should_close) {
+		while (!should_close && (ev = xcb_poll_for_event(conn))) {
+			h_event(ev);
+			free(ev);
+		}
+
+		if (gap.pending)
+			pollstroke(false);
+
+		// every sample that came in the same batch is drawn by
+		// now, they are all shown at once
+		if (stroke_damaged) {
+			start = now_us();
+#ifdef ZINC_USE_PREDICTION
+			tail();
+#endif
+			pizarra_render(pizarra);
+			stroke_damaged = false;
+			++stroke_renders;
+			quality.cost += now_us() - start;
+			adapt();
+		}
+
+		if (should_close || xcb_connection_has_error(conn))
+			break;
+
+		// replies waited on while drawing may have brought events
+		// along, queued where poll() on the socket can't see them
+		if ((ev = xcb_poll_for_queued_event(conn))) {
+			h_event(ev);
+			free(ev);
+			continue;
+		}
+
+		// keep rendering while there is damage left that did
+		// not fit in the upload budget of the last frame
+		timeout = pizarra_has_pending_uploads(pizarra) ? ZINC_FRAME_MS : -1;
+
+#ifdef ZINC_USE_PREDICTION
+		// nor leave a tail out where the pointer stopped
+		if (prediction.shown)
+			timeout = ZINC_PREDICT_MS;
+#endif
+
+		// nor a coarse stroke where it rests for a while
+		if ((idle = quality.coarse && timeout < 0))
+			timeout = ZINC_QUALITY_IDLE_MS;
+
+		// nor the motion history past the time it is waited for
+		if (gap.pending && (timeout < 0 || timeout > ZINC_GAP_MS)) {
+			timeout = ZINC_GAP_MS;
+			idle = false;
+		}
+
+		// the control socket waits while a stroke is drawn by
+		// hand, what it sends is drawn once the stroke is done
+		nctl = 1;
+		if (NULL != control && !drawinfo.active)
+			nctl += control_get_pollfds(control, &pfds[1], 1 + CONTROL_MAX_CLIENTS);
+
+		n = nctl;
+#ifndef ZINC_NO_HISTORY
+		// encodings for the clipboard are done on a thread of
+		// their own, which says so through this one
+		pfds[n].fd = clipboard_get_pollfd(clipboard);
+		pfds[n].events = POLLIN;
+		pfds[n++].revents = 0;
+#endif
+
+		// the render thread reads replies off the connection, and
+		// with them events that poll() on it alone would miss
+		if ((pfds[nrend = n].fd = pizarra_get_pollfd(pizarra)) >= 0) {
+			pfds[n].events = POLLIN;
+			pfds[n++].revents = 0;
+		}
+
+		if (poll(pfds, n, timeout) == 0) {
+#ifdef ZINC_USE_PREDICTION
+			untail();
+#endif
+			if (idle)
+				refine();
+			pizarra_render(pizarra);
+		}
+
+#ifndef ZINC_NO_HISTORY
+		if (pfds[nctl].revents != 0)
+			clipboard_process(clipboard);
+#endif
+
+		if (nrend < n && pfds[nrend].revents != 0)
+			pizarra_drain_pollfd(pizarra);
+
+		for (commands = false, i = 1; i < nctl; ++i)
+			commands = commands || pfds[i].revents != 0;
+
+		if (commands && control_process(control, h_control_command, NULL) > 0) {
+			flushops();
+			pizarra_render(pizarra);
+		}
+	}
+}
+
+static void
+usage(void)
+{
+	puts("usage: zinc [-hsv] [-i image] [-l socket] [-m MiB] [-t dabs]");
+	exit(0);
+}
+
+static void
+version(void)
+{
+	puts("zinc version "VERSION);
+	exit(0);
+}
+
+int
+main(int argc, char **argv)
+{
+	int i;
+	char *end;
+	unsigned long long mib;
 
 	while (++argv, --argc > 0) {
 		if ((*argv)[0] == '-' && (*argv)[1] != '\0' && (*argv)[2] == '\0') {
 			switch ((*argv)[1]) {
 			case 'h': usage(); break;
+			case 's': print_stats = true; break;
 			case 'v': version(); break;
+			case 'i':
+				if (--argc == 0)
+					die("option -i needs a file");
+				import_path = *++argv;
+				break;
+			case 'l':
+				if (--argc == 0)
+					die("option -l needs a socket path");
+				control_path = *++argv;
+				break;
+			case 't':
+				if (--argc == 0)
+					die("option -t needs a number of dabs");
+				if ((timelapse_dabs = atoi(*++argv)) <= 0)
+					die("invalid number of dabs: %s", *argv);
+#ifdef ZINC_NO_HISTORY
+				die("zinc was compiled without history, there is no timelapse");
+#endif
+				break;
+			case 'm':
+				if (--argc == 0)
+					die("option -m needs a size in MiB");
+				// strtoull() would take a sign or spaces, and wrap
+				// around on a negative number
+				mib = strtoull(*++argv, &end, 10);
+				if ((*argv)[0] < '0' || (*argv)[0] > '9' || *end != '\0'
+						|| 0 == mib || mib > SIZE_MAX / (1024 * 1024))
+					die("invalid memory budget: %s", *argv);
+				memory_budget = (size_t)(mib) * 1024 * 1024;
+				break;
 			default: die("invalid option %s", *argv); break;
 			}
 		} else {
@@ -509,6 +2142,8 @@ main(int argc, char **argv)
 
 	drawinfo.color = 0xffffff;
 	drawinfo.brush_size = 5;
+	view_width = 800;
+	view_height = 600;
 	drawinfo.has_prev = false;
 
 	pizarra = pizarra_new(conn, win);
@@ -516,37 +2151,93 @@ main(int argc, char **argv)
 
 #ifndef ZINC_NO_HISTORY
 	hist = history_new();
+	clipboard = clipboard_new(conn, win, readregion, NULL);
 #endif
 
-	while (!should_close && (ev = xcb_wait_for_event(conn))) {
+#ifdef ZINC_USE_VECTOR
+	vindex = vector_index_new();
+	pizarra_set_loader(pizarra, load, NULL);
+#endif
 
-		// check if it is an event targeted to our color picker
-		if (picker_try_process_event(picker, ev)) {
-			free(ev);
-			continue;
-		}
+	if (memory_budget > 0)
+		pizarra_set_memory_budget(pizarra, memory_budget);
 
-		switch (ev->response_type & ~0x80) {
-		case XCB_CLIENT_MESSAGE:     h_client_message((void *)(ev)); break;
-		case XCB_EXPOSE:             h_expose((void *)(ev)); break;
-		case XCB_KEY_PRESS:          h_key_press((void *)(ev)); break;
-		case XCB_BUTTON_PRESS:       h_button_press((void *)(ev)); break;
-		case XCB_MOTION_NOTIFY:      h_motion_notify((void *)(ev)); break;
-		case XCB_BUTTON_RELEASE:     h_button_release((void *)(ev)); break;
-		case XCB_CONFIGURE_NOTIFY:   h_configure_notify((void *)(ev)); break;
-		case XCB_MAPPING_NOTIFY:     h_mapping_notify((void *)(ev)); break;
-		}
+	if (NULL != import_path)
+		import(import_path);
+
+	if (NULL != control_path)
+		control = control_new(control_path);
 
-		free(ev);
+	run();
+
+#ifndef ZINC_NO_HISTORY
+	if (print_stats)
+		clipboard_print_stats(clipboard, stderr);
+	clipboard_destroy(clipboard);
+#endif
+
+#ifndef ZINC_NO_HISTORY
+	if (timelapse_dabs > 0)
+		timelapse();
+#endif
+
+	if (NULL != control) {
+		if (print_stats)
+			control_print_stats(control, stderr);
+		control_destroy(control);
 	}
 
+#ifdef ZINC_USE_VECTOR
+	vector_index_destroy(vindex);
+#endif
+
 #ifndef ZINC_NO_HISTORY
 	history_destroy(hist);
 #endif
 
+	free(ops);
+	free(quality.dabs);
+
+	if (print_stats) {
+#ifdef ZINC_USE_XINPUT
+		fprintf(stderr, "input: %s, ", xi_opcode ? "xinput 2" : "core events");
+#else
+		fprintf(stderr, "input: core events, ");
+#endif
+		fprintf(stderr, "%lu motion samples (%lu from the motion history), "
+				"strokes shown in %lu renders\n", motion_samples,
+				motion_recovered, stroke_renders);
+#ifdef ZINC_USE_PREDICTION
+		if (prediction.tails > 0)
+			fprintf(stderr, "prediction: %lu tails %d ms ahead, %.1f px long on "
+					"average, off by %.2f px on average (max %.2f)\n",
+					prediction.tails, ZINC_PREDICT_MS,
+					prediction.lead_total / prediction.tails,
+					prediction.checked ? prediction.error_total / prediction.checked : 0.0,
+					prediction.error_max);
+#endif
+		for (i = 0; i < BRUSH_ENGINES; ++i)
+			if (brush.dabs[i] > 0)
+				fprintf(stderr, "brush: %s, %lu dabs drawn in the window, avg %.2f us\n",
+						brush_engine_name(i), brush.dabs[i],
+						(double)(brush.time[i]) / brush.dabs[i]);
+		if (quality.batches > 0)
+			fprintf(stderr, "quality: %lu stroke batches (%lu coarse), avg %.2f ms, "
+					"max %.2f ms, %lu refinements (%lu dabs drawn again)\n",
+					quality.batches, quality.coarse_batches,
+					quality.cost_total / 1000.0 / quality.batches,
+					quality.cost_max / 1000.0, quality.refinements, quality.redrawn);
+		pizarra_print_stats(pizarra, stderr);
+	}
+
 	pizarra_destroy(pizarra);
 	picker_destroy(picker);
+	brush_free();
 	xwindestroy();
 
+	// by now all that is still live was never given back
+	if (print_stats)
+		alloc_print_stats(stderr);
+
 	return 0;
 }
@@ -0,0 +1,288 @@
+/*
+	Copyright (C) 2025 <alpheratz99@protonmail.com>
+
+	This program is free software; you can redistribute it and/or modify it
+	under the terms of the GNU General Public License version 2 as published by
+	the Free Software Foundation.
+
+	This program is distributed in the hope that it will be useful, but WITHOUT
+	ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+	more details.
+
+	You should have received a copy of the GNU General Public License along
+	with this program; if not, write to the Free Software Foundation, Inc., 59
+	Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+*/
+
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "utils.h"
+#include "brush.h"
+#include "control.h"
+
+/* bytes gathered before they are written, a batch of commands */
+#define ZINCCTL_BUFFER_SIZE (64 * 1024)
+
+/* points of every stroke the load generator sends, and the size */
+/* of the area they are drawn in */
+#define ZINCCTL_BENCH_POINTS 256
+#define ZINCCTL_BENCH_WIDTH 800
+#define ZINCCTL_BENCH_HEIGHT 600
+
+static int fd;
+static uint8_t buf[ZINCCTL_BUFFER_SIZE];
+static size_t len;
+static unsigned long long sent;
+
+static void
+flush(void)
+{
+	size_t off;
+	ssize_t n;
+
+	for (off = 0; off < len; off += n)
+		if ((n = write(fd, &buf[off], len - off)) < 0)
+			die("write failed: %s", strerror(errno));
+
+	sent += len;
+	len = 0;
+}
+
+static void
+put(const void *data, size_t size)
+{
+	if (len + size > sizeof(buf))
+		flush();
+	memcpy(&buf[len], data, size);
+	len += size;
+}
+
+static void
+command(ControlOp op, int a, int b)
+{
+	put(&(ControlHeader) { .op = op, .a = a, .b = b }, sizeof(ControlHeader));
+}
+
+static void
+point(int x, int y)
+{
+	put(&(ControlPoint) { .x = x, .y = y }, sizeof(ControlPoint));
+}
+
+static bool
+is(const char *word, const char *p, const char *end)
+{
+	return (size_t)(end - p) == strlen(word) && 0 == strncmp(word, p, end - p);
+}
+
+/* the brush engine named in [p, end), -1 if there is none */
+static int
+engine(const char *p, const char *end)
+{
+	int e;
+
+	for (e = 0; e < BRUSH_ENGINES; ++e)
+		if (is(brush_engine_name(e), p, end))
+			return e;
+
+	return -1;
+}
+
+/* one command a line, as in zincctl(1) */
+static void
+script(void)
+{
+	int n, lineno;
+	long x, y;
+	char *line, *p, *end, *args;
+	size_t cap;
+
+	line = NULL;
+	cap = 0;
+
+	for (lineno = 1; getline(&line, &cap, stdin) > 0; ++lineno) {
+		p = line + strspn(line, " \t");
+		args = p + strcspn(p, " \t\n");
+
+		if (*p == '\n' || *p == '#' || *p == '\0')
+			continue;
+
+		if (is("color", p, args)) {
+			command(CONTROL_COLOR, strtol(args, NULL, 16), 0);
+		} else if (is("size", p, args)) {
+			command(CONTROL_SIZE, strtol(args, NULL, 10), 0);
+		} else if (is("camera", p, args)) {
+			x = strtol(args, &end, 10);
+			y = strtol(end, NULL, 10);
+			if (labs(x) > CONTROL_MAX_COORD || labs(y) > CONTROL_MAX_COORD)
+				die("line %d: the camera moves too far", lineno);
+			command(CONTROL_CAMERA, x, y);
+		} else if (is("undo", p, args)) {
+			command(CONTROL_UNDO, 0, 0);
+		} else if (is("redo", p, args)) {
+			command(CONTROL_REDO, 0, 0);
+		} else if (is("brush", p, args)) {
+			p = args + strspn(args, " \t");
+			if ((n = engine(p, p + strcspn(p, " \t\n"))) < 0)
+				die("line %d: unknown brush", lineno);
+			command(CONTROL_BRUSH, n, 0);
+		} else if (is("stroke", p, args)) {
+			// counted first, the header goes before the points
+			for (n = 0, p = args; ; ++n, p = end) {
+				strtol(p, &end, 10);
+				if (end == p)
+					break;
+			}
+			if (n < 2 || n % 2 != 0 || n / 2 > CONTROL_MAX_POINTS)
+				die("line %d: a stroke needs pairs of coordinates", lineno);
+			command(CONTROL_STROKE, n / 2, 0);
+			for (p = args; n > 0; n -= 2) {
+				x = strtol(p, &end, 10);
+				y = strtol(end, &p, 10);
+				if (labs(x) > CONTROL_MAX_COORD || labs(y) > CONTROL_MAX_COORD)
+					die("line %d: a point is too far out", lineno);
+				point(x, y);
+			}
+		} else {
+			die("line %d: unknown command", lineno);
+		}
+	}
+
+	free(line);
+}
+
+/* random walks whose every point is one dab, at least as many as */
+/* asked for, returns how many */
+static long
+bench(long dabs, int brush, int size)
+{
+	int i, x, y;
+	long left;
+
+	srand(time(NULL));
+	command(CONTROL_SIZE, size, 0);
+	command(CONTROL_BRUSH, brush, 0);
+
+	for (left = dabs; left > 0; left -= ZINCCTL_BENCH_POINTS) {
+		command(CONTROL_COLOR, rand() & 0xffffff, 0);
+		command(CONTROL_STROKE, ZINCCTL_BENCH_POINTS, 0);
+
+		x = rand() % ZINCCTL_BENCH_WIDTH;
+		y = rand() % ZINCCTL_BENCH_HEIGHT;
+
+		// steps shorter than the dab spacing, never zero
+		for (i = 0; i < ZINCCTL_BENCH_POINTS; ++i) {
+			x += rand() % 2 ? 2 : -2;
+			y += rand() % 3 - 1;
+			point(x, y);
+		}
+	}
+
+	return dabs - left;
+}
+
+static void
+usage(void)
+{
+	puts("usage: zincctl [-h] [-b dabs] [-e brush] [-s size] socket");
+	exit(0);
+}
+
+int
+main(int argc, char **argv)
+{
+	int brush, size;
+	long dabs;
+	double elapsed;
+	uint64_t start;
+	const char *path;
+	struct sockaddr_un addr;
+
+	dabs = 0;
+	brush = BRUSH_SOFT;
+	size = 5;
+	path = NULL;
+
+	while (++argv, --argc > 0) {
+		if ((*argv)[0] == '-' && (*argv)[1] != '\0' && (*argv)[2] == '\0') {
+			switch ((*argv)[1]) {
+			case 'h': usage(); break;
+			case 'b':
+				if (--argc == 0)
+					die("option -b needs a number of dabs");
+				dabs = strtol(*++argv, NULL, 10);
+				break;
+			case 'e':
+				if (--argc == 0)
+					die("option -e needs a brush");
+				++argv;
+				if ((brush = engine(*argv, *argv + strlen(*argv))) < 0)
+					die("unknown brush: %s", *argv);
+				break;
+			case 's':
+				if (--argc == 0)
+					die("option -s needs a brush size");
+				if ((size = atoi(*++argv)) < 1 || size > BRUSH_MAX_SIZE)
+					die("invalid brush size: %s", *argv);
+				break;
+			default: die("invalid option %s", *argv); break;
+			}
+		} else if (NULL == path) {
+			path = *argv;
+		} else {
+			die("unexpected argument: %s", *argv);
+		}
+	}
+
+	if (NULL == path)
+		usage();
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		die("socket path too long: %s", path);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		die("can't create socket: %s", strerror(errno));
+
+	if (connect(fd, (struct sockaddr *)(&addr), sizeof(addr)) < 0)
+		die("can't connect to %s: %s", path, strerror(errno));
+
+	start = now_us();
+
+	if (dabs > 0)
+		dabs = bench(dabs, brush, size);
+	else
+		script();
+
+	flush();
+
+	// zinc hangs up once it took in all that was sent
+	shutdown(fd, SHUT_WR);
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	elapsed = (now_us() - start) / 1e6;
+
+	if (dabs > 0)
+		printf("%ld dabs (%llu KiB) in %.3f s, %.0f dabs/s\n",
+				dabs, sent / 1024, elapsed, dabs / elapsed);
+
+	close(fd);
+
+	return 0;
+}